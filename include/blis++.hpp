@@ -142,8 +142,23 @@ detail::complex_op<T,U,bool,true> operator>=(const T& a, const U& b)
 
 #include "blis++_memory.hpp"
 #include "blis++_matrix.hpp"
+#include "blis++_autotune.hpp"
+#include "blis++_batch.hpp"
+#include "blis++_checkpoint.hpp"
+#include "blis++_compact.hpp"
+#include "blis++_counters.hpp"
+#include "blis++_file.hpp"
+#include "blis++_lapack.hpp"
+#include "blis++_mapped.hpp"
+#include "blis++_outofcore.hpp"
 #include "blis++_partition.hpp"
+#include "blis++_recorder.hpp"
+#include "blis++_recursive.hpp"
 #include "blis++_scalar.hpp"
+#include "blis++_tasks.hpp"
+#include "blis++_thread.hpp"
+#include "blis++_tsqr.hpp"
 #include "blis++_vector.hpp"
+#include "blis++_view.hpp"
 
 #endif
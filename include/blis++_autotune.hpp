@@ -0,0 +1,341 @@
+#ifndef _BLISPP_AUTOTUNE_HPP_
+#define _BLISPP_AUTOTUNE_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "blis/blis.h"
+
+namespace blis
+{
+
+namespace detail
+{
+    /*
+     * Sizes are bucketed in half-octaves, so that 1000 and 1100 share
+     * measurements but 1000 and 1500 do not.
+     */
+    inline int autotune_bucket(dim_t size)
+    {
+        return (int)std::lround(2*std::log2((double)std::max(size, dim_t(1))));
+    }
+
+    inline char datatype_char(num_t dt)
+    {
+        switch (dt)
+        {
+            case BLIS_FLOAT:    return 's';
+            case BLIS_DOUBLE:   return 'd';
+            case BLIS_SCOMPLEX: return 'c';
+            case BLIS_DCOMPLEX: return 'z';
+            default: throw std::logic_error("unsupported datatype");
+        }
+    }
+
+    inline std::string default_autotune_path()
+    {
+        const char* path = getenv("BLISPP_AUTOTUNE_CACHE");
+        if (path) return path;
+
+        const char* home = getenv("HOME");
+        if (home) return std::string(home) + "/.blis++_autotune";
+
+        return "";
+    }
+}
+
+/*
+ * Block sizes measured per (operation, datatype, shape bucket, thread
+ * count) and kept in a small text file, one measurement per line:
+ *
+ *     potrf d 20 20 20 2 96 0.0123
+ *
+ * (operation, datatype, bucketed m, n and k, bucketed thread count, best
+ * block size and its time in seconds). tune() runs the measurements and
+ * updates the file; block_size() looks the answer up, interpolating in
+ * log space between the nearest measured shapes when there is no exact
+ * match and returning the caller's default when the operation has never
+ * been tuned for this datatype.
+ *
+ * The file is BLISPP_AUTOTUNE_CACHE if set, otherwise ~/.blis++_autotune.
+ * It is machine specific and should not be shared between node types.
+ */
+class Autotuner
+{
+    public:
+        struct Record
+        {
+            std::string op;
+            char dt;
+            int m;
+            int n;
+            int k;
+            int threads;
+            dim_t nb;
+            double seconds;
+        };
+
+    private:
+        std::string _path;
+        std::vector<Record> _records;
+        std::mutex _mutex;
+
+        static std::vector<Record> read(const std::string& path)
+        {
+            std::vector<Record> records;
+            std::ifstream ifs(path);
+            std::string line;
+
+            while (std::getline(ifs, line))
+            {
+                if (line.empty() || line[0] == '#') continue;
+
+                std::istringstream iss(line);
+                Record r;
+                if (iss >> r.op >> r.dt >> r.m >> r.n >> r.k >> r.threads >> r.nb >> r.seconds)
+                    insert(records, r);
+            }
+
+            return records;
+        }
+
+        /*
+         * Persist the measurement just made. Several processes may be
+         * tuning against the same file, so under an exclusive lock on
+         * path.lock the file is read again, the new measurement merged
+         * into what is on disk (which also picks up other processes'
+         * measurements here), and the result written to a uniquely named
+         * file which is renamed over the old one, so that a concurrent
+         * reader never sees a partial cache.
+         */
+        void save(const Record& latest)
+        {
+            if (_path.empty()) return;
+
+            std::string lock_path = _path + ".lock";
+            int lock = open(lock_path.c_str(), O_RDWR|O_CREAT|O_CLOEXEC, 0644);
+            if (lock < 0 || flock(lock, LOCK_EX) != 0)
+            {
+                if (lock >= 0) close(lock);
+                throw std::runtime_error("cannot lock " + lock_path);
+            }
+
+            try
+            {
+                std::vector<Record> merged = read(_path);
+                for (const Record& r : _records)
+                    if (!find(merged, r)) merged.push_back(r);
+                insert(merged, latest);
+
+                std::string tmp = _path + ".XXXXXX";
+                int fd = mkstemp(&tmp[0]);
+                if (fd < 0) throw std::runtime_error("cannot write " + tmp);
+                fchmod(fd, 0644);
+                close(fd);
+
+                {
+                    std::ofstream ofs(tmp);
+                    ofs << "# op dt m n k threads nb seconds\n";
+                    for (const Record& r : merged)
+                        ofs << r.op << ' ' << r.dt << ' ' << r.m << ' ' << r.n << ' '
+                            << r.k << ' ' << r.threads << ' ' << r.nb << ' '
+                            << r.seconds << '\n';
+
+                    if (!ofs)
+                    {
+                        std::remove(tmp.c_str());
+                        throw std::runtime_error("cannot write " + tmp);
+                    }
+                }
+
+                if (std::rename(tmp.c_str(), _path.c_str()) != 0)
+                {
+                    std::remove(tmp.c_str());
+                    throw std::runtime_error("cannot write " + _path);
+                }
+
+                _records.swap(merged);
+            }
+            catch (...)
+            {
+                close(lock);
+                throw;
+            }
+
+            close(lock);
+        }
+
+        static Record* find(std::vector<Record>& records, const Record& r)
+        {
+            for (Record& old : records)
+                if (old.op == r.op && old.dt == r.dt && old.m == r.m &&
+                    old.n == r.n && old.k == r.k && old.threads == r.threads)
+                    return &old;
+
+            return nullptr;
+        }
+
+        static void insert(std::vector<Record>& records, const Record& r)
+        {
+            Record* old = find(records, r);
+            if (old)
+                *old = r;
+            else
+                records.push_back(r);
+        }
+
+        static Record key(const std::string& op, num_t dt, dim_t m, dim_t n,
+                          dim_t k, int threads)
+        {
+            return {op, detail::datatype_char(dt), detail::autotune_bucket(m),
+                    detail::autotune_bucket(n), detail::autotune_bucket(k),
+                    detail::autotune_bucket(threads), 0, 0.0};
+        }
+
+    public:
+        explicit Autotuner(const std::string& path = detail::default_autotune_path())
+        : _path(path)
+        {
+            if (!_path.empty()) _records = read(_path);
+        }
+
+        Autotuner(const Autotuner&) = delete;
+
+        Autotuner& operator=(const Autotuner&) = delete;
+
+        const std::string& path() const
+        {
+            return _path;
+        }
+
+        std::vector<Record> records()
+        {
+            std::lock_guard<std::mutex> guard(_mutex);
+            return _records;
+        }
+
+        /*
+         * The tuned block size for this problem, or def if op has no
+         * measurements for this datatype. Shapes that were not measured
+         * get the inverse-distance weighted geometric mean of the nearest
+         * measurements, distance being taken over the (log) bucket
+         * coordinates including the thread count.
+         */
+        dim_t block_size(const std::string& op, num_t dt, dim_t m, dim_t n,
+                         dim_t k, int threads, dim_t def)
+        {
+            const int NEIGHBORS = 4;
+
+            Record q = key(op, dt, m, n, k, threads);
+
+            std::lock_guard<std::mutex> guard(_mutex);
+
+            std::vector<std::pair<double,const Record*>> near;
+            for (const Record& r : _records)
+            {
+                if (r.op != q.op || r.dt != q.dt) continue;
+
+                double d2 = (double)(r.m-q.m)*(r.m-q.m) + (r.n-q.n)*(r.n-q.n) +
+                            (r.k-q.k)*(r.k-q.k) + (r.threads-q.threads)*(r.threads-q.threads);
+                if (d2 == 0) return r.nb;
+
+                near.emplace_back(d2, &r);
+            }
+
+            if (near.empty()) return def;
+
+            size_t count = std::min(near.size(), (size_t)NEIGHBORS);
+            std::partial_sort(near.begin(), near.begin()+count, near.end(),
+                              [](const std::pair<double,const Record*>& a,
+                                 const std::pair<double,const Record*>& b)
+                              {
+                                  return a.first < b.first;
+                              });
+
+            double wsum = 0, lsum = 0;
+            for (size_t i = 0;i < count;i++)
+            {
+                double w = 1/near[i].first;
+                wsum += w;
+                lsum += w*std::log2((double)near[i].second->nb);
+            }
+
+            return std::max(dim_t(1), (dim_t)std::lround(std::exp2(lsum/wsum)));
+        }
+
+        /*
+         * Time run(nb) for each candidate block size, calling setup()
+         * (untimed) before every run, keep the fastest of reps runs per
+         * candidate, and record and persist the winner.
+         */
+        dim_t tune(const std::string& op, num_t dt, dim_t m, dim_t n, dim_t k,
+                   int threads, const std::vector<dim_t>& candidates,
+                   const std::function<void()>& setup,
+                   const std::function<void(dim_t)>& run, int reps = 3)
+        {
+            if (candidates.empty())
+                throw std::logic_error("no candidate block sizes");
+
+            Record best = key(op, dt, m, n, k, threads);
+            best.seconds = std::numeric_limits<double>::max();
+
+            for (dim_t nb : candidates)
+            {
+                for (int rep = 0;rep < reps;rep++)
+                {
+                    setup();
+                    double t0 = bli_clock();
+                    run(nb);
+                    double t = bli_clock()-t0;
+
+                    if (t < best.seconds)
+                    {
+                        best.seconds = t;
+                        best.nb = nb;
+                    }
+                }
+            }
+
+            std::lock_guard<std::mutex> guard(_mutex);
+            insert(_records, best);
+            save(best);
+
+            return best.nb;
+        }
+
+        static Autotuner& instance()
+        {
+            static Autotuner tuner;
+            return tuner;
+        }
+};
+
+/*
+ * Power-of-two-ish block sizes from 16 up to (but not beyond) max_nb.
+ */
+inline std::vector<dim_t> autotune_candidates(dim_t max_nb)
+{
+    std::vector<dim_t> nbs;
+    for (dim_t nb : {16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512})
+        if (nb <= std::max(max_nb, dim_t(16))) nbs.push_back(nb);
+    return nbs;
+}
+
+}
+
+#endif
@@ -0,0 +1,205 @@
+#ifndef _BLISPP_BATCH_HPP_
+#define _BLISPP_BATCH_HPP_
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "blis++_matrix.hpp"
+#include "blis++_thread.hpp"
+
+namespace blis
+{
+
+/*
+ * Problems of at least this many flops (2*m*n*k) are considered large by
+ * default: they are run one after another so that each can use BLIS's own
+ * threading. Anything smaller is run concurrently with other small
+ * problems, one per thread of the pool.
+ */
+constexpr double GEMM_BATCH_LARGE_FLOPS = 2.0*256*256*256;
+
+namespace detail
+{
+    template <typename T, typename Allocator>
+    Matrix<T> batch_view(const Matrix<T,Allocator>& A)
+    {
+        Matrix<T> V(A.length(), A.width(), const_cast<T*>(A.data()),
+                    A.row_stride(), A.col_stride());
+        V.conjtrans(A.conjtrans());
+        return V;
+    }
+}
+
+/*
+ * A list of problems sharing alpha, beta and one (m,n,k) shape. The group
+ * only holds views; the operands must outlive the call to gemm_batch.
+ */
+template <typename T>
+struct GemmGroup
+{
+    T alpha;
+    T beta;
+    std::vector<Matrix<T>> A;
+    std::vector<Matrix<T>> B;
+    std::vector<Matrix<T>> C;
+
+    GemmGroup(const T& alpha = T(1), const T& beta = T(0))
+    : alpha(alpha), beta(beta) {}
+
+    template <typename AllocA, typename AllocB, typename AllocC>
+    void push_back(const Matrix<T,AllocA>& a, const Matrix<T,AllocB>& b,
+                   Matrix<T,AllocC>& c)
+    {
+        A.push_back(detail::batch_view(a));
+        B.push_back(detail::batch_view(b));
+        C.push_back(detail::batch_view(c));
+    }
+};
+
+namespace detail
+{
+    template <typename T>
+    struct GemmBatchEntry
+    {
+        T alpha;
+        T beta;
+        obj_t A;
+        obj_t B;
+        obj_t C;
+        double flops;
+    };
+
+    /*
+     * Same (m,n,k) and the same transposition and conjugation of A and B.
+     */
+    template <typename T>
+    bool same_shape(const GemmBatchEntry<T>& a, const GemmBatchEntry<T>& b)
+    {
+        return length(a.C) == length(b.C) && width(a.C) == width(b.C) &&
+               width(a.A) == width(b.A) &&
+               bli_obj_conjtrans_status(a.A) == bli_obj_conjtrans_status(b.A) &&
+               bli_obj_conjtrans_status(a.B) == bli_obj_conjtrans_status(b.B);
+    }
+
+    template <typename T, typename AllocA, typename AllocB, typename AllocC>
+    GemmBatchEntry<T> gemm_batch_entry(const T& alpha, const Matrix<T,AllocA>& A,
+                                       const Matrix<T,AllocB>& B, const T& beta,
+                                       Matrix<T,AllocC>& C)
+    {
+        GemmBatchEntry<T> entry;
+        entry.alpha = alpha;
+        entry.beta = beta;
+        entry.A = *static_cast<const obj_t*>(A);
+        entry.B = *static_cast<const obj_t*>(B);
+        entry.C = *static_cast<obj_t*>(C);
+
+        dim_t m = length(entry.C);
+        dim_t n = width(entry.C);
+        dim_t k = width(entry.A);
+
+        if (length(entry.A) != m || width(entry.B) != n || length(entry.B) != k)
+            throw std::logic_error("dimensions must match");
+
+        entry.flops = 2.0*m*n*k;
+
+        return entry;
+    }
+
+    /*
+     * Large problems are run in turn on the calling thread. The rest are
+     * sorted largest-first and handed out dynamically to the threads of the
+     * pool. BLIS has no per-call thread count, so each of those calls
+     * still uses however many threads BLIS is configured for: unless BLIS
+     * is configured single-threaded, the cores are oversubscribed while
+     * the small problems run.
+     */
+    template <typename T>
+    void gemm_batch(std::vector<GemmBatchEntry<T>>& entries, double large_flops)
+    {
+        std::vector<GemmBatchEntry<T>*> small;
+
+        for (GemmBatchEntry<T>& entry : entries)
+        {
+            if (entry.flops >= large_flops)
+            {
+                assign_gemm(entry.alpha, entry.A, entry.B, entry.beta, entry.C);
+            }
+            else
+            {
+                small.push_back(&entry);
+            }
+        }
+
+        std::sort(small.begin(), small.end(),
+                  [](const GemmBatchEntry<T>* a, const GemmBatchEntry<T>* b)
+                  {
+                      return a->flops > b->flops;
+                  });
+
+        ThreadPool::instance().parallel_for(small.size(),
+        [&](dim_t i)
+        {
+            GemmBatchEntry<T>& entry = *small[i];
+            assign_gemm(entry.alpha, entry.A, entry.B, entry.beta, entry.C);
+        });
+    }
+}
+
+/*
+ * C[i] = alpha*A[i]*B[i] + beta*C[i] for 0 <= i < count. The problems must
+ * be independent (no C[i] may overlap any other operand).
+ */
+template <typename T, typename AllocA, typename AllocB, typename AllocC>
+void gemm_batch(const T& alpha, const Matrix<T,AllocA>* A, const Matrix<T,AllocB>* B,
+                const T& beta, Matrix<T,AllocC>* C, size_t count,
+                double large_flops = GEMM_BATCH_LARGE_FLOPS)
+{
+    std::vector<detail::GemmBatchEntry<T>> entries;
+    entries.reserve(count);
+
+    for (size_t i = 0;i < count;i++)
+        entries.push_back(detail::gemm_batch_entry(alpha, A[i], B[i], beta, C[i]));
+
+    detail::gemm_batch(entries, large_flops);
+}
+
+template <typename T, typename AllocA, typename AllocB, typename AllocC>
+void gemm_batch(const T& alpha, const std::vector<Matrix<T,AllocA>>& A,
+                const std::vector<Matrix<T,AllocB>>& B, const T& beta,
+                std::vector<Matrix<T,AllocC>>& C,
+                double large_flops = GEMM_BATCH_LARGE_FLOPS)
+{
+    if (A.size() != C.size() || B.size() != C.size())
+        throw std::logic_error("batch sizes must match");
+
+    gemm_batch(alpha, A.data(), B.data(), beta, C.data(), C.size(), large_flops);
+}
+
+template <typename T>
+void gemm_batch(std::vector<GemmGroup<T>>& groups,
+                double large_flops = GEMM_BATCH_LARGE_FLOPS)
+{
+    std::vector<detail::GemmBatchEntry<T>> entries;
+
+    for (GemmGroup<T>& group : groups)
+    {
+        if (group.A.size() != group.C.size() || group.B.size() != group.C.size())
+            throw std::logic_error("batch sizes must match");
+
+        for (size_t i = 0;i < group.C.size();i++)
+        {
+            entries.push_back(detail::gemm_batch_entry(group.alpha, group.A[i], group.B[i],
+                                                       group.beta, group.C[i]));
+
+            if (i > 0 && !detail::same_shape(entries.back(), entries[entries.size()-2]))
+                throw std::logic_error("all problems in a group must have the same shape");
+        }
+    }
+
+    detail::gemm_batch(entries, large_flops);
+}
+
+}
+
+#endif
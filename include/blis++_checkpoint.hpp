@@ -0,0 +1,512 @@
+#ifndef _BLISPP_CHECKPOINT_HPP_
+#define _BLISPP_CHECKPOINT_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "blis++_mapped.hpp"
+#include "blis++_matrix.hpp"
+#include "blis++_thread.hpp"
+
+namespace blis
+{
+
+/*
+ * Options for save_checkpoint. panel_width is the number of columns per
+ * chunk (0 picks about 1 MiB of data per chunk). With shuffle, the bytes
+ * of each chunk are regrouped by significance before compression, which
+ * is what makes smooth floating-point data compressible. mantissa_bits,
+ * if non-negative, rounds every value to that many explicit mantissa bits
+ * (lossy); zeroed low bits compress away almost entirely.
+ */
+struct CheckpointOptions
+{
+    dim_t panel_width = 0;
+    bool shuffle = true;
+    int mantissa_bits = -1;
+};
+
+/*
+ * Container layout: this header, then the compressed chunks, then an
+ * index of nchunks CheckpointChunk entries at index_offset. Chunk c holds
+ * columns [c*panel_width,(c+1)*panel_width) stored column-major.
+ */
+struct CheckpointHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    int32_t datatype;
+    uint32_t element_size;
+    int64_t m;
+    int64_t n;
+    int64_t panel_width;
+    uint64_t nchunks;
+    uint64_t index_offset;
+    uint32_t shuffle;
+    int32_t mantissa_bits;
+    char reserved[56];
+};
+
+static_assert(sizeof(CheckpointHeader) == 128, "unexpected header padding");
+
+struct CheckpointChunk
+{
+    uint64_t offset;
+    uint64_t size;
+    uint64_t raw_size;
+    uint32_t codec;
+    uint32_t reserved;
+};
+
+namespace detail
+{
+    constexpr char CHECKPOINT_MAGIC[8] = {'B','L','I','S','C','K','P','T'};
+    constexpr uint32_t CHECKPOINT_VERSION = 1;
+    constexpr uint32_t CHECKPOINT_BYTE_ORDER = 0x01020304;
+
+    enum { CHUNK_STORED = 0, CHUNK_LZ = 1 };
+
+    /*
+     * Byte-oriented LZ77 codec in the style of LZ4: each sequence is a
+     * token (literal count in the high nibble, match length-4 in the low
+     * one, 15 meaning "more bytes follow"), the literals, and a 16-bit
+     * little-endian match offset. The last sequence has only literals.
+     */
+    class LZCodec
+    {
+        private:
+            enum { MIN_MATCH = 4, LAST_LITERALS = 5, HASH_BITS = 16 };
+
+            static uint32_t read32(const uint8_t* p)
+            {
+                uint32_t x;
+                memcpy(&x, p, 4);
+                return x;
+            }
+
+            static uint32_t hash(uint32_t x)
+            {
+                return (x*2654435761u) >> (32-HASH_BITS);
+            }
+
+            static void put_length(std::vector<uint8_t>& out, size_t len)
+            {
+                for (;len >= 255;len -= 255) out.push_back(255);
+                out.push_back(len);
+            }
+
+            static void emit(std::vector<uint8_t>& out, const uint8_t* literals,
+                             size_t nliterals, size_t offset, size_t match)
+            {
+                size_t ml = match ? match-MIN_MATCH : 0;
+                out.push_back((std::min<size_t>(nliterals, 15) << 4) |
+                              std::min<size_t>(ml, 15));
+                if (nliterals >= 15) put_length(out, nliterals-15);
+                out.insert(out.end(), literals, literals+nliterals);
+
+                if (match)
+                {
+                    out.push_back(offset & 0xff);
+                    out.push_back(offset >> 8);
+                    if (ml >= 15) put_length(out, ml-15);
+                }
+            }
+
+            static size_t get_length(const uint8_t*& in, const uint8_t* end, size_t len)
+            {
+                if (len < 15) return len;
+
+                uint8_t b;
+                do
+                {
+                    if (in == end) throw std::runtime_error("corrupt chunk");
+                    b = *in++;
+                    len += b;
+                }
+                while (b == 255);
+
+                return len;
+            }
+
+        public:
+            static void compress(const uint8_t* in, size_t n, std::vector<uint8_t>& out)
+            {
+                out.clear();
+                out.reserve(n + n/255 + 16);
+
+                std::vector<int64_t> table(size_t(1) << HASH_BITS, -1);
+                size_t anchor = 0;
+                size_t i = 0;
+
+                while (n >= MIN_MATCH+LAST_LITERALS && i+MIN_MATCH <= n-LAST_LITERALS)
+                {
+                    uint32_t h = hash(read32(in+i));
+                    int64_t cand = table[h];
+                    table[h] = i;
+
+                    if (cand < 0 || i-cand > 65535 || read32(in+cand) != read32(in+i))
+                    {
+                        i++;
+                        continue;
+                    }
+
+                    size_t len = MIN_MATCH;
+                    while (i+len < n-LAST_LITERALS && in[cand+len] == in[i+len]) len++;
+
+                    emit(out, in+anchor, i-anchor, i-cand, len);
+                    i += len;
+                    anchor = i;
+                }
+
+                emit(out, in+anchor, n-anchor, 0, 0);
+            }
+
+            static void decompress(const uint8_t* in, size_t size, uint8_t* out, size_t n)
+            {
+                const uint8_t* end = in+size;
+                size_t pos = 0;
+
+                while (in < end)
+                {
+                    uint8_t token = *in++;
+
+                    size_t nliterals = get_length(in, end, token >> 4);
+                    if (nliterals > size_t(end-in) || nliterals > n-pos)
+                        throw std::runtime_error("corrupt chunk");
+
+                    memcpy(out+pos, in, nliterals);
+                    in += nliterals;
+                    pos += nliterals;
+
+                    if (in == end) break;
+
+                    if (end-in < 2) throw std::runtime_error("corrupt chunk");
+                    size_t offset = in[0] | (in[1] << 8);
+                    in += 2;
+
+                    size_t len = get_length(in, end, token & 15) + MIN_MATCH;
+                    if (offset == 0 || offset > pos || len > n-pos)
+                        throw std::runtime_error("corrupt chunk");
+
+                    for (size_t k = 0;k < len;k++, pos++) out[pos] = out[pos-offset];
+                }
+
+                if (pos != n) throw std::runtime_error("corrupt chunk");
+            }
+    };
+
+    template <typename R> struct float_bits;
+    template <> struct float_bits< float> { typedef uint32_t type; enum { mantissa = 23, exponent = 8 }; };
+    template <> struct float_bits<double> { typedef uint64_t type; enum { mantissa = 52, exponent = 11 }; };
+
+    /*
+     * Round n values to keep explicit mantissa bits, to nearest. Inf and
+     * NaN are left alone.
+     */
+    template <typename R>
+    void truncate_mantissa(R* p, size_t n, int keep)
+    {
+        typedef float_bits<R> traits;
+        typedef typename traits::type U;
+
+        if (keep < 0 || keep >= traits::mantissa) return;
+
+        int drop = traits::mantissa-keep;
+        U mask = ~((U(1) << drop) - 1);
+        U half = U(1) << (drop-1);
+        U exponent = ((U(1) << traits::exponent) - 1) << traits::mantissa;
+
+        for (size_t i = 0;i < n;i++)
+        {
+            U bits;
+            memcpy(&bits, p+i, sizeof(U));
+            if ((bits & exponent) != exponent) bits = (bits+half) & mask;
+            memcpy(p+i, &bits, sizeof(U));
+        }
+    }
+
+    /*
+     * out[b*n+i] = byte b of unit i, for n units of size bytes each.
+     */
+    inline void shuffle_bytes(const uint8_t* in, size_t n, size_t size, uint8_t* out)
+    {
+        for (size_t i = 0;i < n;i++)
+            for (size_t b = 0;b < size;b++)
+                out[b*n+i] = in[i*size+b];
+    }
+
+    struct ChunkBuffers
+    {
+        std::vector<uint8_t> raw;
+        std::vector<uint8_t> shuffled;
+        std::vector<uint8_t> packed;
+    };
+
+    inline void checkpoint_chunk_shape(const CheckpointHeader& header, uint64_t c,
+                                dim_t& j0, dim_t& w)
+    {
+        j0 = c*header.panel_width;
+        w = std::min<dim_t>(header.panel_width, header.n-j0);
+    }
+}
+
+/*
+ * Write A to path as a chunked, compressed checkpoint. Chunks are
+ * gathered, shuffled and compressed in parallel on the thread pool a
+ * batch at a time and appended to the file in order, so only a few
+ * chunks are held in memory at once.
+ */
+template <typename T, typename Allocator>
+void save_checkpoint(const std::string& path, const Matrix<T,Allocator>& A,
+                     const CheckpointOptions& options = CheckpointOptions())
+{
+    typedef real_type_t<T> R;
+
+    dim_t m = A.length();
+    dim_t n = A.width();
+    inc_t rs = A.row_stride();
+    inc_t cs = A.col_stride();
+
+    if (A.is_transposed())
+    {
+        std::swap(m, n);
+        std::swap(rs, cs);
+    }
+
+    bool conj = A.is_conjugated();
+    const T* p = A.data();
+
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, detail::CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = detail::CHECKPOINT_VERSION;
+    header.byte_order = detail::CHECKPOINT_BYTE_ORDER;
+    header.datatype = datatype<T>::value;
+    header.element_size = sizeof(T);
+    header.m = m;
+    header.n = n;
+    header.panel_width = options.panel_width > 0 ? options.panel_width :
+        std::max<dim_t>(1, (1 << 20)/std::max<size_t>(m*sizeof(T), 1));
+    header.nchunks = n == 0 ? 0 : (n+header.panel_width-1)/header.panel_width;
+    header.shuffle = options.shuffle;
+    header.mantissa_bits = options.mantissa_bits;
+
+    detail::FileDescriptor fd(path, O_WRONLY|O_CREAT|O_TRUNC);
+
+    ThreadPool& pool = ThreadPool::instance();
+    std::vector<CheckpointChunk> index(header.nchunks);
+    std::vector<detail::ChunkBuffers> buffers(2*pool.num_threads());
+    uint64_t offset = sizeof(header);
+
+    for (uint64_t first = 0;first < header.nchunks;first += buffers.size())
+    {
+        uint64_t batch = std::min<uint64_t>(buffers.size(), header.nchunks-first);
+
+        pool.parallel_for(batch, [&](dim_t b)
+        {
+            uint64_t c = first+b;
+            detail::ChunkBuffers& buf = buffers[b];
+            CheckpointChunk& chunk = index[c];
+
+            dim_t j0, w;
+            detail::checkpoint_chunk_shape(header, c, j0, w);
+
+            size_t nelem = m*w;
+            chunk.raw_size = nelem*sizeof(T);
+            buf.raw.resize(chunk.raw_size);
+            T* raw = (T*)buf.raw.data();
+
+            for (dim_t j = 0;j < w;j++)
+                for (dim_t i = 0;i < m;i++)
+                    raw[i+j*m] = conj ? blis::conj(p[i*rs+(j0+j)*cs]) : p[i*rs+(j0+j)*cs];
+
+            detail::truncate_mantissa((R*)raw, nelem*sizeof(T)/sizeof(R), options.mantissa_bits);
+
+            const uint8_t* src = buf.raw.data();
+
+            if (options.shuffle)
+            {
+                buf.shuffled.resize(chunk.raw_size);
+                detail::shuffle_bytes(src, nelem*sizeof(T)/sizeof(R), sizeof(R), buf.shuffled.data());
+                src = buf.shuffled.data();
+            }
+
+            detail::LZCodec::compress(src, chunk.raw_size, buf.packed);
+
+            if (buf.packed.size() < chunk.raw_size)
+            {
+                chunk.codec = detail::CHUNK_LZ;
+            }
+            else
+            {
+                chunk.codec = detail::CHUNK_STORED;
+                buf.packed.assign(src, src+chunk.raw_size);
+            }
+
+            chunk.size = buf.packed.size();
+        });
+
+        for (uint64_t b = 0;b < batch;b++)
+        {
+            CheckpointChunk& chunk = index[first+b];
+            chunk.offset = offset;
+            detail::pwrite_all(fd, buffers[b].packed.data(), chunk.size, offset);
+            offset += chunk.size;
+        }
+    }
+
+    header.index_offset = offset;
+    detail::pwrite_all(fd, index.data(), index.size()*sizeof(CheckpointChunk), offset);
+    detail::pwrite_all(fd, &header, sizeof(header), 0);
+}
+
+/*
+ * Restore a checkpoint into A. An empty A is allocated with the stored
+ * dimensions; otherwise the dimensions must match and the data goes
+ * straight into A's existing storage (which may be a view with arbitrary
+ * strides). Chunks are read and decompressed in parallel, each thread
+ * writing its chunk's elements directly to their final positions.
+ */
+template <typename T, typename Allocator>
+void load_checkpoint(const std::string& path, Matrix<T,Allocator>& A)
+{
+    typedef real_type_t<T> R;
+
+    detail::FileDescriptor fd(path, O_RDONLY);
+    CheckpointHeader header;
+    detail::pread_all(fd, &header, sizeof(header), 0);
+
+    if (memcmp(header.magic, detail::CHECKPOINT_MAGIC, sizeof(header.magic)) != 0)
+        throw std::runtime_error(path + " is not a checkpoint");
+
+    if (header.byte_order != detail::CHECKPOINT_BYTE_ORDER)
+        throw std::runtime_error(path + " was written with a different byte order");
+
+    if (header.version != detail::CHECKPOINT_VERSION)
+        throw std::runtime_error(path + " has an unsupported version");
+
+    if (header.datatype != datatype<T>::value || header.element_size != sizeof(T))
+        throw std::runtime_error(path + " has a different datatype");
+
+    /*
+     * The chunks have to cover exactly the n columns, and the index and
+     * every chunk have to lie within the file.
+     */
+    if (header.m < 0 || header.n < 0 || header.panel_width <= 0 ||
+        header.nchunks != (uint64_t)(header.n/header.panel_width +
+                                     (header.n%header.panel_width != 0)))
+        throw std::runtime_error(path + " has a corrupt header");
+
+    uint64_t file_size = fd.size();
+
+    if (header.index_offset < sizeof(header) || header.index_offset > file_size ||
+        header.nchunks > (file_size-header.index_offset)/sizeof(CheckpointChunk))
+        throw std::runtime_error(path + " is truncated or has a corrupt header");
+
+    if (A.data() == nullptr && A.length() == 0 && A.width() == 0)
+        A.reset(header.m, header.n);
+
+    dim_t m = A.length();
+    dim_t n = A.width();
+    inc_t rs = A.row_stride();
+    inc_t cs = A.col_stride();
+
+    if (A.is_transposed())
+    {
+        std::swap(m, n);
+        std::swap(rs, cs);
+    }
+
+    if (m != header.m || n != header.n)
+        throw std::logic_error("dimensions must match");
+
+    bool conj = A.is_conjugated();
+    T* p = A.data();
+
+    std::vector<CheckpointChunk> index(header.nchunks);
+    detail::pread_all(fd, index.data(), index.size()*sizeof(CheckpointChunk), header.index_offset);
+
+    for (uint64_t c = 0;c < header.nchunks;c++)
+    {
+        const CheckpointChunk& chunk = index[c];
+
+        dim_t j0, w;
+        detail::checkpoint_chunk_shape(header, c, j0, w);
+
+        if (chunk.offset < sizeof(header) || chunk.offset > header.index_offset ||
+            chunk.size > header.index_offset-chunk.offset ||
+            chunk.raw_size != m*w*sizeof(T) ||
+            (chunk.codec != detail::CHUNK_LZ &&
+             (chunk.codec != detail::CHUNK_STORED || chunk.size != chunk.raw_size)))
+            throw std::runtime_error(path + " has a corrupt index");
+    }
+
+    ThreadPool& pool = ThreadPool::instance();
+    std::vector<detail::ChunkBuffers> buffers(pool.num_threads());
+
+    pool.run([&](int tid, int nthreads)
+    {
+        detail::ChunkBuffers& buf = buffers[tid];
+
+        for (uint64_t c = tid;c < header.nchunks;c += nthreads)
+        {
+            const CheckpointChunk& chunk = index[c];
+
+            dim_t j0, w;
+            detail::checkpoint_chunk_shape(header, c, j0, w);
+
+            size_t nelem = m*w;
+            size_t nunits = nelem*sizeof(T)/sizeof(R);
+
+            buf.packed.resize(chunk.size);
+            detail::pread_all(fd, buf.packed.data(), chunk.size, chunk.offset);
+
+            const uint8_t* src = buf.packed.data();
+
+            if (chunk.codec == detail::CHUNK_LZ)
+            {
+                buf.raw.resize(chunk.raw_size);
+                detail::LZCodec::decompress(src, chunk.size, buf.raw.data(), chunk.raw_size);
+                src = buf.raw.data();
+            }
+
+            for (size_t u = 0;u < nunits;u++)
+            {
+                R value;
+
+                if (header.shuffle)
+                {
+                    uint8_t* bytes = (uint8_t*)&value;
+                    for (size_t b = 0;b < sizeof(R);b++)
+                        bytes[b] = src[b*nunits+u];
+                }
+                else
+                {
+                    memcpy(&value, src+u*sizeof(R), sizeof(R));
+                }
+
+                size_t e = u*sizeof(R)/sizeof(T);
+                dim_t i = e%m;
+                dim_t j = j0+e/m;
+                R* dst = (R*)(p+i*rs+j*cs) + (u*sizeof(R)%sizeof(T))/sizeof(R);
+                *dst = value;
+            }
+
+            if (conj)
+            {
+                for (dim_t j = j0;j < j0+w;j++)
+                    for (dim_t i = 0;i < m;i++)
+                        p[i*rs+j*cs] = blis::conj(p[i*rs+j*cs]);
+            }
+        }
+    });
+}
+
+}
+
+#endif
@@ -0,0 +1,423 @@
+#ifndef _BLISPP_COMPACT_HPP_
+#define _BLISPP_COMPACT_HPP_
+
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+
+#include "blis++_matrix.hpp"
+#include "blis++_thread.hpp"
+
+namespace blis
+{
+
+namespace detail
+{
+    template <typename T> struct compact_lanes
+    {
+        static const dim_t value = sizeof(T) >= BLIS_HEAP_ADDR_ALIGN_SIZE ? 1 :
+                                   BLIS_HEAP_ADDR_ALIGN_SIZE/sizeof(T);
+    };
+}
+
+/*
+ * A batch of equally-sized small matrices stored in "compact" form:
+ * matrices are grouped into chunks of Lanes, and within a chunk element
+ * (i,j) of every matrix is contiguous. Each chunk is column-major over
+ * (i,j), so that
+ *
+ *     A_b(i,j) = data[((c*n + j)*m + i)*Lanes + l],   b = c*Lanes + l.
+ *
+ * Loops over the lanes of a chunk have a fixed trip count and unit
+ * stride, so the compact kernels below vectorize across the batch rather
+ * than within a (tiny) matrix. Lanes left over in the last chunk are
+ * padding; they hold identity matrices so that the kernels stay finite.
+ */
+template <typename T, dim_t Lanes=detail::compact_lanes<T>::value,
+          typename Allocator=AlignedAllocator<T>>
+class CompactBatch
+{
+    public:
+        typedef T type;
+        static const dim_t lanes = Lanes;
+
+    private:
+        Memory<T,Allocator> _mem;
+        dim_t _m = 0;
+        dim_t _n = 0;
+        dim_t _count = 0;
+
+    public:
+        CompactBatch() {}
+
+        CompactBatch(dim_t m, dim_t n, dim_t count)
+        {
+            reset(m, n, count);
+        }
+
+        CompactBatch(const CompactBatch&) = delete;
+
+        CompactBatch(CompactBatch&& other) = default;
+
+        CompactBatch& operator=(const CompactBatch&) = delete;
+
+        CompactBatch& operator=(CompactBatch&& other) = default;
+
+        void reset(dim_t m, dim_t n, dim_t count)
+        {
+            if (m < 0 || n < 0 || count < 0)
+                throw std::logic_error("parameter must be non-negative");
+
+            _m = m;
+            _n = n;
+            _count = count;
+
+            siz_t size = num_chunks()*chunk_size();
+            T* p = _mem.reset(size);
+            std::fill(p, p+size, T(0));
+
+            for (dim_t b = count;b < num_chunks()*Lanes;b++)
+                for (dim_t i = 0;i < std::min(m, n);i++)
+                    (*this)(b, i, i) = T(1);
+        }
+
+        dim_t length() const { return _m; }
+
+        dim_t width() const { return _n; }
+
+        dim_t size() const { return _count; }
+
+        dim_t num_chunks() const { return (_count+Lanes-1)/Lanes; }
+
+        dim_t chunk_size() const { return _m*_n*Lanes; }
+
+        T* chunk(dim_t c) { return (T*)_mem + c*chunk_size(); }
+
+        const T* chunk(dim_t c) const { return (const T*)_mem + c*chunk_size(); }
+
+        T& operator()(dim_t b, dim_t i, dim_t j)
+        {
+            return chunk(b/Lanes)[(j*_m + i)*Lanes + b%Lanes];
+        }
+
+        const T& operator()(dim_t b, dim_t i, dim_t j) const
+        {
+            return chunk(b/Lanes)[(j*_m + i)*Lanes + b%Lanes];
+        }
+
+        template <typename Alloc>
+        void pack(dim_t b, const Matrix<T,Alloc>& A)
+        {
+            if (A.length() != _m || A.width() != _n)
+                throw std::logic_error("dimensions must match");
+
+            for (dim_t j = 0;j < _n;j++)
+                for (dim_t i = 0;i < _m;i++)
+                    (*this)(b, i, j) = A.data()[i*A.row_stride() + j*A.col_stride()];
+        }
+
+        template <typename Alloc>
+        void unpack(dim_t b, Matrix<T,Alloc>& A) const
+        {
+            if (A.length() != _m || A.width() != _n)
+                throw std::logic_error("dimensions must match");
+
+            for (dim_t j = 0;j < _n;j++)
+                for (dim_t i = 0;i < _m;i++)
+                    A.data()[i*A.row_stride() + j*A.col_stride()] = (*this)(b, i, j);
+        }
+};
+
+namespace detail
+{
+    /*
+     * Runs body(first_chunk, last_chunk) over blocks of chunks on the
+     * thread pool; small batches stay on the calling thread.
+     */
+    template <typename Body>
+    void for_each_chunk(dim_t nchunks, Body body)
+    {
+        const dim_t block = 64;
+        dim_t nblocks = (nchunks+block-1)/block;
+
+        if (nblocks <= 1)
+        {
+            body(0, nchunks);
+            return;
+        }
+
+        ThreadPool::instance().parallel_for(nblocks,
+        [&](dim_t i)
+        {
+            body(i*block, std::min(nchunks, (i+1)*block));
+        });
+    }
+
+    template <typename T, dim_t Lanes>
+    class CompactOperand
+    {
+        private:
+            const T* _p;
+            inc_t _rs, _cs;
+            bool _conj;
+
+        public:
+            CompactOperand(const T* p, dim_t m, trans_op_t trans)
+            : _p(p), _rs(Lanes), _cs(m*Lanes), _conj(trans.conjugate())
+            {
+                if (trans.transpose()) std::swap(_rs, _cs);
+            }
+
+            const T* operator()(dim_t i, dim_t j) const
+            {
+                return _p + i*_rs + j*_cs;
+            }
+
+            bool conjugated() const
+            {
+                return _conj;
+            }
+    };
+
+    template <typename T>
+    inline T conj_if(bool c, const T& x)
+    {
+        return c ? conj(x) : x;
+    }
+}
+
+/*
+ * C_b := alpha op(A_b) op(B_b) + beta C_b for every matrix b of the batch.
+ */
+template <typename T, dim_t Lanes, typename Alloc>
+void compact_gemm(const T& alpha,
+                  const CompactBatch<T,Lanes,Alloc>& A, trans_op_t transa,
+                  const CompactBatch<T,Lanes,Alloc>& B, trans_op_t transb,
+                  const T& beta, CompactBatch<T,Lanes,Alloc>& C)
+{
+    dim_t m = C.length();
+    dim_t n = C.width();
+    dim_t k = transa.transpose() ? A.length() : A.width();
+
+    if ((transa.transpose() ? A.width() : A.length()) != m ||
+        (transb.transpose() ? B.length() : B.width()) != n ||
+        (transb.transpose() ? B.width() : B.length()) != k ||
+        A.size() != C.size() || B.size() != C.size())
+        throw std::logic_error("dimensions must match");
+
+    detail::for_each_chunk(C.num_chunks(),
+    [&](dim_t first, dim_t last)
+    {
+        T ab[Lanes];
+
+        for (dim_t c = first;c < last;c++)
+        {
+            detail::CompactOperand<T,Lanes> a(A.chunk(c), A.length(), transa);
+            detail::CompactOperand<T,Lanes> b(B.chunk(c), B.length(), transb);
+            T* pc = C.chunk(c);
+
+            for (dim_t j = 0;j < n;j++)
+            {
+                for (dim_t i = 0;i < m;i++)
+                {
+                    for (dim_t l = 0;l < Lanes;l++) ab[l] = T(0);
+
+                    for (dim_t p = 0;p < k;p++)
+                    {
+                        const T* pa = a(i, p);
+                        const T* pb = b(p, j);
+                        for (dim_t l = 0;l < Lanes;l++)
+                            ab[l] += detail::conj_if(a.conjugated(), pa[l])*
+                                     detail::conj_if(b.conjugated(), pb[l]);
+                    }
+
+                    T* cij = pc + (j*m + i)*Lanes;
+                    if (beta == T(0))
+                    {
+                        for (dim_t l = 0;l < Lanes;l++) cij[l] = alpha*ab[l];
+                    }
+                    else
+                    {
+                        for (dim_t l = 0;l < Lanes;l++) cij[l] = alpha*ab[l] + beta*cij[l];
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*
+ * Solve op(A_b) X_b = alpha B_b (side == BLIS_LEFT) or X_b op(A_b) = alpha
+ * B_b (side == BLIS_RIGHT) for every matrix b, overwriting B with X. Only
+ * the uplo triangle of A is referenced.
+ */
+template <typename T, dim_t Lanes, typename Alloc>
+void compact_trsm(side_t side, uplo_t uplo, trans_op_t trans, diag_t diag,
+                  const T& alpha, const CompactBatch<T,Lanes,Alloc>& A,
+                  CompactBatch<T,Lanes,Alloc>& B)
+{
+    dim_t m = B.length();
+    dim_t n = B.width();
+    dim_t k = side == BLIS_LEFT ? m : n;
+
+    if (A.length() != k || A.width() != k || A.size() != B.size())
+        throw std::logic_error("dimensions must match");
+
+    bool lower = (uplo == BLIS_LOWER) != trans.transpose();
+    bool unit = diag == BLIS_UNIT_DIAG;
+    bool forward = side == BLIS_LEFT ? lower : !lower;
+
+    detail::for_each_chunk(B.num_chunks(),
+    [&](dim_t first, dim_t last)
+    {
+        for (dim_t c = first;c < last;c++)
+        {
+            detail::CompactOperand<T,Lanes> a(A.chunk(c), k, trans);
+            T* pb = B.chunk(c);
+            auto x = [&](dim_t i, dim_t j) { return pb + (j*m + i)*Lanes; };
+
+            for (dim_t idx = 0;idx < m*n;idx++)
+            {
+                T* bij = pb + idx*Lanes;
+                for (dim_t l = 0;l < Lanes;l++) bij[l] *= alpha;
+            }
+
+            for (dim_t s = 0;s < k;s++)
+            {
+                dim_t q = forward ? s : k-1-s;
+                const T* aqq = a(q, q);
+                dim_t lo = forward ? q+1 : 0;
+                dim_t hi = forward ? k : q;
+
+                if (side == BLIS_LEFT)
+                {
+                    for (dim_t j = 0;j < n;j++)
+                    {
+                        T* xq = x(q, j);
+                        if (!unit)
+                            for (dim_t l = 0;l < Lanes;l++)
+                                xq[l] /= detail::conj_if(a.conjugated(), aqq[l]);
+
+                        for (dim_t i = lo;i < hi;i++)
+                        {
+                            const T* aiq = a(i, q);
+                            T* xi = x(i, j);
+                            for (dim_t l = 0;l < Lanes;l++)
+                                xi[l] -= detail::conj_if(a.conjugated(), aiq[l])*xq[l];
+                        }
+                    }
+                }
+                else
+                {
+                    for (dim_t i = 0;i < m;i++)
+                    {
+                        T* xq = x(i, q);
+                        if (!unit)
+                            for (dim_t l = 0;l < Lanes;l++)
+                                xq[l] /= detail::conj_if(a.conjugated(), aqq[l]);
+
+                        for (dim_t j = lo;j < hi;j++)
+                        {
+                            const T* aqj = a(q, j);
+                            T* xj = x(i, j);
+                            for (dim_t l = 0;l < Lanes;l++)
+                                xj[l] -= xq[l]*detail::conj_if(a.conjugated(), aqj[l]);
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+/*
+ * Cholesky factorization A_b = L_b L_b^H (uplo == BLIS_LOWER) or
+ * A_b = U_b^H U_b (uplo == BLIS_UPPER) of every matrix in the batch, in
+ * place. Returns the number of matrices which are not positive definite;
+ * if info is given, info[b] is set to 0 on success or to j+1 where j is
+ * the first column with a non-positive pivot (as in LAPACK).
+ */
+template <typename T, dim_t Lanes, typename Alloc>
+dim_t compact_potrf(uplo_t uplo, CompactBatch<T,Lanes,Alloc>& A, dim_t* info = nullptr)
+{
+    typedef real_type_t<T> R;
+
+    dim_t n = A.length();
+
+    if (A.width() != n)
+        throw std::logic_error("matrix must be square");
+
+    bool lower = uplo == BLIS_LOWER;
+    std::atomic<dim_t> nfailed(0);
+
+    detail::for_each_chunk(A.num_chunks(),
+    [&](dim_t first, dim_t last)
+    {
+        R d[Lanes];
+        dim_t failed[Lanes];
+
+        for (dim_t c = first;c < last;c++)
+        {
+            /*
+             * The upper case factors the transpose, conj(A) = U^T conj(U),
+             * with the lower-triangular loops below.
+             */
+            T* pa = A.chunk(c);
+            auto a = [&](dim_t i, dim_t j)
+            {
+                return lower ? pa + (j*n + i)*Lanes : pa + (i*n + j)*Lanes;
+            };
+
+            for (dim_t l = 0;l < Lanes;l++) failed[l] = 0;
+
+            for (dim_t j = 0;j < n;j++)
+            {
+                T* ajj = a(j, j);
+
+                for (dim_t l = 0;l < Lanes;l++) d[l] = real(ajj[l]);
+
+                for (dim_t p = 0;p < j;p++)
+                {
+                    const T* ajp = a(j, p);
+                    for (dim_t l = 0;l < Lanes;l++) d[l] -= real(norm2(ajp[l]));
+                }
+
+                for (dim_t l = 0;l < Lanes;l++)
+                {
+                    if (!(d[l] > R(0)) && failed[l] == 0) failed[l] = j+1;
+                    d[l] = std::sqrt(d[l]);
+                    ajj[l] = d[l];
+                }
+
+                for (dim_t i = j+1;i < n;i++)
+                {
+                    T* aij = a(i, j);
+
+                    for (dim_t p = 0;p < j;p++)
+                    {
+                        const T* aip = a(i, p);
+                        const T* ajp = a(j, p);
+                        for (dim_t l = 0;l < Lanes;l++)
+                            aij[l] -= aip[l]*conj(ajp[l]);
+                    }
+
+                    for (dim_t l = 0;l < Lanes;l++) aij[l] /= d[l];
+                }
+            }
+
+            for (dim_t l = 0;l < Lanes;l++)
+            {
+                dim_t b = c*Lanes + l;
+                if (b >= A.size()) break;
+                if (info) info[b] = failed[l];
+                if (failed[l]) nfailed++;
+            }
+        }
+    });
+
+    return nfailed;
+}
+
+}
+
+#endif
@@ -0,0 +1,581 @@
+#ifndef _BLISPP_COUNTERS_HPP_
+#define _BLISPP_COUNTERS_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "blis/blis.h"
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace blis
+{
+
+enum CounterEvent
+{
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_DTLB_MISSES,
+    COUNTER_MEM_READ_BYTES,
+    COUNTER_MEM_WRITE_BYTES,
+    COUNTER_TASK_CLOCK_NS,
+    COUNTER_PAGE_FAULTS,
+    COUNTER_CONTEXT_SWITCHES,
+    COUNTER_CPU_MIGRATIONS,
+    COUNTER_EVENTS
+};
+
+inline const char* counter_name(CounterEvent event)
+{
+    switch (event)
+    {
+        case COUNTER_CYCLES:           return "cycles";
+        case COUNTER_INSTRUCTIONS:     return "instructions";
+        case COUNTER_L1D_MISSES:       return "l1d_misses";
+        case COUNTER_LLC_MISSES:       return "llc_misses";
+        case COUNTER_DTLB_MISSES:      return "dtlb_misses";
+        case COUNTER_MEM_READ_BYTES:   return "mem_read_bytes";
+        case COUNTER_MEM_WRITE_BYTES:  return "mem_write_bytes";
+        case COUNTER_TASK_CLOCK_NS:    return "task_clock_ns";
+        case COUNTER_PAGE_FAULTS:      return "page_faults";
+        case COUNTER_CONTEXT_SWITCHES: return "context_switches";
+        case COUNTER_CPU_MIGRATIONS:   return "cpu_migrations";
+        default:                       return "unknown";
+    }
+}
+
+/*
+ * Counts for one region; available says which events could be counted at
+ * all on this machine (the others read as zero).
+ */
+struct CounterValues
+{
+    double value[COUNTER_EVENTS] = {};
+    bool available[COUNTER_EVENTS] = {};
+
+    double operator[](CounterEvent event) const
+    {
+        return value[event];
+    }
+
+    CounterValues& operator+=(const CounterValues& other)
+    {
+        for (int i = 0;i < COUNTER_EVENTS;i++)
+        {
+            value[i] += other.value[i];
+            available[i] = available[i] || other.available[i];
+        }
+        return *this;
+    }
+
+    CounterValues& operator/=(double n)
+    {
+        for (int i = 0;i < COUNTER_EVENTS;i++) value[i] /= n;
+        return *this;
+    }
+};
+
+namespace detail
+{
+#if defined(__linux__)
+
+    inline int perf_event_open(int type, uint64_t config, pid_t pid, int cpu, bool user_only)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = user_only;
+        attr.exclude_hv = user_only;
+        /*
+         * Events on a thread carry over to the threads it creates, and
+         * their counts are included when the event is read.
+         */
+        attr.inherit = pid != -1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED|PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        return syscall(SYS_perf_event_open, &attr, pid, cpu, -1, 0);
+    }
+
+    /*
+     * Raw count and the times the counter was enabled and running.
+     */
+    struct CounterReading
+    {
+        uint64_t count = 0;
+        uint64_t enabled = 0;
+        uint64_t running = 0;
+    };
+
+    inline CounterReading read_counter(int fd)
+    {
+        CounterReading r;
+        uint64_t buf[3];
+        if (read(fd, buf, sizeof(buf)) == (ssize_t)sizeof(buf))
+        {
+            r.count = buf[0];
+            r.enabled = buf[1];
+            r.running = buf[2];
+        }
+        return r;
+    }
+
+    /*
+     * The count between two readings, extrapolated to the whole region if
+     * the kernel had to multiplex the counter. Differences are taken
+     * rather than resetting the counter, since a reset does not clear
+     * what exited inherited threads have added to it.
+     */
+    inline double counter_delta(const CounterReading& from, const CounterReading& to)
+    {
+        uint64_t running = to.running - from.running;
+        if (running == 0) return 0;
+        return (double)(to.count - from.count)*(to.enabled - from.enabled)/running;
+    }
+
+    inline std::string read_sysfs(const std::string& path)
+    {
+        std::ifstream ifs(path);
+        std::string line;
+        std::getline(ifs, line);
+        return line;
+    }
+
+    /*
+     * Encode an event description from sysfs, e.g. "event=0x04,umask=0x03",
+     * using the PMU's format fields, e.g. "config:0-7". Only fields in
+     * config (not config1/config2) are supported.
+     */
+    inline bool sysfs_event_config(const std::string& pmu, const std::string& desc,
+                                   uint64_t& config)
+    {
+        config = 0;
+
+        size_t pos = 0;
+        while (pos < desc.size())
+        {
+            size_t next = desc.find(',', pos);
+            if (next == std::string::npos) next = desc.size();
+            std::string term = desc.substr(pos, next-pos);
+            pos = next+1;
+
+            size_t eq = term.find('=');
+            std::string field = term.substr(0, eq);
+            uint64_t value = eq == std::string::npos ? 1 :
+                             strtoull(term.c_str()+eq+1, nullptr, 0);
+
+            std::string format = read_sysfs(pmu + "/format/" + field);
+            unsigned lo, hi;
+            int n = sscanf(format.c_str(), "config:%u-%u", &lo, &hi);
+            if (n == 1) hi = lo;
+            else if (n != 2) return false;
+
+            uint64_t mask = hi-lo >= 63 ? ~uint64_t(0) : (uint64_t(1) << (hi-lo+1))-1;
+            config |= (value & mask) << lo;
+        }
+
+        return true;
+    }
+
+    /*
+     * CPUs from a list such as "0,18" or "0-3".
+     */
+    inline std::vector<int> parse_cpu_list(const std::string& s)
+    {
+        std::vector<int> cpus;
+
+        const char* p = s.c_str();
+        while (*p)
+        {
+            char* end;
+            long first = strtol(p, &end, 10);
+            if (end == p) break;
+            long last = first;
+            if (*end == '-') last = strtol(end+1, &end, 10);
+            for (long cpu = first;cpu <= last;cpu++) cpus.push_back(cpu);
+            p = *end == ',' ? end+1 : end;
+        }
+
+        return cpus;
+    }
+
+#endif
+}
+
+/*
+ * Performance counters (through perf_event_open) for all threads of the
+ * process: cycles, instructions, L1D, LLC and dTLB read misses, and
+ * memory controller read and write traffic from the uncore IMC PMUs where
+ * the kernel exposes them (which usually requires perf_event_paranoid <= 0
+ * or CAP_PERFMON). The software events (task clock, page faults, context
+ * switches, migrations) are always counted, so that when the hardware
+ * counters are unavailable, as in most virtual machines and containers,
+ * there is still something to go on.
+ *
+ * Counters are attached to each thread that exists when the object is
+ * created, one descriptor per event per thread, and are inherited by
+ * every thread created after that (such as those BLIS spawns inside a
+ * timed region), so each thread is counted exactly once. The hardware
+ * events count only user-mode activity; the software events include the
+ * kernel, where context switches and migrations occur. The counters are not thread-safe: one thread
+ * should start and stop them.
+ */
+class PerfCounters
+{
+    private:
+        struct Event
+        {
+            CounterEvent id;
+            int type;
+            uint64_t config;
+            bool user_only;
+        };
+
+        struct Uncore
+        {
+            CounterEvent id;
+            int fd;
+            double scale;
+        };
+
+        std::vector<Event> _events;
+        std::vector<std::pair<int,std::vector<int>>> _threads;
+        std::vector<Uncore> _uncore;
+        std::map<int,detail::CounterReading> _baseline;
+        bool _available[COUNTER_EVENTS] = {};
+
+#if defined(__linux__)
+
+        static std::vector<Event> candidate_events()
+        {
+            const uint64_t read_miss = (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+            return
+            {
+                {COUNTER_CYCLES,           PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,             true},
+                {COUNTER_INSTRUCTIONS,     PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,           true},
+                {COUNTER_L1D_MISSES,       PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D  | read_miss, true},
+                {COUNTER_LLC_MISSES,       PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,           true},
+                {COUNTER_DTLB_MISSES,      PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | read_miss, true},
+                {COUNTER_TASK_CLOCK_NS,    PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK,             false},
+                {COUNTER_PAGE_FAULTS,      PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS,            false},
+                {COUNTER_CONTEXT_SWITCHES, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES,       false},
+                {COUNTER_CPU_MIGRATIONS,   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS,         false}
+            };
+        }
+
+        void attach(int tid)
+        {
+            std::vector<int> fds;
+            for (const Event& event : _events)
+                fds.push_back(detail::perf_event_open(event.type, event.config, tid, -1,
+                                                      event.user_only));
+            _threads.emplace_back(tid, fds);
+        }
+
+        /*
+         * Threads created later inherit the counters, and attaching them
+         * again would count them twice. The descriptors of threads that
+         * exit are kept, since threads they created are counted through
+         * them.
+         */
+        void attach_threads()
+        {
+            DIR* dir = opendir("/proc/self/task");
+            if (!dir) return;
+
+            while (dirent* entry = readdir(dir))
+            {
+                int tid = atoi(entry->d_name);
+                if (tid > 0) attach(tid);
+            }
+
+            closedir(dir);
+        }
+
+        void open_uncore()
+        {
+            const std::string root = "/sys/bus/event_source/devices";
+
+            DIR* dir = opendir(root.c_str());
+            if (!dir) return;
+
+            while (dirent* entry = readdir(dir))
+            {
+                std::string name = entry->d_name;
+                if (name.compare(0, 10, "uncore_imc") != 0) continue;
+
+                std::string pmu = root + "/" + name;
+                int type = atoi(detail::read_sysfs(pmu + "/type").c_str());
+                std::vector<int> cpus = detail::parse_cpu_list(detail::read_sysfs(pmu + "/cpumask"));
+
+                for (auto& event : {std::make_pair(COUNTER_MEM_READ_BYTES, "cas_count_read"),
+                                    std::make_pair(COUNTER_MEM_WRITE_BYTES, "cas_count_write")})
+                {
+                    std::string path = pmu + "/events/" + event.second;
+                    uint64_t config;
+                    if (!detail::sysfs_event_config(pmu, detail::read_sysfs(path), config))
+                        continue;
+
+                    /*
+                     * The scale converts counts to the unit given, usually
+                     * 64-byte lines to MiB.
+                     */
+                    std::string scale_str = detail::read_sysfs(path + ".scale");
+                    double scale = scale_str.empty() ? 64 : atof(scale_str.c_str());
+                    std::string unit = detail::read_sysfs(path + ".unit");
+                    if (unit == "MiB") scale *= 1024*1024;
+                    else if (unit == "KiB") scale *= 1024;
+
+                    for (int cpu : cpus)
+                    {
+                        int fd = detail::perf_event_open(type, config, -1, cpu, false);
+                        if (fd < 0) continue;
+                        _uncore.push_back({event.first, fd, scale});
+                        _available[event.first] = true;
+                    }
+                }
+            }
+
+            closedir(dir);
+        }
+
+        double delta(int fd)
+        {
+            return detail::counter_delta(_baseline[fd], detail::read_counter(fd));
+        }
+
+        template <typename Func>
+        void for_each_fd(Func func)
+        {
+            for (const auto& thread : _threads)
+                for (int fd : thread.second)
+                    if (fd >= 0) func(fd);
+            for (const Uncore& u : _uncore) func(u.fd);
+        }
+
+#endif
+
+    public:
+        explicit PerfCounters(bool uncore = true)
+        {
+#if defined(__linux__)
+            /*
+             * Keep the events that can be opened on the calling thread.
+             */
+            for (Event event : candidate_events())
+            {
+                int fd = detail::perf_event_open(event.type, event.config, 0, -1,
+                                                 event.user_only);
+
+                /*
+                 * Where the kernel may not be profiled, the task clock and
+                 * page faults can still be counted from user mode; context
+                 * switches and migrations happen in the kernel and would
+                 * always read 0, so they are left out.
+                 */
+                if (fd < 0 && (event.id == COUNTER_TASK_CLOCK_NS ||
+                               event.id == COUNTER_PAGE_FAULTS))
+                {
+                    event.user_only = true;
+                    fd = detail::perf_event_open(event.type, event.config, 0, -1, true);
+                }
+
+                if (fd < 0) continue;
+                close(fd);
+
+                _events.push_back(event);
+                _available[event.id] = true;
+            }
+
+            attach_threads();
+            if (uncore) open_uncore();
+#endif
+        }
+
+        PerfCounters(const PerfCounters&) = delete;
+
+        PerfCounters& operator=(const PerfCounters&) = delete;
+
+        ~PerfCounters()
+        {
+#if defined(__linux__)
+            for_each_fd([](int fd) { close(fd); });
+#endif
+        }
+
+        bool available(CounterEvent event) const
+        {
+            return _available[event];
+        }
+
+        /*
+         * Whether any hardware (core PMU) event could be opened.
+         */
+        bool hardware() const
+        {
+            return _available[COUNTER_CYCLES] || _available[COUNTER_INSTRUCTIONS];
+        }
+
+        void start()
+        {
+#if defined(__linux__)
+            for_each_fd([&](int fd) { _baseline[fd] = detail::read_counter(fd); });
+            for_each_fd([](int fd) { ioctl(fd, PERF_EVENT_IOC_ENABLE, 0); });
+#endif
+        }
+
+        CounterValues stop()
+        {
+            CounterValues values;
+
+#if defined(__linux__)
+            for_each_fd([](int fd) { ioctl(fd, PERF_EVENT_IOC_DISABLE, 0); });
+
+            for (const auto& thread : _threads)
+                for (size_t i = 0;i < _events.size();i++)
+                    if (thread.second[i] >= 0)
+                        values.value[_events[i].id] += delta(thread.second[i]);
+
+            for (const Uncore& u : _uncore)
+                values.value[u.id] += u.scale*delta(u.fd);
+#endif
+
+            std::copy(_available, _available+COUNTER_EVENTS, values.available);
+            return values;
+        }
+};
+
+/*
+ * Per-operation counter totals for Matrix-level operations (expression
+ * assignment), for finding out where the misses are without wrapping
+ * every call site. Off by default, and then costs one relaxed load per
+ * operation; enable() or BLISPP_COUNTERS=1 in the environment turns it
+ * on. Operations started while another thread's operation is being
+ * counted are not counted, since the counters cover the whole process,
+ * and neither are operations nested inside a counted one.
+ */
+class OperationCounters
+{
+    public:
+        struct Totals
+        {
+            size_t calls = 0;
+            CounterValues values;
+        };
+
+        class Scope
+        {
+            private:
+                OperationCounters& _parent;
+                const char* _op;
+                std::unique_lock<std::mutex> _lock;
+
+                static bool& in_scope()
+                {
+                    static thread_local bool flag = false;
+                    return flag;
+                }
+
+            public:
+                explicit Scope(const char* op)
+                : _parent(OperationCounters::instance()), _op(op)
+                {
+                    if (!_parent._enabled.load(std::memory_order_relaxed) || in_scope()) return;
+
+                    _lock = std::unique_lock<std::mutex>(_parent._counting, std::try_to_lock);
+                    if (!_lock) return;
+
+                    in_scope() = true;
+                    _parent._counters->start();
+                }
+
+                Scope(const Scope&) = delete;
+
+                Scope& operator=(const Scope&) = delete;
+
+                ~Scope()
+                {
+                    if (!_lock) return;
+
+                    CounterValues values = _parent._counters->stop();
+                    in_scope() = false;
+
+                    std::lock_guard<std::mutex> guard(_parent._mutex);
+                    Totals& totals = _parent._totals[_op];
+                    totals.calls++;
+                    totals.values += values;
+                }
+        };
+
+    private:
+        std::atomic<bool> _enabled;
+        std::unique_ptr<PerfCounters> _counters;
+        std::mutex _counting;
+        std::mutex _mutex;
+        std::map<std::string,Totals> _totals;
+
+    public:
+        OperationCounters()
+        : _enabled(false)
+        {
+            const char* env = getenv("BLISPP_COUNTERS");
+            if (env && atoi(env) > 0) enable();
+        }
+
+        void enable(bool on = true)
+        {
+            std::lock_guard<std::mutex> counting(_counting);
+            if (on && !_counters) _counters.reset(new PerfCounters);
+            _enabled = on;
+        }
+
+        bool enabled() const
+        {
+            return _enabled;
+        }
+
+        std::map<std::string,Totals> totals()
+        {
+            std::lock_guard<std::mutex> guard(_mutex);
+            return _totals;
+        }
+
+        void clear()
+        {
+            std::lock_guard<std::mutex> guard(_mutex);
+            _totals.clear();
+        }
+
+        static OperationCounters& instance()
+        {
+            static OperationCounters counters;
+            return counters;
+        }
+};
+
+}
+
+#endif
@@ -0,0 +1,251 @@
+#ifndef _BLISPP_FILE_HPP_
+#define _BLISPP_FILE_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include "blis++_mapped.hpp"
+#include "blis++_matrix.hpp"
+#include "blis++_memory.hpp"
+
+namespace blis
+{
+
+/*
+ * On-disk matrix format. A fixed 128-byte header is followed, at
+ * data_offset (a multiple of BLIS_PAGE_SIZE, and so also of
+ * BLIS_HEAP_ADDR_ALIGN_SIZE), by the elements laid out with the recorded
+ * strides. The header and payload are in the byte order of the machine
+ * that wrote them; byte_order tells a reader whether it has to swap.
+ */
+struct MatrixFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    int32_t datatype;
+    uint32_t element_size;
+    int64_t m;
+    int64_t n;
+    int64_t rs;
+    int64_t cs;
+    uint64_t data_offset;
+    uint64_t data_size;
+    char reserved[56];
+};
+
+static_assert(sizeof(MatrixFileHeader) == 128, "unexpected header padding");
+
+namespace detail
+{
+    constexpr char MATRIX_FILE_MAGIC[8] = {'B','L','I','S','M','A','T','\0'};
+    constexpr uint32_t MATRIX_FILE_VERSION = 1;
+    constexpr uint32_t MATRIX_FILE_BYTE_ORDER = 0x01020304;
+
+    inline void byte_swap(void* p, size_t size)
+    {
+        char* c = (char*)p;
+        std::reverse(c, c+size);
+    }
+
+    inline void byte_swap(MatrixFileHeader& header)
+    {
+        byte_swap(&header.version, 4);
+        byte_swap(&header.byte_order, 4);
+        byte_swap(&header.datatype, 4);
+        byte_swap(&header.element_size, 4);
+        byte_swap(&header.m, 8);
+        byte_swap(&header.n, 8);
+        byte_swap(&header.rs, 8);
+        byte_swap(&header.cs, 8);
+        byte_swap(&header.data_offset, 8);
+        byte_swap(&header.data_size, 8);
+    }
+
+    template <typename T>
+    void byte_swap_elements(T* p, size_t n)
+    {
+        typedef real_type_t<T> R;
+        R* r = (R*)p;
+
+        for (size_t i = 0;i < n*sizeof(T)/sizeof(R);i++)
+            byte_swap(r+i, sizeof(R));
+    }
+
+    inline uint64_t matrix_file_extent(int64_t m, int64_t n, int64_t rs, int64_t cs)
+    {
+        return m == 0 || n == 0 ? 0 : (m-1)*rs + (n-1)*cs + 1;
+    }
+
+    /*
+     * Read and validate the header of a matrix file. Returns true if the
+     * file was written with the opposite byte order (the header itself
+     * has already been swapped).
+     */
+    template <typename T>
+    bool read_header(int fd, const std::string& path, MatrixFileHeader& header)
+    {
+        pread_all(fd, &header, sizeof(header), 0);
+
+        if (memcmp(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic)) != 0)
+            throw std::runtime_error(path + " is not a matrix file");
+
+        bool swapped = header.byte_order != MATRIX_FILE_BYTE_ORDER;
+        if (swapped) byte_swap(header);
+
+        if (header.byte_order != MATRIX_FILE_BYTE_ORDER)
+            throw std::runtime_error(path + " has an unknown byte order");
+
+        if (header.version != MATRIX_FILE_VERSION)
+            throw std::runtime_error(path + " has an unsupported version");
+
+        if (header.datatype != datatype<T>::value || header.element_size != sizeof(T))
+            throw std::runtime_error(path + " has a different datatype");
+
+        if (header.m < 0 || header.n < 0 || header.rs < 0 || header.cs < 0)
+            throw std::runtime_error(path + " has a corrupt header");
+
+        /*
+         * The payload is read or mapped with the recorded strides and
+         * size, so both have to describe exactly the buffer the matrix
+         * gets, and lie within the file.
+         */
+        bool empty = header.m == 0 || header.n == 0;
+        const int64_t max_offset = std::numeric_limits<int64_t>::max()/(2*sizeof(T));
+
+        if (!empty && (header.rs == 0 || header.cs == 0 ||
+                       header.m-1 > max_offset/header.rs ||
+                       header.n-1 > max_offset/header.cs))
+            throw std::runtime_error(path + " has a corrupt header");
+
+        if (header.data_size != matrix_file_extent(header.m, header.n,
+                                                   header.rs, header.cs)*sizeof(T))
+            throw std::runtime_error(path + " has a corrupt header");
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) throw_errno("fstat " + path);
+
+        if (header.data_offset%BLIS_PAGE_SIZE != 0 ||
+            header.data_offset > (uint64_t)st.st_size ||
+            header.data_size > (uint64_t)st.st_size - header.data_offset)
+            throw std::runtime_error(path + " is truncated or has a corrupt header");
+
+        return swapped;
+    }
+}
+
+/*
+ * Write A to path. A matrix stored densely by rows or by columns (and not
+ * conjugated) goes out with one write straight from its buffer, keeping
+ * its layout; anything else is first packed column-major.
+ */
+template <typename T, typename Allocator>
+void save(const std::string& path, const Matrix<T,Allocator>& A)
+{
+    dim_t m = A.length();
+    dim_t n = A.width();
+    inc_t rs = A.row_stride();
+    inc_t cs = A.col_stride();
+
+    if (A.is_transposed())
+    {
+        std::swap(m, n);
+        std::swap(rs, cs);
+    }
+
+    bool dense = !A.is_conjugated() &&
+                 ((rs == 1 && (cs == m || n == 1)) ||
+                  (cs == 1 && (rs == n || m == 1)));
+
+    Matrix<T> packed;
+    const T* p = A.data();
+
+    if (!dense)
+    {
+        obj_t a = *static_cast<const obj_t*>(A);
+        packed.reset(m, n, 1, std::max<dim_t>(m, 1));
+        bli_copym(&a, packed);
+        p = packed.data();
+        rs = 1;
+        cs = std::max<dim_t>(m, 1);
+    }
+
+    MatrixFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, detail::MATRIX_FILE_MAGIC, sizeof(header.magic));
+    header.version = detail::MATRIX_FILE_VERSION;
+    header.byte_order = detail::MATRIX_FILE_BYTE_ORDER;
+    header.datatype = datatype<T>::value;
+    header.element_size = sizeof(T);
+    header.m = m;
+    header.n = n;
+    header.rs = rs;
+    header.cs = cs;
+    header.data_offset = (sizeof(header)+BLIS_PAGE_SIZE-1)/BLIS_PAGE_SIZE*BLIS_PAGE_SIZE;
+    header.data_size = detail::matrix_file_extent(m, n, rs, cs)*sizeof(T);
+
+    detail::FileDescriptor fd(path, O_WRONLY|O_CREAT|O_TRUNC);
+
+    if (ftruncate(fd, header.data_offset+header.data_size) != 0)
+        detail::throw_errno("ftruncate " + path);
+
+    detail::pwrite_all(fd, &header, sizeof(header), 0);
+    detail::pwrite_all(fd, p, header.data_size, header.data_offset);
+}
+
+/*
+ * Read a matrix file into A, which is reallocated with the stored
+ * strides. The payload is read with a single call directly into A's
+ * buffer, so with an AlignedAllocator no copy is made in user space.
+ */
+template <typename T, typename Allocator>
+void load(const std::string& path, Matrix<T,Allocator>& A)
+{
+    detail::FileDescriptor fd(path, O_RDONLY);
+    MatrixFileHeader header;
+    bool swapped = detail::read_header<T>(fd, path, header);
+
+    A.reset(header.m, header.n, header.rs, header.cs);
+
+    detail::pread_all(fd, A.data(), header.data_size, header.data_offset);
+
+    if (swapped) detail::byte_swap_elements(A.data(), header.data_size/sizeof(T));
+}
+
+template <typename T>
+Matrix<T,AlignedAllocator<T>> load(const std::string& path)
+{
+    Matrix<T,AlignedAllocator<T>> A;
+    load(path, A);
+    return A;
+}
+
+/*
+ * Attach to the payload of a matrix file without reading it: the matrix
+ * is a view of the mapped file, paged in on demand. Files written with
+ * the opposite byte order cannot be mapped and have to be load()ed.
+ */
+template <typename T>
+MappedMatrix<T> load_mapped(const std::string& path,
+                            MapAccess access = MAPPED_READ_ONLY,
+                            MapAdvice advice = ADVISE_NORMAL)
+{
+    MatrixFileHeader header;
+
+    {
+        detail::FileDescriptor fd(path, O_RDONLY);
+        if (detail::read_header<T>(fd, path, header))
+            throw std::runtime_error(path + " has a foreign byte order and cannot be mapped");
+    }
+
+    return MappedMatrix<T>(path, header.m, header.n, header.rs, header.cs,
+                           access, advice, header.data_offset);
+}
+
+}
+
+#endif
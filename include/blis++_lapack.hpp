@@ -0,0 +1,690 @@
+#ifndef _BLISPP_LAPACK_HPP_
+#define _BLISPP_LAPACK_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "blis++_autotune.hpp"
+#include "blis++_matrix.hpp"
+#include "blis++_partition.hpp"
+#include "blis++_thread.hpp"
+#include "blis++_view.hpp"
+
+namespace blis
+{
+
+/*
+ * Blocked factorizations built directly on the BLIS level-3 operations, so
+ * that all of the threading comes from BLIS (and the library's own
+ * ThreadPool for look-ahead) rather than from a separately linked LAPACK.
+ *
+ * Each routine works in place on a MatrixView, with Matrix overloads for
+ * convenience, and follows the LAPACK conventions for its result: 0 on
+ * success, otherwise one plus the index at which the factorization broke
+ * down. nb = 0 selects the block size tuned for this shape and thread
+ * count (see Autotuner and tune_potrf etc.), or LAPACK_BLOCK_SIZE if the
+ * routine has not been tuned. With lookahead, the next block
+ * column is updated first and then factored concurrently with the rest of
+ * the trailing update. BLIS has no per-call thread count, so both halves
+ * use BLIS's configured threading: look-ahead assumes BLIS_NUM_THREADS=1,
+ * and otherwise oversubscribes the cores while they overlap.
+ */
+constexpr dim_t LAPACK_BLOCK_SIZE = 128;
+
+namespace lapack
+{
+
+namespace detail
+{
+    template <typename T>
+    dim_t block_size(const char* op, dim_t m, dim_t n)
+    {
+        return Autotuner::instance().block_size(op, datatype<T>::value, m, n,
+                                                std::min(m, n),
+                                                ThreadPool::instance().num_threads(),
+                                                LAPACK_BLOCK_SIZE);
+    }
+
+    template <typename T>
+    void copy(const MatrixView<T>& A, const MatrixView<T>& B)
+    {
+        if (B.length() == 0 || B.width() == 0) return;
+        bli_copym(A.obj(), B.obj());
+    }
+
+    /*
+     * A well-conditioned, diagonally dominant test matrix for tuning.
+     */
+    template <typename T>
+    void tuning_matrix(const MatrixView<T>& A)
+    {
+        dim_t m = A.length();
+        dim_t n = A.width();
+
+        for (dim_t j = 0;j < n;j++)
+            for (dim_t i = 0;i < m;i++)
+                A(i, j) = T(1.0/(1+i+j) + (i == j ? m : 0));
+    }
+
+    template <typename T>
+    dim_t tune(const char* op, dim_t m, dim_t n,
+               const std::function<void(const MatrixView<T>&, dim_t)>& run)
+    {
+        Matrix<T> A_(m, n), F_(m, n);
+        MatrixView<T> A(A_), F(F_);
+        tuning_matrix(A);
+
+        return Autotuner::instance().tune(op, datatype<T>::value, m, n, std::min(m, n),
+                                          ThreadPool::instance().num_threads(),
+                                          autotune_candidates(std::min(m, n)),
+                                          [&] { copy(A, F); },
+                                          [&](dim_t nb) { run(F, nb); });
+    }
+
+    /*
+     * Diagonal blocks at most this large are factored element by element
+     * at the bottom of the recursion.
+     */
+    constexpr dim_t LEAF_SIZE = 16;
+
+    template <typename T>
+    MatrixView<T> herm(MatrixView<T> A)
+    {
+        A.transpose();
+        A.conjugate();
+        return A;
+    }
+
+    /*
+     * The stored matrix of A seen through its transpose flag, so that
+     * element access and partitioning are in logical coordinates.
+     */
+    template <typename T>
+    MatrixView<T> logical(MatrixView<T> A)
+    {
+        if (A.is_conjugated())
+            throw std::logic_error("conjugated operands are not supported");
+
+        if (A.is_transposed())
+            A.reset(A.width(), A.length(), A.data(), A.col_stride(), A.row_stride());
+
+        return A;
+    }
+
+    template <typename T>
+    MatrixView<T> transposed(const MatrixView<T>& A)
+    {
+        return MatrixView<T>(A.width(), A.length(), A.data(),
+                             A.col_stride(), A.row_stride());
+    }
+
+    /*
+     * The shape recorded for a factorization: the (logical) dimensions
+     * of A, with the block size as k.
+     */
+    template <typename T>
+    void record(ShapeRecorder::Scope& recording, const char* variant,
+                const MatrixView<T>& A, dim_t nb)
+    {
+        recording.variant(variant);
+        recording.operand_a(A.obj().obj);
+        recording.shape(A.length(), A.width(), nb);
+    }
+
+    inline void record_triangular(ShapeRecorder::Scope& recording, side_t side,
+                                  uplo_t uplo, diag_t diag, const obj_t& a, const obj_t& b)
+    {
+        char variant[] = {side == BLIS_LEFT ? 'l' : 'r', uplo == BLIS_LOWER ? 'l' : 'u',
+                          blis::detail::trans_char((trans_t)bli_obj_conjtrans_status(a)),
+                          diag == BLIS_UNIT_DIAG ? 'u' : 'n', 0};
+        recording.variant(variant);
+        recording.operand_a(a);
+        recording.operand_b(b);
+        recording.shape(blis::detail::length(b), blis::detail::width(b), 0);
+    }
+
+    template <typename T>
+    MatrixView<T> block(const MatrixView<T>& A, dim_t i, dim_t j, dim_t m, dim_t n)
+    {
+        return MatrixView<T>(m, n, &A(i, j), A.row_stride(), A.col_stride());
+    }
+
+    template <typename T>
+    void gemm(const T& alpha, const MatrixView<T>& A, const MatrixView<T>& B,
+              const T& beta, const MatrixView<T>& C)
+    {
+        if (C.length() == 0 || C.width() == 0) return;
+        obj_t a = A.obj().obj, b = B.obj().obj, c = C.obj().obj;
+        blis::detail::assign_gemm(alpha, a, b, beta, c);
+    }
+
+    template <typename T>
+    void trsm(side_t side, uplo_t uplo, diag_t diag, const T& alpha,
+              const MatrixView<T>& A, const MatrixView<T>& B)
+    {
+        if (B.length() == 0 || B.width() == 0) return;
+        blis::detail::ScalarConstant<T> s(alpha);
+        obj_t a = A.obj().obj, b = B.obj().obj;
+        blis::detail::set_triangular(a, uplo, diag);
+        ShapeRecorder::Scope recording("trsm", datatype<T>::value);
+        if (recording.active()) record_triangular(recording, side, uplo, diag, a, b);
+        bli_trsm(side, s, &a, &b);
+    }
+
+    template <typename T>
+    void trmm(side_t side, uplo_t uplo, diag_t diag, const T& alpha,
+              const MatrixView<T>& A, const MatrixView<T>& B)
+    {
+        if (B.length() == 0 || B.width() == 0) return;
+        blis::detail::ScalarConstant<T> s(alpha);
+        obj_t a = A.obj().obj, b = B.obj().obj;
+        blis::detail::set_triangular(a, uplo, diag);
+        ShapeRecorder::Scope recording("trmm", datatype<T>::value);
+        if (recording.active()) record_triangular(recording, side, uplo, diag, a, b);
+        bli_trmm(side, s, &a, &b);
+    }
+
+    /*
+     * Lower triangle of C = alpha*A*A^H + beta*C.
+     */
+    template <typename T>
+    void herk(const T& alpha, const MatrixView<T>& A, const T& beta,
+              const MatrixView<T>& C)
+    {
+        if (C.length() == 0) return;
+        blis::detail::ScalarConstant<T> a_(alpha), b_(beta);
+        obj_t a = A.obj().obj, c = C.obj().obj;
+        bli_obj_set_struc(BLIS_HERMITIAN, c);
+        bli_obj_set_uplo(BLIS_LOWER, c);
+        ShapeRecorder::Scope recording("herk", datatype<T>::value);
+        if (recording.active())
+        {
+            char variant[] = {'l',
+                blis::detail::trans_char((trans_t)bli_obj_conjtrans_status(a)), 0};
+            recording.variant(variant);
+            recording.operand_a(a);
+            recording.operand_c(c);
+            recording.shape(C.length(), C.width(), blis::detail::width(a));
+        }
+        bli_herk(a_, &a, b_, &c);
+    }
+
+    /*
+     * Run f and g at the same time on two threads of the pool (or one
+     * after the other if only one is available). The BLIS calls in each
+     * still use BLIS's configured thread count.
+     */
+    template <typename F, typename G>
+    void concurrently(F f, G g)
+    {
+        ThreadPool::instance().run([&](int tid, int nthreads)
+        {
+            ShapeRecorder::Nested nested;
+
+            if (nthreads < 2)
+            {
+                f();
+                g();
+            }
+            else if (tid == 0)
+            {
+                f();
+            }
+            else if (tid == 1)
+            {
+                g();
+            }
+        });
+    }
+
+    /*
+     * Swap row i with row ipiv[i] for k1 <= i < k2.
+     */
+    template <typename T>
+    void laswp(const MatrixView<T>& A, const dim_t* ipiv, dim_t k1, dim_t k2)
+    {
+        for (dim_t i = k1;i < k2;i++)
+        {
+            dim_t p = ipiv[i];
+            if (p == i) continue;
+
+            for (dim_t j = 0;j < A.width();j++)
+                std::swap(A(i, j), A(p, j));
+        }
+    }
+
+    template <typename T>
+    dim_t potrf_unblocked(const MatrixView<T>& A)
+    {
+        typedef real_type_t<T> R;
+
+        for (dim_t j = 0;j < A.length();j++)
+        {
+            R d = std::real(A(j, j));
+            for (dim_t k = 0;k < j;k++) d -= std::real(norm2(A(j, k)));
+
+            if (!(d > R(0))) return j+1;
+
+            R ljj = std::sqrt(d);
+            A(j, j) = ljj;
+
+            for (dim_t i = j+1;i < A.length();i++)
+            {
+                T s = A(i, j);
+                for (dim_t k = 0;k < j;k++) s -= A(i, k)*blis::conj(A(j, k));
+                A(i, j) = s/ljj;
+            }
+        }
+
+        return 0;
+    }
+
+    /*
+     * Recursive lower Cholesky of a diagonal block: factor the leading
+     * half, solve for the off-diagonal block, update and factor the
+     * trailing half.
+     */
+    template <typename T>
+    dim_t potrf_recursive(MatrixView<T> A)
+    {
+        dim_t n = A.length();
+        if (n <= LEAF_SIZE) return potrf_unblocked(A);
+
+        MatrixView<T> ATL, ATR,
+                      ABL, ABR;
+        Partition2x2(n/2, n/2, QUADRANT_TL, A, ATL, ATR, ABL, ABR);
+
+        dim_t info = potrf_recursive(ATL);
+        if (info) return info;
+
+        trsm(BLIS_RIGHT, BLIS_LOWER, BLIS_NONUNIT_DIAG, T(1), herm(ATL), ABL);
+        herk(T(-1), ABL, T(1), ABR);
+
+        info = potrf_recursive(ABR);
+        return info ? info+n/2 : 0;
+    }
+
+    /*
+     * Factor the block column [A11; A21]: A11 = L11*L11^H and
+     * A21 = A21*L11^-H.
+     */
+    template <typename T>
+    dim_t potrf_panel(const MatrixView<T>& A11, const MatrixView<T>& A21)
+    {
+        dim_t info = potrf_recursive(A11);
+        if (info) return info;
+
+        trsm(BLIS_RIGHT, BLIS_LOWER, BLIS_NONUNIT_DIAG, T(1), herm(A11), A21);
+        return 0;
+    }
+
+    template <typename T>
+    dim_t potrf_lower(MatrixView<T> A, dim_t nb, bool lookahead)
+    {
+        bool factored = false;
+
+        for (auto& b : blocked_diagonal(A, nb))
+        {
+            dim_t k = b.A00.length();
+
+            if (!factored)
+            {
+                dim_t info = potrf_panel(b.A11, b.A21);
+                if (info) return info+k;
+            }
+
+            factored = false;
+
+            dim_t nr = b.A22.length();
+            dim_t nn = std::min(nb, nr);
+
+            if (!lookahead || nn == nr)
+            {
+                herk(T(-1), b.A21, T(1), b.A22);
+                continue;
+            }
+
+            /*
+             * Update the next block column, then factor it while the rest
+             * of the trailing matrix is updated.
+             */
+            MatrixView<T> A21_1, A21_2;
+            PartitionTop(nn, A21_1, b.A21, A21_2);
+
+            MatrixView<T> P11 = block(b.A22, 0, 0, nn, nn);
+            MatrixView<T> P21 = block(b.A22, nn, 0, nr-nn, nn);
+            MatrixView<T> R22 = block(b.A22, nn, nn, nr-nn, nr-nn);
+
+            herk(T(-1), A21_1, T(1), P11);
+            gemm(T(-1), A21_2, herm(A21_1), T(1), P21);
+
+            dim_t info = 0;
+            concurrently([&] { info = potrf_panel(P11, P21); },
+                         [&] { herk(T(-1), A21_2, T(1), R22); });
+
+            if (info) return info+k+b.A11.length();
+            factored = true;
+        }
+
+        return 0;
+    }
+
+    /*
+     * Recursive LU with partial pivoting of an m x n panel (m >= n):
+     * factor the left half, apply its interchanges and updates to the
+     * right half, factor the lower right part and apply its interchanges
+     * back to the left. ipiv is relative to the panel.
+     */
+    template <typename T>
+    dim_t getrf_recursive(MatrixView<T> A, dim_t* ipiv)
+    {
+        dim_t m = A.length();
+        dim_t n = A.width();
+
+        if (n == 1)
+        {
+            dim_t p = 0;
+            for (dim_t i = 1;i < m;i++)
+                if (std::abs(A(i, 0)) > std::abs(A(p, 0))) p = i;
+
+            ipiv[0] = p;
+            if (A(p, 0) == T(0)) return 1;
+
+            std::swap(A(0, 0), A(p, 0));
+            T inv = T(1)/A(0, 0);
+            for (dim_t i = 1;i < m;i++) A(i, 0) *= inv;
+
+            return 0;
+        }
+
+        dim_t n1 = n/2;
+
+        MatrixView<T> AL, AR;
+        PartitionLeft(n1, A, AL, AR);
+
+        MatrixView<T> A11, A21, A12, A22;
+        PartitionTop(n1, A11, AL, A21);
+        PartitionTop(n1, A12, AR, A22);
+
+        dim_t info = getrf_recursive(AL, ipiv);
+
+        laswp(AR, ipiv, 0, n1);
+        trsm(BLIS_LEFT, BLIS_LOWER, BLIS_UNIT_DIAG, T(1), A11, A12);
+        gemm(T(-1), A21, A12, T(1), A22);
+
+        dim_t info2 = getrf_recursive(A22, ipiv+n1);
+
+        for (dim_t i = n1;i < n;i++) ipiv[i] += n1;
+        laswp(AL, ipiv, n1, n);
+
+        if (!info && info2) info = info2+n1;
+        return info;
+    }
+
+    template <typename T>
+    dim_t getrf_blocked(MatrixView<T> A, dim_t* ipiv, dim_t nb, bool lookahead)
+    {
+        dim_t m = A.length();
+        dim_t n = A.width();
+        dim_t info = 0;
+        bool factored = false;
+
+        auto factor = [&](dim_t k, dim_t w)
+        {
+            dim_t i = getrf_recursive(block(A, k, k, m-k, w), ipiv+k);
+            for (dim_t j = k;j < k+w;j++) ipiv[j] += k;
+            if (i && !info) info = i+k;
+        };
+
+        for (auto& b : blocked_diagonal(A, nb))
+        {
+            dim_t k = b.A00.length();
+            dim_t w = b.A11.width();
+
+            if (!factored) factor(k, w);
+            factored = false;
+
+            /*
+             * Apply the interchanges to the columns on either side, then
+             * form U12 and update the trailing matrix.
+             */
+            laswp(block(A, 0, 0, m, k), ipiv, k, k+w);
+            laswp(block(A, 0, k+w, m, n-k-w), ipiv, k, k+w);
+
+            trsm(BLIS_LEFT, BLIS_LOWER, BLIS_UNIT_DIAG, T(1), b.A11, b.A12);
+
+            dim_t mr = b.A22.length();
+            dim_t nr = b.A22.width();
+            dim_t nn = std::min(nb, std::min(mr, nr));
+
+            if (!lookahead || nn == 0 || nn == nr)
+            {
+                gemm(T(-1), b.A21, b.A12, T(1), b.A22);
+                continue;
+            }
+
+            MatrixView<T> A12_1, A12_2, A22_1, A22_2;
+            PartitionLeft(nn, b.A12, A12_1, A12_2);
+            PartitionLeft(nn, b.A22, A22_1, A22_2);
+
+            gemm(T(-1), b.A21, A12_1, T(1), A22_1);
+
+            concurrently([&] { factor(k+w, nn); },
+                         [&] { gemm(T(-1), b.A21, A12_2, T(1), A22_2); });
+
+            factored = true;
+        }
+
+        return info;
+    }
+
+    template <typename T>
+    dim_t trtri_unblocked(const MatrixView<T>& A, diag_t diag)
+    {
+        dim_t n = A.length();
+
+        for (dim_t j = 0;j < n;j++)
+        {
+            T ajj = diag == BLIS_UNIT_DIAG ? T(1) : T(1)/A(j, j);
+            if (diag != BLIS_UNIT_DIAG) A(j, j) = ajj;
+
+            /*
+             * Column j below the diagonal: -inv(L22)*L(j+1:n,j)*ajj, with
+             * inv(L22) not yet formed, so solve forward.
+             */
+            for (dim_t i = j+1;i < n;i++)
+            {
+                T s = A(i, j)*ajj;
+                for (dim_t k = j+1;k < i;k++) s += A(i, k)*A(k, j);
+                A(i, j) = diag == BLIS_UNIT_DIAG ? -s : -s/A(i, i);
+            }
+        }
+
+        return 0;
+    }
+
+    /*
+     * Recursive lower triangular inverse: with A00 inverted, A10 becomes
+     * -inv(A11)*A10*inv(A00), and then A11 is inverted.
+     */
+    template <typename T>
+    void trtri_recursive(MatrixView<T> A, diag_t diag)
+    {
+        dim_t n = A.length();
+
+        if (n <= LEAF_SIZE)
+        {
+            trtri_unblocked(A, diag);
+            return;
+        }
+
+        MatrixView<T> ATL, ATR,
+                      ABL, ABR;
+        Partition2x2(n/2, n/2, QUADRANT_TL, A, ATL, ATR, ABL, ABR);
+
+        trtri_recursive(ATL, diag);
+        trmm(BLIS_RIGHT, BLIS_LOWER, diag, T(1), ATL, ABL);
+        trsm(BLIS_LEFT, BLIS_LOWER, diag, T(-1), ABR, ABL);
+        trtri_recursive(ABR, diag);
+    }
+
+    template <typename T>
+    void trtri_lower(MatrixView<T> A, diag_t diag, dim_t nb)
+    {
+        for (auto& b : blocked_diagonal(A, nb))
+        {
+            trmm(BLIS_RIGHT, BLIS_LOWER, diag, T(1), b.A00, b.A10);
+            trsm(BLIS_LEFT, BLIS_LOWER, diag, T(-1), b.A11, b.A10);
+            trtri_recursive(b.A11, diag);
+        }
+    }
+}
+
+/*
+ * Cholesky factorization A = L*L^H (uplo lower) or A = U^H*U (upper),
+ * overwriting the uplo triangle of the Hermitian positive definite A.
+ */
+template <typename T>
+dim_t potrf(uplo_t uplo, MatrixView<T> A, dim_t nb = 0, bool lookahead = false)
+{
+    ShapeRecorder::Scope recording("potrf", datatype<T>::value);
+
+    A = detail::logical(A);
+
+    if (A.length() != A.width())
+        throw std::logic_error("matrix must be square");
+
+    if (nb <= 0) nb = detail::block_size<T>("potrf", A.length(), A.width());
+
+    if (recording.active())
+        detail::record(recording, uplo == BLIS_LOWER ? "l" : "u", A, nb);
+
+    if (uplo == BLIS_LOWER) return detail::potrf_lower(A, nb, lookahead);
+
+    /*
+     * The upper triangle of A is the lower triangle of A^T = conj(A), and
+     * if conj(A) = L*L^H then A = (L^T)^H*L^T, so factoring the transpose
+     * in place leaves U = L^T.
+     */
+    return detail::potrf_lower(detail::transposed(A), nb, lookahead);
+}
+
+template <typename T, typename Allocator>
+dim_t potrf(uplo_t uplo, Matrix<T,Allocator>& A, dim_t nb = 0, bool lookahead = false)
+{
+    return potrf(uplo, MatrixView<T>(A), nb, lookahead);
+}
+
+/*
+ * LU factorization with partial pivoting, A = P*L*U, with L unit lower
+ * triangular. Row i was interchanged with row ipiv[i] (counting from 0).
+ * As in LAPACK, a zero pivot is reported but the factorization is
+ * completed.
+ */
+template <typename T>
+dim_t getrf(MatrixView<T> A, std::vector<dim_t>& ipiv, dim_t nb = 0,
+            bool lookahead = false)
+{
+    ShapeRecorder::Scope recording("getrf", datatype<T>::value);
+
+    A = detail::logical(A);
+
+    if (nb <= 0) nb = detail::block_size<T>("getrf", A.length(), A.width());
+
+    if (recording.active()) detail::record(recording, "", A, nb);
+
+    ipiv.resize(std::min(A.length(), A.width()));
+
+    return detail::getrf_blocked(A, ipiv.data(), nb, lookahead);
+}
+
+template <typename T, typename Allocator>
+dim_t getrf(Matrix<T,Allocator>& A, std::vector<dim_t>& ipiv, dim_t nb = 0,
+            bool lookahead = false)
+{
+    return getrf(MatrixView<T>(A), ipiv, nb, lookahead);
+}
+
+/*
+ * Inverse of the triangular matrix in the uplo triangle of A, in place.
+ * A zero on the diagonal (of a non-unit matrix) is reported and A is
+ * left unchanged.
+ */
+template <typename T>
+dim_t trtri(uplo_t uplo, diag_t diag, MatrixView<T> A, dim_t nb = 0)
+{
+    ShapeRecorder::Scope recording("trtri", datatype<T>::value);
+
+    A = detail::logical(A);
+
+    if (A.length() != A.width())
+        throw std::logic_error("matrix must be square");
+
+    if (nb <= 0) nb = detail::block_size<T>("trtri", A.length(), A.width());
+
+    if (recording.active())
+    {
+        char variant[] = {uplo == BLIS_LOWER ? 'l' : 'u',
+                          diag == BLIS_UNIT_DIAG ? 'u' : 'n', 0};
+        detail::record(recording, variant, A, nb);
+    }
+
+    if (diag != BLIS_UNIT_DIAG)
+        for (dim_t i = 0;i < A.length();i++)
+            if (A(i, i) == T(0)) return i+1;
+
+    detail::trtri_lower(uplo == BLIS_LOWER ? A : detail::transposed(A), diag, nb);
+
+    return 0;
+}
+
+template <typename T, typename Allocator>
+dim_t trtri(uplo_t uplo, diag_t diag, Matrix<T,Allocator>& A, dim_t nb = 0)
+{
+    return trtri(uplo, diag, MatrixView<T>(A), nb);
+}
+
+/*
+ * Measure the candidate block sizes for each routine at this size and
+ * thread count and record the best in Autotuner::instance(). Later calls
+ * with nb = 0 pick it up (and interpolate from it for nearby sizes).
+ */
+template <typename T>
+dim_t tune_potrf(dim_t n, bool lookahead = false)
+{
+    return detail::tune<T>("potrf", n, n,
+    [&](const MatrixView<T>& A, dim_t nb)
+    {
+        potrf(BLIS_LOWER, A, nb, lookahead);
+    });
+}
+
+template <typename T>
+dim_t tune_getrf(dim_t m, dim_t n, bool lookahead = false)
+{
+    std::vector<dim_t> ipiv;
+    return detail::tune<T>("getrf", m, n,
+    [&](const MatrixView<T>& A, dim_t nb)
+    {
+        getrf(A, ipiv, nb, lookahead);
+    });
+}
+
+template <typename T>
+dim_t tune_trtri(dim_t n)
+{
+    return detail::tune<T>("trtri", n, n,
+    [&](const MatrixView<T>& A, dim_t nb)
+    {
+        trtri(BLIS_LOWER, BLIS_NONUNIT_DIAG, A, nb);
+    });
+}
+
+}
+}
+
+#endif
@@ -0,0 +1,357 @@
+#ifndef _BLISPP_MAPPED_HPP_
+#define _BLISPP_MAPPED_HPP_
+
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "blis++_matrix.hpp"
+
+namespace blis
+{
+
+enum MapAccess
+{
+    MAPPED_READ_ONLY,
+    MAPPED_READ_WRITE,
+    MAPPED_PRIVATE
+};
+
+enum MapAdvice
+{
+    ADVISE_NORMAL,
+    ADVISE_SEQUENTIAL,
+    ADVISE_RANDOM,
+    ADVISE_WILLNEED
+};
+
+namespace detail
+{
+    inline void throw_errno(const std::string& what)
+    {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    inline void pread_all(int fd, void* buf, size_t size, off_t offset)
+    {
+        char* p = (char*)buf;
+
+        while (size > 0)
+        {
+            ssize_t done = pread(fd, p, size, offset);
+
+            if (done < 0 && errno == EINTR) continue;
+            if (done < 0) throw_errno("pread");
+            if (done == 0) throw std::runtime_error("unexpected end of file");
+
+            p += done;
+            size -= done;
+            offset += done;
+        }
+    }
+
+    inline void pwrite_all(int fd, const void* buf, size_t size, off_t offset)
+    {
+        const char* p = (const char*)buf;
+
+        while (size > 0)
+        {
+            ssize_t done = pwrite(fd, p, size, offset);
+
+            if (done < 0 && errno == EINTR) continue;
+            if (done < 0) throw_errno("pwrite");
+
+            p += done;
+            size -= done;
+            offset += done;
+        }
+    }
+
+    /*
+     * An mmap'd byte range [offset,offset+size) of an open file. The
+     * mapping itself starts at the enclosing page boundary. With
+     * huge_pages, it is placed so that 2M boundaries of the file fall on
+     * 2M boundaries of the address space and advised with MADV_HUGEPAGE,
+     * which lets the kernel use huge pages for the page cache where the
+     * filesystem supports it (e.g. tmpfs).
+     */
+    class FileMapping
+    {
+        private:
+            void* _base = nullptr;
+            size_t _length = 0;
+            char* _data = nullptr;
+            size_t _size = 0;
+
+        public:
+            FileMapping() {}
+
+            FileMapping(int fd, off_t offset, size_t size, MapAccess access,
+                        bool huge_pages = false)
+            : _size(size)
+            {
+                const size_t huge_size = 2*1024*1024;
+
+                off_t map_offset = offset - offset%page_size();
+                _length = size + (offset-map_offset);
+
+                int prot = access == MAPPED_READ_ONLY ? PROT_READ : PROT_READ|PROT_WRITE;
+                int flags = access == MAPPED_PRIVATE ? MAP_PRIVATE : MAP_SHARED;
+                void* addr = nullptr;
+
+                if (huge_pages)
+                {
+                    size_t reserve = _length + huge_size;
+                    void* region = mmap(nullptr, reserve, PROT_NONE,
+                                        MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+                    if (region == MAP_FAILED) throw_errno("mmap");
+
+                    uintptr_t phase = map_offset%huge_size;
+                    uintptr_t start = ((uintptr_t)region + huge_size-1)/huge_size*huge_size;
+                    start = start - huge_size + phase;
+                    if (start < (uintptr_t)region) start += huge_size;
+
+                    munmap(region, reserve);
+                    addr = (void*)start;
+                }
+
+                _base = mmap(addr, _length, prot, flags, fd, map_offset);
+                if (_base == MAP_FAILED)
+                {
+                    _base = nullptr;
+                    throw_errno("mmap");
+                }
+
+                _data = (char*)_base + (offset-map_offset);
+
+                if (huge_pages) madvise(_base, _length, MADV_HUGEPAGE);
+            }
+
+            FileMapping(const FileMapping&) = delete;
+
+            FileMapping(FileMapping&& other)
+            {
+                *this = std::move(other);
+            }
+
+            FileMapping& operator=(const FileMapping&) = delete;
+
+            FileMapping& operator=(FileMapping&& other)
+            {
+                std::swap(_base, other._base);
+                std::swap(_length, other._length);
+                std::swap(_data, other._data);
+                std::swap(_size, other._size);
+                return *this;
+            }
+
+            ~FileMapping()
+            {
+                if (_base) munmap(_base, _length);
+            }
+
+            char* data() const { return _data; }
+
+            size_t size() const { return _size; }
+
+            void advise(MapAdvice advice) const
+            {
+                int flag = MADV_NORMAL;
+
+                switch (advice)
+                {
+                    case ADVISE_NORMAL:     flag = MADV_NORMAL;     break;
+                    case ADVISE_SEQUENTIAL: flag = MADV_SEQUENTIAL; break;
+                    case ADVISE_RANDOM:     flag = MADV_RANDOM;     break;
+                    case ADVISE_WILLNEED:   flag = MADV_WILLNEED;   break;
+                }
+
+                if (_base) madvise(_base, _length, flag);
+            }
+
+            void sync() const
+            {
+                if (_base && msync(_base, _length, MS_SYNC) != 0) throw_errno("msync");
+            }
+    };
+
+    class FileDescriptor
+    {
+        private:
+            int _fd;
+
+        public:
+            FileDescriptor(const std::string& path, int flags, mode_t mode = 0644)
+            : _fd(open(path.c_str(), flags, mode))
+            {
+                if (_fd < 0) throw_errno("open " + path);
+            }
+
+            FileDescriptor(const FileDescriptor&) = delete;
+
+            FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+            ~FileDescriptor()
+            {
+                close(_fd);
+            }
+
+            operator int() const { return _fd; }
+
+            off_t size() const
+            {
+                struct stat st;
+                if (fstat(_fd, &st) != 0) throw_errno("fstat");
+                return st.st_size;
+            }
+    };
+}
+
+/*
+ * A matrix whose elements live in a file, mapped directly into memory
+ * instead of being read into a freshly allocated buffer. The payload
+ * starts offset bytes into the file and is laid out with the given
+ * (non-negative) strides; by default it is column-major. The object is
+ * a view, so it can be used anywhere a Matrix<T> is, but it may not
+ * outlive itself through copies: views taken of it are invalidated when
+ * it is destroyed.
+ *
+ * MAPPED_READ_ONLY maps the file shared and read-only (writing faults),
+ * MAPPED_READ_WRITE writes changes through to the file, and
+ * MAPPED_PRIVATE gives a private, writable copy-on-write image.
+ */
+template <typename T>
+class MappedMatrix : public Matrix<T>
+{
+    public:
+        using typename Matrix<T>::type;
+        using typename Matrix<T>::real_type;
+
+    private:
+        detail::FileMapping _mapping;
+
+        static size_t extent(dim_t m, dim_t n, inc_t rs, inc_t cs)
+        {
+            if (m < 0 || n < 0 || rs < 0 || cs < 0)
+                throw std::logic_error("parameter must be non-negative");
+
+            if (m == 0 || n == 0) return 0;
+
+            return ((m-1)*rs + (n-1)*cs + 1)*sizeof(T);
+        }
+
+        void map(const std::string& path, int flags, bool create,
+                 dim_t m, dim_t n, inc_t rs, inc_t cs, off_t offset,
+                 MapAccess access, MapAdvice advice, bool huge_pages)
+        {
+            if (rs == 0 && cs == 0)
+            {
+                rs = 1;
+                cs = std::max<dim_t>(m, 1);
+            }
+
+            size_t bytes = extent(m, n, rs, cs);
+            detail::FileDescriptor fd(path, flags);
+
+            if (create && ftruncate(fd, offset+bytes) != 0)
+                detail::throw_errno("ftruncate " + path);
+
+            if (fd.size() < offset+(off_t)bytes)
+                throw std::runtime_error(path + " is too small for the requested matrix");
+
+            if (bytes > 0)
+            {
+                _mapping = detail::FileMapping(fd, offset, bytes, access, huge_pages);
+                _mapping.advise(advice);
+            }
+
+            Matrix<T>::reset(m, n, (T*)_mapping.data(), rs, cs);
+        }
+
+        MappedMatrix() {}
+
+    public:
+        MappedMatrix(const std::string& path, dim_t m, dim_t n,
+                     MapAccess access = MAPPED_READ_ONLY,
+                     MapAdvice advice = ADVISE_NORMAL,
+                     off_t offset = 0, bool huge_pages = false)
+        {
+            map(path, access == MAPPED_READ_ONLY ? O_RDONLY : O_RDWR, false,
+                m, n, 0, 0, offset, access, advice, huge_pages);
+        }
+
+        MappedMatrix(const std::string& path, dim_t m, dim_t n, inc_t rs, inc_t cs,
+                     MapAccess access = MAPPED_READ_ONLY,
+                     MapAdvice advice = ADVISE_NORMAL,
+                     off_t offset = 0, bool huge_pages = false)
+        {
+            map(path, access == MAPPED_READ_ONLY ? O_RDONLY : O_RDWR, false,
+                m, n, rs, cs, offset, access, advice, huge_pages);
+        }
+
+        MappedMatrix(const MappedMatrix&) = delete;
+
+        MappedMatrix(MappedMatrix&& other)
+        : Matrix<T>(std::move(other)), _mapping(std::move(other._mapping)) {}
+
+        MappedMatrix& operator=(const MappedMatrix&) = delete;
+
+        MappedMatrix& operator=(MappedMatrix&& other)
+        {
+            Matrix<T>::operator=(std::move(other));
+            _mapping = std::move(other._mapping);
+            return *this;
+        }
+
+        MappedMatrix& operator=(const type& val)
+        {
+            Matrix<T>::operator=(val);
+            return *this;
+        }
+
+        template <typename Expr, typename=detail::if_expression<Expr>>
+        MappedMatrix& operator=(const Expr& expr)
+        {
+            Matrix<T>::operator=(expr);
+            return *this;
+        }
+
+        /*
+         * Create (or truncate/extend) a file large enough for an m x n
+         * matrix at the given offset and map it read-write.
+         */
+        static MappedMatrix create(const std::string& path, dim_t m, dim_t n,
+                                   inc_t rs = 0, inc_t cs = 0, off_t offset = 0,
+                                   MapAdvice advice = ADVISE_NORMAL,
+                                   bool huge_pages = false)
+        {
+            MappedMatrix A;
+            A.map(path, O_RDWR|O_CREAT, true, m, n, rs, cs, offset,
+                  MAPPED_READ_WRITE, advice, huge_pages);
+            return A;
+        }
+
+        void advise(MapAdvice advice) const
+        {
+            _mapping.advise(advice);
+        }
+
+        /*
+         * Flush modifications of a MAPPED_READ_WRITE matrix to the file.
+         */
+        void sync() const
+        {
+            _mapping.sync();
+        }
+};
+
+}
+
+#endif
@@ -1,7 +1,12 @@
 #ifndef _BLISPP_MATRIX_HPP_
 #define _BLISPP_MATRIX_HPP_
 
+#include <algorithm>
+#include <limits>
+
+#include "blis++_counters.hpp"
 #include "blis++_memory.hpp"
+#include "blis++_recorder.hpp"
 
 namespace blis
 {
@@ -32,10 +37,66 @@ namespace transpose
     constexpr trans_op_t H(BLIS_CONJ_TRANSPOSE);
 }
 
+template <typename T, typename Allocator> class Matrix;
+template <typename T> class Scalar;
+
 namespace detail
 {
     template <typename T> using if_complex =
         typename std::enable_if<is_complex<T>::value>::type;
+
+    /*
+     * Tag base of all lazy matrix expressions (products, sums, scaled and
+     * transposed terms). Expressions only record views of their operands;
+     * the work happens when one is assigned to a Matrix.
+     */
+    struct ExpressionBase {};
+
+    template <typename T> struct is_expression
+    {
+        static const bool value = std::is_base_of<ExpressionBase,T>::value;
+    };
+
+    template <typename T, typename Allocator>
+    std::true_type is_matrix_helper(const Matrix<T,Allocator>*);
+    std::false_type is_matrix_helper(...);
+
+    template <typename T>
+    std::true_type is_scalar_object_helper(const Scalar<T>*);
+    std::false_type is_scalar_object_helper(...);
+
+    template <typename T> struct is_scalar_object
+    {
+        static const bool value = decltype(is_scalar_object_helper((T*)nullptr))::value;
+    };
+
+    template <typename T> struct is_matrix
+    {
+        static const bool value = decltype(is_matrix_helper((T*)nullptr))::value &&
+                                  !is_scalar_object<T>::value;
+    };
+
+    template <typename T> struct is_operand
+    {
+        static const bool value = is_expression<T>::value || is_matrix<T>::value;
+    };
+
+    template <typename T> struct is_scalar_operand
+    {
+        static const bool value = std::is_arithmetic<T>::value ||
+                                  is_complex<T>::value ||
+                                  is_scalar_object<T>::value;
+    };
+
+    template <typename T> using if_expression =
+        typename std::enable_if<is_expression<T>::value>::type;
+
+    template <typename T> using if_operand =
+        typename std::enable_if<is_operand<T>::value>::type;
+
+    template <typename T, typename Allocator, typename Expr>
+    void assign(Matrix<T,Allocator>& C, const Expr& expr,
+                const T& beta, const T& scale);
 }
 
 template <typename T, typename Allocator=std::allocator<T>>
@@ -60,7 +121,7 @@ class Matrix : private obj_t
         {
             _is_view = other._is_view;
 
-            if (_is_view)
+            if (_is_view || detail::share(_mem, other._mem))
             {
                 memcpy(static_cast<      obj_t*>(this),
                        static_cast<const obj_t*>(&other), sizeof(obj_t));
@@ -143,6 +204,17 @@ class Matrix : private obj_t
             _mem.reset();
         }
 
+        /*
+         * Called before any mutable access; a copy-on-write matrix whose
+         * buffer is still shared gets its own copy here (the contents are
+         * only copied if they are going to be read).
+         */
+        void write_access(bool preserve = true)
+        {
+            type* p = (type*)bli_obj_buffer(*this);
+            bli_obj_set_buffer(detail::detach(_mem, p, preserve), *this);
+        }
+
         Matrix(double r, double i)
         {
             create(r, i);
@@ -208,11 +280,37 @@ class Matrix : private obj_t
 
         Matrix& operator=(const type& val)
         {
+            write_access(false);
             Matrix s(real(val), imag(val));
             bli_setm(s, this);
             return *this;
         }
 
+        /*
+         * Evaluate an expression such as alpha*A*B + beta*C directly into
+         * this matrix. See detail::assign for the mapping onto BLIS calls.
+         */
+        template <typename Expr, typename=detail::if_expression<Expr>>
+        Matrix& operator=(const Expr& expr)
+        {
+            detail::assign(*this, expr, type(0), type(1));
+            return *this;
+        }
+
+        template <typename Expr, typename=detail::if_operand<Expr>>
+        Matrix& operator+=(const Expr& expr)
+        {
+            detail::assign(*this, expr, type(1), type(1));
+            return *this;
+        }
+
+        template <typename Expr, typename=detail::if_operand<Expr>>
+        Matrix& operator-=(const Expr& expr)
+        {
+            detail::assign(*this, expr, type(1), type(-1));
+            return *this;
+        }
+
         void reset()
         {
             free();
@@ -388,7 +486,7 @@ class Matrix : private obj_t
 
         void shift_down(dim_t m)
         {
-            bli_obj_set_buffer(data()+m*row_stride(), *this);
+            bli_obj_set_buffer((type*)bli_obj_buffer(*this)+m*row_stride(), *this);
         }
 
         void shift_up(dim_t m)
@@ -398,7 +496,7 @@ class Matrix : private obj_t
 
         void shift_right(dim_t n)
         {
-            bli_obj_set_buffer(data()+n*col_stride(), *this);
+            bli_obj_set_buffer((type*)bli_obj_buffer(*this)+n*col_stride(), *this);
         }
 
         void shift_left(dim_t n)
@@ -428,6 +526,7 @@ class Matrix : private obj_t
 
         type* data()
         {
+            write_access();
             return (type*)bli_obj_buffer(*this);
         }
 
@@ -438,6 +537,7 @@ class Matrix : private obj_t
 
         operator obj_t*()
         {
+            write_access();
             return this;
         }
 
@@ -477,6 +577,655 @@ class Matrix : private obj_t
         }
 };
 
+namespace detail
+{
+    template <typename T>
+    class ScalarConstant : private obj_t
+    {
+        public:
+            explicit ScalarConstant(const T& val)
+            {
+                bli_obj_scalar_init_detached(datatype<T>::value, this);
+                bli_setsc(real(val), imag(val), this);
+            }
+
+            ScalarConstant(const ScalarConstant&) = delete;
+
+            ScalarConstant& operator=(const ScalarConstant&) = delete;
+
+            operator obj_t*() { return this; }
+    };
+
+    inline trans_op_t compose(trans_op_t a, trans_op_t b)
+    {
+        return trans_op_t((trans_t)(a.info ^ b.info));
+    }
+
+    inline void apply(trans_op_t trans, obj_t& obj)
+    {
+        if (trans.transpose()) bli_obj_toggle_trans(obj);
+        if (trans.conjugate()) bli_obj_toggle_conj(obj);
+    }
+
+    inline dim_t length(const obj_t& obj)
+    {
+        return bli_obj_length_after_trans(obj);
+    }
+
+    inline dim_t width(const obj_t& obj)
+    {
+        return bli_obj_width_after_trans(obj);
+    }
+
+    inline bool same_view(const obj_t& a, const obj_t& b)
+    {
+        return bli_obj_buffer(a) == bli_obj_buffer(b) &&
+               bli_obj_length(a) == bli_obj_length(b) &&
+               bli_obj_width(a) == bli_obj_width(b) &&
+               bli_obj_row_stride(a) == bli_obj_row_stride(b) &&
+               bli_obj_col_stride(a) == bli_obj_col_stride(b) &&
+               bli_obj_conjtrans_status(a) == bli_obj_conjtrans_status(b);
+    }
+
+    /*
+     * Conservative test for whether two views may touch the same memory,
+     * based on the range of addresses each one spans.
+     */
+    template <typename T>
+    bool overlaps(const obj_t& a, const obj_t& b)
+    {
+        auto extent = [](const obj_t& x, const char*& lo, const char*& hi)
+        {
+            dim_t m = bli_obj_length(x);
+            dim_t n = bli_obj_width(x);
+            inc_t rs = bli_obj_row_stride(x);
+            inc_t cs = bli_obj_col_stride(x);
+            const T* p = (const T*)bli_obj_buffer(x);
+            const T* l = p + std::min<inc_t>(0, (m-1)*rs) + std::min<inc_t>(0, (n-1)*cs);
+            const T* h = p + std::max<inc_t>(0, (m-1)*rs) + std::max<inc_t>(0, (n-1)*cs) + 1;
+            lo = (const char*)l;
+            hi = (const char*)h;
+            return m > 0 && n > 0;
+        };
+
+        const char *alo, *ahi, *blo, *bhi;
+        if (!extent(a, alo, ahi) || !extent(b, blo, bhi)) return false;
+        return alo < bhi && blo < ahi;
+    }
+
+    /*
+     * One term of a flattened expression: alpha times a product of
+     * nfactors views (each carrying its own trans/conj bits).
+     */
+    template <typename T, int MaxFactors>
+    struct Monomial
+    {
+        T alpha;
+        int nfactors;
+        obj_t factors[MaxFactors];
+    };
+
+    template <typename T>
+    class MatrixTerm : public ExpressionBase
+    {
+        public:
+            typedef T type;
+            enum { nterms = 1, nfactors = 1 };
+
+        private:
+            obj_t _obj;
+
+        public:
+            template <typename Allocator>
+            explicit MatrixTerm(const Matrix<T,Allocator>& A)
+            : _obj(*static_cast<const obj_t*>(A)) {}
+
+            dim_t length() const { return detail::length(_obj); }
+
+            dim_t width() const { return detail::width(_obj); }
+
+            template <int N>
+            void flatten(const T& alpha, trans_op_t trans, Monomial<T,N>* terms) const
+            {
+                terms[0].alpha = alpha;
+                terms[0].nfactors = 1;
+                terms[0].factors[0] = _obj;
+                apply(trans, terms[0].factors[0]);
+            }
+    };
+
+    template <typename Expr>
+    class ScaledExpression : public ExpressionBase
+    {
+        public:
+            typedef typename Expr::type type;
+            enum { nterms = Expr::nterms, nfactors = Expr::nfactors };
+
+        private:
+            type _alpha;
+            Expr _expr;
+
+        public:
+            ScaledExpression(const type& alpha, const Expr& expr)
+            : _alpha(alpha), _expr(expr) {}
+
+            dim_t length() const { return _expr.length(); }
+
+            dim_t width() const { return _expr.width(); }
+
+            template <int N>
+            void flatten(const type& alpha, trans_op_t trans, Monomial<type,N>* terms) const
+            {
+                _expr.flatten(alpha*(trans.conjugate() ? conj(_alpha) : _alpha), trans, terms);
+            }
+    };
+
+    template <typename Expr>
+    class TransposedExpression : public ExpressionBase
+    {
+        public:
+            typedef typename Expr::type type;
+            enum { nterms = Expr::nterms, nfactors = Expr::nfactors };
+
+        private:
+            trans_op_t _trans;
+            Expr _expr;
+
+        public:
+            TransposedExpression(trans_op_t trans, const Expr& expr)
+            : _trans(trans), _expr(expr) {}
+
+            dim_t length() const { return _trans.transpose() ? _expr.width() : _expr.length(); }
+
+            dim_t width() const { return _trans.transpose() ? _expr.length() : _expr.width(); }
+
+            template <int N>
+            void flatten(const type& alpha, trans_op_t trans, Monomial<type,N>* terms) const
+            {
+                _expr.flatten(alpha, compose(_trans, trans), terms);
+            }
+    };
+
+    template <typename Left, typename Right>
+    class ProductExpression : public ExpressionBase
+    {
+        static_assert(std::is_same<typename Left::type, typename Right::type>::value,
+                      "operands must have the same datatype");
+
+        public:
+            typedef typename Left::type type;
+            enum { nterms = Left::nterms*Right::nterms,
+                   nfactors = Left::nfactors+Right::nfactors };
+
+        private:
+            Left _left;
+            Right _right;
+
+        public:
+            ProductExpression(const Left& left, const Right& right)
+            : _left(left), _right(right)
+            {
+                if (left.width() != right.length())
+                    throw std::logic_error("inner dimensions must match");
+            }
+
+            dim_t length() const { return _left.length(); }
+
+            dim_t width() const { return _right.width(); }
+
+            /*
+             * Products of sums are distributed, (A+B)*C -> A*C + B*C, so
+             * that every term maps onto a single gemm/gemv.
+             */
+            template <int N>
+            void flatten(const type& alpha, trans_op_t trans, Monomial<type,N>* terms) const
+            {
+                Monomial<type,N> left[Left::nterms];
+                Monomial<type,N> right[Right::nterms];
+
+                _left.flatten(alpha, trans, left);
+                _right.flatten(type(1), trans, right);
+
+                for (int i = 0;i < Left::nterms;i++)
+                {
+                    for (int j = 0;j < Right::nterms;j++)
+                    {
+                        const Monomial<type,N>& first = trans.transpose() ? right[j] : left[i];
+                        const Monomial<type,N>& second = trans.transpose() ? left[i] : right[j];
+                        Monomial<type,N>& term = terms[i*Right::nterms+j];
+
+                        term.alpha = left[i].alpha*right[j].alpha;
+                        term.nfactors = first.nfactors+second.nfactors;
+                        std::copy(first.factors, first.factors+first.nfactors, term.factors);
+                        std::copy(second.factors, second.factors+second.nfactors,
+                                  term.factors+first.nfactors);
+                    }
+                }
+            }
+    };
+
+    template <typename Left, typename Right>
+    class SumExpression : public ExpressionBase
+    {
+        static_assert(std::is_same<typename Left::type, typename Right::type>::value,
+                      "operands must have the same datatype");
+
+        public:
+            typedef typename Left::type type;
+            enum { nterms = Left::nterms+Right::nterms,
+                   nfactors = (int)Left::nfactors > (int)Right::nfactors ?
+                              (int)Left::nfactors : (int)Right::nfactors };
+
+        private:
+            Left _left;
+            Right _right;
+
+        public:
+            SumExpression(const Left& left, const Right& right)
+            : _left(left), _right(right)
+            {
+                if (left.length() != right.length() ||
+                    left.width() != right.width())
+                    throw std::logic_error("dimensions must match");
+            }
+
+            dim_t length() const { return _left.length(); }
+
+            dim_t width() const { return _left.width(); }
+
+            template <int N>
+            void flatten(const type& alpha, trans_op_t trans, Monomial<type,N>* terms) const
+            {
+                _left.flatten(alpha, trans, terms);
+                _right.flatten(alpha, trans, terms+Left::nterms);
+            }
+    };
+
+    template <typename T, typename Allocator>
+    MatrixTerm<T> as_expression(const Matrix<T,Allocator>& A)
+    {
+        return MatrixTerm<T>(A);
+    }
+
+    template <typename Expr, typename=if_expression<Expr>>
+    const Expr& as_expression(const Expr& expr)
+    {
+        return expr;
+    }
+
+    template <typename Expr> using expression_t =
+        typename std::decay<decltype(as_expression(std::declval<const Expr&>()))>::type;
+
+    template <typename T, typename U>
+    T scalar_value(const Scalar<U>& s)
+    {
+        return T(static_cast<const U&>(s));
+    }
+
+    template <typename T, typename U>
+    typename std::enable_if<!is_scalar_object<U>::value,T>::type
+    scalar_value(const U& s)
+    {
+        return T(s);
+    }
+
+    template <typename Left, typename Right, typename Result>
+    using if_operands = typename std::enable_if<is_operand<Left>::value &&
+                                                is_operand<Right>::value,Result>::type;
+
+    template <typename S, typename Expr, typename Result>
+    using if_scaled = typename std::enable_if<is_scalar_operand<S>::value &&
+                                              is_operand<Expr>::value,Result>::type;
+
+    template <typename T>
+    void assign_term(Monomial<T,1>& term, obj_t& C, const T& beta)
+    {
+        ScalarConstant<T> alpha(term.alpha);
+        obj_t& A = term.factors[0];
+
+        ShapeRecorder::Scope recording(beta == T(0) ? "copym" : "axpym", datatype<T>::value);
+        if (recording.active())
+        {
+            recording.variant(std::string(1, trans_char((trans_t)bli_obj_conjtrans_status(A))));
+            recording.operand_a(A);
+            recording.operand_c(C);
+            recording.shape(length(C), width(C), 0);
+        }
+
+        if (beta == T(0))
+        {
+            bli_copym(&A, &C);
+            if (term.alpha != T(1)) bli_scalm(alpha, &C);
+        }
+        else
+        {
+            if (beta != T(1))
+            {
+                ScalarConstant<T> b(beta);
+                bli_scalm(b, &C);
+            }
+            bli_axpym(alpha, &A, &C);
+        }
+    }
+
+    inline void record_gemv(ShapeRecorder::Scope& recording, const obj_t& A,
+                            const obj_t& x, const obj_t& y)
+    {
+        char variant[] = {trans_char((trans_t)bli_obj_conjtrans_status(A)),
+                          bli_obj_has_conj(x) ? 'c' : 'n', 0};
+        recording.variant(variant);
+        recording.operand_a(A);
+        recording.operand_b(x);
+        recording.operand_c(y);
+        recording.shape(length(A), width(A), 0);
+    }
+
+    /*
+     * C = alpha*A*B + beta*C as a single gemv when either side of the
+     * product is a vector, and otherwise as a single gemm.
+     */
+    template <typename T>
+    void assign_gemm(const T& alpha_, obj_t& A, obj_t& B, const T& beta_, obj_t& C)
+    {
+        ScalarConstant<T> alpha(alpha_), beta(beta_);
+
+        bool gemv = width(B) == 1 && width(C) == 1;
+        bool gevm = !gemv && length(A) == 1 && length(C) == 1;
+
+        ShapeRecorder::Scope recording(gemv || gevm ? "gemv" : "gemm", datatype<T>::value);
+
+        if (gemv)
+        {
+            if (recording.active()) record_gemv(recording, A, B, C);
+            bli_gemv(alpha, &A, &B, beta, &C);
+        }
+        else if (gevm)
+        {
+            obj_t At = A, Bt = B, Ct = C;
+            bli_obj_toggle_trans(At);
+            bli_obj_toggle_trans(Bt);
+            bli_obj_toggle_trans(Ct);
+            if (recording.active()) record_gemv(recording, Bt, At, Ct);
+            bli_gemv(alpha, &Bt, &At, beta, &Ct);
+        }
+        else
+        {
+            if (recording.active())
+            {
+                char variant[] = {trans_char((trans_t)bli_obj_conjtrans_status(A)),
+                                  trans_char((trans_t)bli_obj_conjtrans_status(B)), 0};
+                recording.variant(variant);
+                recording.operand_a(A);
+                recording.operand_b(B);
+                recording.operand_c(C);
+                recording.shape(length(C), width(C), width(A));
+            }
+            bli_gemm(alpha, &A, &B, beta, &C);
+        }
+    }
+
+    /*
+     * Products of three or more factors are parenthesized by the classic
+     * O(n^3) matrix-chain dynamic program using the actual operand
+     * dimensions. Intermediates are carved out of the calling thread's
+     * current MatrixArena and the outermost product is written directly
+     * into C.
+     */
+    template <typename T, int N>
+    class ChainProduct
+    {
+        private:
+            obj_t* _factors;
+            int _nfactors;
+            dim_t _dims[N+1];
+            int _split[N][N];
+
+            void evaluate(int first, int last, obj_t& result, MatrixArena& arena)
+            {
+                result = _factors[first];
+                if (first == last) return;
+
+                T* p = arena.allocate<T>(_dims[first]*_dims[last+1]);
+                bli_obj_create_with_attached_buffer(datatype<T>::value,
+                                                    _dims[first], _dims[last+1], p,
+                                                    1, std::max<dim_t>(_dims[first], 1),
+                                                    &result);
+
+                evaluate(first, last, T(1), T(0), result, arena);
+            }
+
+            void evaluate(int first, int last, const T& alpha, const T& beta,
+                          obj_t& C, MatrixArena& arena)
+            {
+                int split = _split[first][last];
+
+                obj_t left, right;
+                evaluate(first, split, left, arena);
+                evaluate(split+1, last, right, arena);
+
+                assign_gemm(alpha, left, right, beta, C);
+            }
+
+        public:
+            ChainProduct(obj_t* factors, int nfactors)
+            : _factors(factors), _nfactors(nfactors)
+            {
+                for (int i = 0;i < nfactors;i++)
+                    _dims[i] = length(factors[i]);
+                _dims[nfactors] = width(factors[nfactors-1]);
+
+                double cost[N][N];
+
+                for (int i = 0;i < nfactors;i++) cost[i][i] = 0;
+
+                for (int len = 1;len < nfactors;len++)
+                {
+                    for (int i = 0;i+len < nfactors;i++)
+                    {
+                        int j = i+len;
+                        cost[i][j] = std::numeric_limits<double>::max();
+
+                        for (int k = i;k < j;k++)
+                        {
+                            double c = cost[i][k] + cost[k+1][j] +
+                                (double)_dims[i]*_dims[k+1]*_dims[j+1];
+
+                            if (c < cost[i][j])
+                            {
+                                cost[i][j] = c;
+                                _split[i][j] = k;
+                            }
+                        }
+                    }
+                }
+            }
+
+            void evaluate(const T& alpha, const T& beta, obj_t& C)
+            {
+                ArenaScope scope;
+                evaluate(0, _nfactors-1, alpha, beta, C, scope.arena());
+            }
+    };
+
+    template <typename T, int N>
+    void assign_chain(Monomial<T,N>& term, obj_t& C, const T& beta)
+    {
+        ChainProduct<T,N>(term.factors, term.nfactors).evaluate(term.alpha, beta, C);
+    }
+
+    template <typename T, int N>
+    void assign_terms(Monomial<T,N>* terms, int nterms, obj_t& C, T beta)
+    {
+        if (nterms == 0)
+        {
+            if (beta == T(0))
+            {
+                ScalarConstant<T> zero(T(0));
+                bli_setm(zero, &C);
+            }
+            else if (beta != T(1))
+            {
+                ScalarConstant<T> b(beta);
+                bli_scalm(b, &C);
+            }
+            return;
+        }
+
+        for (int i = 0;i < nterms;i++)
+        {
+            Monomial<T,N>& term = terms[i];
+
+            if (term.nfactors == 1)
+            {
+                OperationCounters::Scope counting("axpym");
+
+                Monomial<T,1> single;
+                single.alpha = term.alpha;
+                single.nfactors = 1;
+                single.factors[0] = term.factors[0];
+                assign_term(single, C, beta);
+            }
+            else if (term.nfactors == 2)
+            {
+                OperationCounters::Scope counting("gemm");
+                assign_gemm(term.alpha, term.factors[0], term.factors[1], beta, C);
+            }
+            else
+            {
+                OperationCounters::Scope counting("gemm_chain");
+                assign_chain(term, C, beta);
+            }
+
+            beta = T(1);
+        }
+    }
+
+    /*
+     * C = scale*expr + beta*C.
+     *
+     * The expression is flattened into a sum of scaled products. Terms
+     * which are C itself are folded into beta, single matrices become
+     * copym/axpym, and products become gemm (or gemv). No temporaries are
+     * created unless an operand overlaps C, in which case the result is
+     * formed out of place first. An empty (default-constructed) C is sized
+     * to fit the expression.
+     */
+    template <typename T, typename Allocator, typename Expr>
+    void assign(Matrix<T,Allocator>& C, const Expr& expr_,
+                const T& beta_, const T& scale)
+    {
+        typedef expression_t<Expr> E;
+        static_assert(std::is_same<T, typename E::type>::value,
+                      "operands must have the same datatype");
+
+        const E& expr = as_expression(expr_);
+
+        if (C.data() == nullptr && C.length() == 0 && C.width() == 0)
+            C.reset(expr.length(), expr.width());
+
+        obj_t& c = *static_cast<obj_t*>(C);
+
+        if (length(c) != expr.length() || width(c) != expr.width())
+            throw std::logic_error("dimensions must match");
+
+        Monomial<T,E::nfactors> terms[E::nterms];
+        expr.flatten(scale, trans_op_t(), terms);
+
+        T beta = beta_;
+        bool aliased = false;
+        int nterms = 0;
+
+        for (int i = 0;i < E::nterms;i++)
+        {
+            if (terms[i].nfactors == 1 && same_view(terms[i].factors[0], c))
+            {
+                beta += terms[i].alpha;
+                continue;
+            }
+
+            for (int j = 0;j < terms[i].nfactors;j++)
+                aliased = aliased || overlaps<T>(terms[i].factors[j], c);
+
+            if (nterms != i) terms[nterms] = terms[i];
+            nterms++;
+        }
+
+        if (!aliased)
+        {
+            assign_terms(terms, nterms, c, beta);
+        }
+        else
+        {
+            Matrix<T> tmp(length(c), width(c));
+            assign_terms(terms, nterms, *static_cast<obj_t*>(tmp), T(0));
+
+            Monomial<T,1> result;
+            result.alpha = T(1);
+            result.nfactors = 1;
+            result.factors[0] = *static_cast<obj_t*>(tmp);
+            assign_term(result, c, beta);
+        }
+    }
+}
+
+template <typename Left, typename Right>
+detail::if_operands<Left,Right,
+    detail::ProductExpression<detail::expression_t<Left>,detail::expression_t<Right>>>
+operator*(const Left& left, const Right& right)
+{
+    return {detail::as_expression(left), detail::as_expression(right)};
+}
+
+template <typename S, typename Expr>
+detail::if_scaled<S,Expr,detail::ScaledExpression<detail::expression_t<Expr>>>
+operator*(const S& alpha, const Expr& expr)
+{
+    typedef typename detail::expression_t<Expr>::type T;
+    return {detail::scalar_value<T>(alpha), detail::as_expression(expr)};
+}
+
+template <typename Expr, typename S>
+detail::if_scaled<S,Expr,detail::ScaledExpression<detail::expression_t<Expr>>>
+operator*(const Expr& expr, const S& alpha)
+{
+    typedef typename detail::expression_t<Expr>::type T;
+    return {detail::scalar_value<T>(alpha), detail::as_expression(expr)};
+}
+
+template <typename Left, typename Right>
+detail::if_operands<Left,Right,
+    detail::SumExpression<detail::expression_t<Left>,detail::expression_t<Right>>>
+operator+(const Left& left, const Right& right)
+{
+    return {detail::as_expression(left), detail::as_expression(right)};
+}
+
+template <typename Left, typename Right>
+detail::if_operands<Left,Right,
+    detail::SumExpression<detail::expression_t<Left>,
+                          detail::ScaledExpression<detail::expression_t<Right>>>>
+operator-(const Left& left, const Right& right)
+{
+    typedef typename detail::expression_t<Right>::type T;
+    return {detail::as_expression(left), {T(-1), detail::as_expression(right)}};
+}
+
+template <typename Expr>
+detail::if_operands<Expr,Expr,detail::ScaledExpression<detail::expression_t<Expr>>>
+operator-(const Expr& expr)
+{
+    typedef typename detail::expression_t<Expr>::type T;
+    return {T(-1), detail::as_expression(expr)};
+}
+
+template <typename Expr>
+typename std::enable_if<detail::is_expression<Expr>::value,
+                        detail::TransposedExpression<Expr>>::type
+operator^(const Expr& expr, trans_op_t trans)
+{
+    return {trans, expr};
+}
+
 }
 
 #endif
@@ -1,11 +1,26 @@
 #ifndef _BLISPP_MEMORY_HPP_
 #define _BLISPP_MEMORY_HPP_
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
 #include <stdexcept>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include "blis/blis.h"
 
+#include "blis++_thread.hpp"
+
+#if defined(__linux__)
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #if BLISPP_HAVE_MEMKIND
 #include "memkind.h"
 #endif
@@ -82,49 +97,506 @@ class Memory : private Allocator
         operator const type*() const { return _ptr; }
 };
 
-template <typename T>
-class PooledMemory : private mem_t
+/*
+ * Allocator policy which opts a Matrix into copy-on-write semantics:
+ * copies of an owned Matrix<T,CopyOnWrite<Allocator>> share one reference
+ * counted buffer, and the actual copy is only made when one of them is
+ * accessed mutably. Converting to a non-const obj_t*, which is how
+ * operands are handed to BLIS directly (e.g. C in bli_gemm(alpha, A, B,
+ * beta, C)), counts as mutable access; expressions such as C = A*B and
+ * gemm_batch read their inputs through the const conversion, so those
+ * keep sharing.
+ */
+template <typename Allocator>
+struct CopyOnWrite : Allocator
+{
+    typedef typename Allocator::value_type value_type;
+
+    CopyOnWrite() {}
+
+    CopyOnWrite(const Allocator& alloc) : Allocator(alloc) {}
+};
+
+template <typename T, typename Allocator>
+class Memory<T,CopyOnWrite<Allocator>> : private Allocator
 {
     public:
         typedef T type;
 
     private:
-        packbuf_t _packbuf;
+        struct Block
+        {
+            std::atomic<long> refs;
+            type* ptr;
+            siz_t size;
+
+            Block(type* ptr, siz_t size) : refs(1), ptr(ptr), size(size) {}
+        };
+
+        Block* _block = nullptr;
+
+        void release()
+        {
+            if (_block && --_block->refs == 0)
+            {
+                this->deallocate(_block->ptr, _block->size);
+                delete _block;
+            }
+            _block = nullptr;
+        }
+
+        Block* allocate_block(siz_t size)
+        {
+            type* ptr = this->allocate(size);
+
+            try
+            {
+                return new Block(ptr, size);
+            }
+            catch (...)
+            {
+                this->deallocate(ptr, size);
+                throw;
+            }
+        }
 
-        void init()
+    public:
+        Memory(const Memory& other)
+        : Allocator(other), _block(other._block)
+        {
+            if (_block) _block->refs++;
+        }
+
+        Memory(Memory&& other)
+        : Allocator(other), _block(other._block)
+        {
+            other._block = nullptr;
+        }
+
+        Memory& operator=(const Memory& other)
+        {
+            if (other._block) other._block->refs++;
+            release();
+            _block = other._block;
+            return *this;
+        }
+
+        Memory& operator=(Memory&& other)
         {
-            memset(static_cast<mem_t*>(this), 0, sizeof(mem_t));
+            std::swap(_block, other._block);
+            return *this;
         }
 
+        explicit Memory(siz_t size, CopyOnWrite<Allocator> alloc = CopyOnWrite<Allocator>())
+        : Allocator(alloc)
+        {
+            reset(size);
+        }
+
+        explicit Memory(CopyOnWrite<Allocator> alloc = CopyOnWrite<Allocator>())
+        : Allocator(alloc) {}
+
+        ~Memory()
+        {
+            release();
+        }
+
+        type* reset(siz_t size = 0)
+        {
+            release();
+            if (size > 0) _block = allocate_block(size);
+            return *this;
+        }
+
+        bool shared() const
+        {
+            return _block && _block->refs > 1;
+        }
+
+        /*
+         * Make this the sole owner of its buffer, copying the contents
+         * first if requested. Returns where the element p of the shared
+         * buffer lives afterwards.
+         */
+        type* detach(type* p, bool copy = true)
+        {
+            if (!shared()) return p;
+
+            Block* block = allocate_block(_block->size);
+            if (copy) std::copy(_block->ptr, _block->ptr+_block->size, block->ptr);
+
+            type* old = _block->ptr;
+            release();
+            _block = block;
+
+            return block->ptr + (p - old);
+        }
+
+        operator type*() { return _block ? _block->ptr : nullptr; }
+
+        operator const type*() const { return _block ? _block->ptr : nullptr; }
+};
+
+namespace detail
+{
+    template <typename T, typename Allocator>
+    bool share(Memory<T,Allocator>&, const Memory<T,Allocator>&)
+    {
+        return false;
+    }
+
+    template <typename T, typename Allocator>
+    bool share(Memory<T,CopyOnWrite<Allocator>>& mem,
+               const Memory<T,CopyOnWrite<Allocator>>& other)
+    {
+        mem = other;
+        return true;
+    }
+
+    template <typename T, typename Allocator>
+    T* detach(Memory<T,Allocator>&, T* p, bool)
+    {
+        return p;
+    }
+
+    template <typename T, typename Allocator>
+    T* detach(Memory<T,CopyOnWrite<Allocator>>& mem, T* p, bool copy)
+    {
+        return mem.detach(p, copy);
+    }
+}
+
+namespace detail
+{
+    /*
+     * Size-class pool for packing and workspace buffers.
+     *
+     * Requests are rounded up to one of four classes per power of two
+     * (4K, 5K, 6K, 7K, 8K, 10K, ...), wasting at most 25%. Every thread
+     * has its own cache of free buffers per class, so the common
+     * acquire/release cycle on one thread takes no lock. A buffer released
+     * by a different thread is pushed onto a lock-free stack of the thread
+     * which acquired it, and picked up by that thread on its next miss.
+     * Only overflow from, and refills of, the thread caches go through
+     * the shared per-class lists, each guarded by its own mutex.
+     */
+    class MemoryPool
+    {
+        public:
+            enum
+            {
+                MIN_CLASS_SHIFT = 12,
+                MAX_CLASS_SHIFT = 34,
+                NUM_CLASSES = 4*(MAX_CLASS_SHIFT-MIN_CLASS_SHIFT)+1,
+                ALIGNMENT = BLIS_PAGE_SIZE
+            };
+
+            struct ThreadCache;
+
+            struct Buffer
+            {
+                void* ptr = nullptr;
+                size_t size = 0;
+                int size_class = -1;
+                ThreadCache* owner = nullptr;
+            };
+
+            struct FreeNode
+            {
+                FreeNode* next;
+            };
+
+            struct ThreadCache
+            {
+                std::atomic<bool> in_use;
+                std::vector<void*> local[NUM_CLASSES];
+                std::atomic<FreeNode*> remote[NUM_CLASSES];
+
+                ThreadCache() : in_use(true)
+                {
+                    for (auto& head : remote) head = nullptr;
+                }
+            };
+
+        private:
+            struct SharedList
+            {
+                std::mutex lock;
+                std::vector<void*> buffers;
+            };
+
+            SharedList _shared[NUM_CLASSES];
+            std::mutex _registry_lock;
+            std::vector<std::unique_ptr<ThreadCache>> _caches;
+
+            struct CacheHolder
+            {
+                ThreadCache* cache = nullptr;
+
+                ~CacheHolder()
+                {
+                    if (cache) instance().retire(cache);
+                }
+            };
+
+            static size_t local_limit(int size_class)
+            {
+                return class_size(size_class) <= (1ul << 20) ? 8 : 2;
+            }
+
+            static void* allocate(size_t size)
+            {
+                void* ptr;
+                if (posix_memalign(&ptr, ALIGNMENT, size) != 0) throw std::bad_alloc();
+                return ptr;
+            }
+
+            ThreadCache& adopt()
+            {
+                std::lock_guard<std::mutex> guard(_registry_lock);
+
+                for (auto& cache : _caches)
+                {
+                    bool expected = false;
+                    if (cache->in_use.compare_exchange_strong(expected, true))
+                        return *cache;
+                }
+
+                _caches.emplace_back(new ThreadCache);
+                return *_caches.back();
+            }
+
+            void retire(ThreadCache* cache)
+            {
+                for (int c = 0;c < NUM_CLASSES;c++)
+                {
+                    drain_remote(*cache, c);
+
+                    std::lock_guard<std::mutex> guard(_shared[c].lock);
+                    _shared[c].buffers.insert(_shared[c].buffers.end(),
+                                              cache->local[c].begin(),
+                                              cache->local[c].end());
+                    cache->local[c].clear();
+                }
+
+                cache->in_use = false;
+            }
+
+            static void drain_remote(ThreadCache& cache, int size_class)
+            {
+                FreeNode* node = cache.remote[size_class].exchange(nullptr);
+
+                while (node)
+                {
+                    FreeNode* next = node->next;
+                    cache.local[size_class].push_back(node);
+                    node = next;
+                }
+            }
+
+        public:
+            MemoryPool() {}
+
+            MemoryPool(const MemoryPool&) = delete;
+
+            MemoryPool& operator=(const MemoryPool&) = delete;
+
+            ~MemoryPool()
+            {
+                trim();
+            }
+
+            static int size_class(size_t size)
+            {
+                if (size <= (1ul << MIN_CLASS_SHIFT)) return 0;
+
+                int shift = 0;
+                while ((size-1) >> (shift+1)) shift++;
+
+                if (shift >= MAX_CLASS_SHIFT) return -1;
+
+                size_t base = 1ul << shift;
+                int sub = (4*(size-base) + base-1)/base;
+
+                return 4*(shift-MIN_CLASS_SHIFT) + sub;
+            }
+
+            static size_t class_size(int size_class)
+            {
+                return (1ul << (MIN_CLASS_SHIFT + size_class/4))/4 * (4 + size_class%4);
+            }
+
+            ThreadCache& thread_cache()
+            {
+                static thread_local CacheHolder holder;
+                if (!holder.cache) holder.cache = &adopt();
+                return *holder.cache;
+            }
+
+            Buffer acquire(size_t size)
+            {
+                Buffer buf;
+                buf.size_class = size_class(size);
+
+                if (buf.size_class < 0)
+                {
+                    buf.size = size;
+                    buf.ptr = allocate(size);
+                    return buf;
+                }
+
+                buf.size = class_size(buf.size_class);
+
+                ThreadCache& cache = thread_cache();
+                std::vector<void*>& local = cache.local[buf.size_class];
+                buf.owner = &cache;
+
+                if (local.empty()) drain_remote(cache, buf.size_class);
+
+                if (local.empty())
+                {
+                    SharedList& shared = _shared[buf.size_class];
+                    std::lock_guard<std::mutex> guard(shared.lock);
+                    size_t n = std::min(shared.buffers.size(), (local_limit(buf.size_class)+1)/2);
+                    local.insert(local.end(), shared.buffers.end()-n, shared.buffers.end());
+                    shared.buffers.resize(shared.buffers.size()-n);
+                }
+
+                if (local.empty())
+                {
+                    buf.ptr = allocate(buf.size);
+                }
+                else
+                {
+                    buf.ptr = local.back();
+                    local.pop_back();
+                }
+
+                return buf;
+            }
+
+            void release(Buffer& buf)
+            {
+                if (!buf.ptr) return;
+
+                if (buf.size_class < 0)
+                {
+                    ::free(buf.ptr);
+                }
+                else if (buf.owner == &thread_cache())
+                {
+                    std::vector<void*>& local = buf.owner->local[buf.size_class];
+                    local.push_back(buf.ptr);
+
+                    if (local.size() > local_limit(buf.size_class))
+                    {
+                        size_t n = local.size()/2;
+                        SharedList& shared = _shared[buf.size_class];
+                        std::lock_guard<std::mutex> guard(shared.lock);
+                        shared.buffers.insert(shared.buffers.end(), local.begin(), local.begin()+n);
+                        local.erase(local.begin(), local.begin()+n);
+                    }
+                }
+                else
+                {
+                    FreeNode* node = (FreeNode*)buf.ptr;
+                    std::atomic<FreeNode*>& head = buf.owner->remote[buf.size_class];
+                    node->next = head.load(std::memory_order_relaxed);
+                    while (!head.compare_exchange_weak(node->next, node,
+                                                       std::memory_order_release,
+                                                       std::memory_order_relaxed));
+                }
+
+                buf = Buffer();
+            }
+
+            /*
+             * Return the buffers held in the shared lists to the system,
+             * along with those released to the caches of threads that
+             * have since exited. Buffers cached by live threads are not
+             * affected.
+             */
+            void trim()
+            {
+                {
+                    /*
+                     * Holding the registry lock keeps the retired caches
+                     * from being adopted meanwhile; other threads may
+                     * still push onto their remote stacks.
+                     */
+                    std::lock_guard<std::mutex> registry(_registry_lock);
+
+                    for (auto& cache : _caches)
+                    {
+                        if (cache->in_use) continue;
+
+                        for (int c = 0;c < NUM_CLASSES;c++)
+                        {
+                            FreeNode* node = cache->remote[c].exchange(nullptr);
+
+                            std::lock_guard<std::mutex> guard(_shared[c].lock);
+                            for (;node;node = node->next)
+                                _shared[c].buffers.push_back(node);
+                        }
+                    }
+                }
+
+                for (SharedList& shared : _shared)
+                {
+                    std::lock_guard<std::mutex> guard(shared.lock);
+                    for (void* ptr : shared.buffers) ::free(ptr);
+                    shared.buffers.clear();
+                }
+            }
+
+            static MemoryPool& instance()
+            {
+                static MemoryPool pool;
+                return pool;
+            }
+    };
+}
+
+/*
+ * Workspace buffer (sizes are in bytes) drawn from the size-class
+ * MemoryPool. The buffer only grows: reset(size) keeps the current buffer
+ * if it is already large enough. The packbuf_t argument is accepted for
+ * compatibility with the BLIS memory broker interface.
+ */
+template <typename T>
+class PooledMemory
+{
+    public:
+        typedef T type;
+
+    private:
+        detail::MemoryPool::Buffer _buf;
+        packbuf_t _packbuf;
+
     public:
         PooledMemory(const PooledMemory&) = delete;
 
         PooledMemory(PooledMemory&& other)
+        : _buf(other._buf), _packbuf(other._packbuf)
         {
-            *this = std::move(other);
+            other._buf = detail::MemoryPool::Buffer();
         }
 
         PooledMemory& operator=(const PooledMemory&) = delete;
 
         PooledMemory& operator=(PooledMemory&& other)
         {
-            if (this != &other)
-            {
-                memcpy(static_cast<mem_t*>(this), static_cast<mem_t*>(other), sizeof(mem_t));
-                _packbuf = other._packbuf;
-                other.init();
-            }
+            std::swap(_buf, other._buf);
+            std::swap(_packbuf, other._packbuf);
             return *this;
         }
 
-        explicit PooledMemory(packbuf_t packbuf) : _packbuf(packbuf)
-        {
-            init();
-        }
+        explicit PooledMemory(packbuf_t packbuf = BLIS_BUFFER_FOR_GEN_USE)
+        : _packbuf(packbuf) {}
 
-        explicit PooledMemory(siz_t size, packbuf_t packbuf) : _packbuf(packbuf)
+        explicit PooledMemory(siz_t size, packbuf_t packbuf = BLIS_BUFFER_FOR_GEN_USE)
+        : _packbuf(packbuf)
         {
-            init();
             reset(size);
         }
 
@@ -137,27 +609,86 @@ class PooledMemory : private mem_t
 
         void reset(siz_t size)
         {
-            if (bli_mem_is_unalloc(this))
-            {
-                bli_mem_acquire_m(size, _packbuf, this);
-            }
-            else if (size > bli_mem_size(this))
-            {
-                bli_mem_release(this);
-                bli_mem_acquire_m(size, _packbuf, this);
-            }
+            if (size <= _buf.size && _buf.ptr) return;
+
+            free();
+            _buf = detail::MemoryPool::instance().acquire(size);
         }
 
         void free()
         {
-            if (bli_mem_is_alloc(this)) bli_mem_release(this);
+            detail::MemoryPool::instance().release(_buf);
         }
 
-        operator type*() { return (type*)bli_mem_buffer(this); }
+        siz_t size() const
+        {
+            return _buf.size;
+        }
+
+        operator type*() { return (type*)_buf.ptr; }
 
-        operator const type*() const { return (type*)bli_mem_buffer(this); }
+        operator const type*() const { return (const type*)_buf.ptr; }
 };
 
+namespace detail
+{
+    inline size_t page_size()
+    {
+#if defined(__linux__)
+        static const size_t size = sysconf(_SC_PAGESIZE);
+        return size;
+#else
+        return BLIS_PAGE_SIZE;
+#endif
+    }
+
+    /*
+     * Size of the pages actually backing the address p, as reported by the
+     * kernel in /proc/self/smaps: the hugetlbfs page size for MAP_HUGETLB
+     * mappings, the transparent huge page size if any part of the mapping
+     * has been promoted, and the base page size otherwise.
+     */
+    inline size_t backing_page_size(const void* p)
+    {
+#if defined(__linux__)
+        FILE* fp = fopen("/proc/self/smaps", "r");
+        if (!fp) return page_size();
+
+        uintptr_t addr = (uintptr_t)p;
+        bool found = false;
+        size_t kernel_page = 0, anon_huge = 0;
+        char line[512];
+
+        while (fgets(line, sizeof(line), fp))
+        {
+            unsigned long start, end;
+            size_t value;
+
+            if (sscanf(line, "%lx-%lx", &start, &end) == 2 &&
+                line[strspn(line, "0123456789abcdef")] == '-')
+            {
+                if (found) break;
+                found = addr >= start && addr < end;
+            }
+            else if (found && sscanf(line, "KernelPageSize: %zu kB", &value) == 1)
+            {
+                kernel_page = value*1024;
+            }
+            else if (found && sscanf(line, "AnonHugePages: %zu kB", &value) == 1)
+            {
+                anon_huge = value*1024;
+            }
+        }
+
+        fclose(fp);
+
+        if (kernel_page > page_size()) return kernel_page;
+        if (anon_huge > 0) return 2*1024*1024;
+#endif
+        return page_size();
+    }
+}
+
 enum MemoryType
 {
     MEMORY_DDR_4K,
@@ -192,6 +723,16 @@ class AlignedAllocator
 
         void deallocate(T* ptr, size_t n) const;
 
+        /*
+         * The page size actually obtained for memory returned by allocate,
+         * which may be smaller than requested by Type if huge pages were
+         * not available.
+         */
+        static size_t page_size(const T* ptr)
+        {
+            return detail::backing_page_size(ptr);
+        }
+
         bool operator==(const AlignedAllocator& other) const { return true; }
 
         bool operator!=(const AlignedAllocator& other) const { return false; }
@@ -271,6 +812,100 @@ void AlignedAllocator<T,Type,Alignment>::deallocate(T* ptr, size_t n) const
     }
 }
 
+#elif defined(__linux__)
+
+namespace detail
+{
+    struct HugePageMapping
+    {
+        void* base;
+        size_t length;
+    };
+
+    /*
+     * Map at least len bytes backed by huge pages of the given size: first
+     * as explicit hugetlbfs pages (MAP_HUGETLB), which needs pages reserved
+     * in /proc/sys/vm/nr_hugepages, and failing that as an ordinary
+     * mapping advised with MADV_HUGEPAGE so that transparent huge pages
+     * can back it. start is set to the first 2M-aligned (or huge page
+     * aligned) address of the mapping, with len bytes available after it.
+     */
+    inline HugePageMapping map_huge_pages(size_t len, size_t huge_size, char*& start)
+    {
+        const size_t thp_size = 2*1024*1024;
+        int huge_flag = huge_size == thp_size ? (21 << MAP_HUGE_SHIFT)
+                                              : (30 << MAP_HUGE_SHIFT);
+
+        size_t length = (len+huge_size-1)/huge_size*huge_size;
+        void* base = mmap(nullptr, length, PROT_READ|PROT_WRITE,
+                          MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|huge_flag, -1, 0);
+
+        if (base != MAP_FAILED)
+        {
+            start = (char*)base;
+            return {base, length};
+        }
+
+        length = (len+thp_size-1)/thp_size*thp_size + thp_size;
+        base = mmap(nullptr, length, PROT_READ|PROT_WRITE,
+                    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) throw std::bad_alloc();
+
+        start = (char*)(((uintptr_t)base+thp_size-1)/thp_size*thp_size);
+        madvise(start, length-(start-(char*)base), MADV_HUGEPAGE);
+
+        return {base, length};
+    }
+}
+
+template <typename T, MemoryType Type, size_t Alignment>
+T* AlignedAllocator<T,Type,Alignment>::allocate(size_t n) const
+{
+    T* ptr;
+
+    if (Type == MEMORY_DDR_4K || Type == MEMORY_HBM_4K)
+    {
+        int ret = posix_memalign((void**)&ptr, Alignment, n*sizeof(T));
+        if (ret != 0) throw std::bad_alloc();
+    }
+    else
+    {
+        size_t huge_size = (Type == MEMORY_DDR_2M || Type == MEMORY_HBM_2M) ?
+                           2*1024*1024 : 1024*1024*1024;
+        /*
+         * The mapping is recorded just past the data, so that the data
+         * itself starts on the huge page boundary.
+         */
+        size_t trailer = align(n*sizeof(T), alignof(detail::HugePageMapping));
+
+        char* start;
+        detail::HugePageMapping mapping =
+            detail::map_huge_pages(trailer + sizeof(detail::HugePageMapping),
+                                   huge_size, start);
+
+        ptr = (T*)start;
+        *(detail::HugePageMapping*)(start + trailer) = mapping;
+    }
+
+    return ptr;
+}
+
+template <typename T, MemoryType Type, size_t Alignment>
+void AlignedAllocator<T,Type,Alignment>::deallocate(T* ptr, size_t n) const
+{
+    if (Type == MEMORY_DDR_4K || Type == MEMORY_HBM_4K)
+    {
+        free(ptr);
+    }
+    else
+    {
+        size_t trailer = align(n*sizeof(T), alignof(detail::HugePageMapping));
+        detail::HugePageMapping mapping =
+            *(detail::HugePageMapping*)((char*)ptr + trailer);
+        munmap(mapping.base, mapping.length);
+    }
+}
+
 #else
 
 template <typename T, MemoryType Type, size_t Alignment>
@@ -290,6 +925,412 @@ void AlignedAllocator<T,Type,Alignment>::deallocate(T* ptr, size_t n) const
 
 #endif
 
+enum NumaPolicy
+{
+    NUMA_LOCAL,
+    NUMA_INTERLEAVE,
+    NUMA_BLOCKED
+};
+
+namespace detail
+{
+#if defined(__linux__)
+
+    inline std::vector<int> numa_nodes()
+    {
+        std::vector<int> nodes;
+
+        FILE* fp = fopen("/sys/devices/system/node/online", "r");
+        if (fp)
+        {
+            int first, last;
+            while (fscanf(fp, "%d", &first) == 1)
+            {
+                last = first;
+                int c = fgetc(fp);
+                if (c == '-')
+                {
+                    if (fscanf(fp, "%d", &last) != 1) break;
+                    c = fgetc(fp);
+                }
+                for (int node = first;node <= last;node++) nodes.push_back(node);
+                if (c != ',') break;
+            }
+            fclose(fp);
+        }
+
+        if (nodes.empty()) nodes.push_back(0);
+        return nodes;
+    }
+
+    inline int numa_current_node()
+    {
+        unsigned cpu, node;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) return 0;
+        return node;
+    }
+
+    /*
+     * Returns the node on which the page containing p currently resides,
+     * or -1 if it is unknown (for instance not yet touched).
+     */
+    inline int numa_node_of(const void* p)
+    {
+        int node = -1;
+        if (syscall(SYS_get_mempolicy, &node, nullptr, 0, p, MPOL_F_NODE|MPOL_F_ADDR) != 0)
+            return -1;
+        return node;
+    }
+
+    /*
+     * Placement is a hint: on kernels or containers without NUMA support
+     * mbind fails and the default first-touch policy applies.
+     */
+    inline bool numa_bind(void* p, size_t len, int mode, const std::vector<int>& nodes)
+    {
+        int max_node = *std::max_element(nodes.begin(), nodes.end());
+        const int bits = 8*sizeof(unsigned long);
+        std::vector<unsigned long> mask(max_node/bits+1, 0);
+        for (int node : nodes) mask[node/bits] |= 1ul << (node%bits);
+
+        return syscall(SYS_mbind, p, len, mode, mask.data(),
+                       mask.size()*bits+1, 0) == 0;
+    }
+
+#else
+
+    inline std::vector<int> numa_nodes() { return {0}; }
+
+    inline int numa_current_node() { return 0; }
+
+    inline int numa_node_of(const void*) { return -1; }
+
+#endif
+
+    /*
+     * Zero the range [p,p+len) in parallel so that each page is first
+     * touched by the thread which will work on it. The range is split
+     * into contiguous page-aligned blocks, one per thread, which matches
+     * how BLIS partitions the columns of a column-major operand among its
+     * threads. With NUMA_BLOCKED each thread also binds its block to its
+     * own node, in case it migrates while touching.
+     */
+    inline void numa_first_touch(void* p, size_t len, NumaPolicy policy)
+    {
+        size_t npages = (len+page_size()-1)/page_size();
+
+        ThreadPool::instance().run([&](int tid, int nthreads)
+        {
+            size_t first = npages*tid/nthreads;
+            size_t last = npages*(tid+1)/nthreads;
+            if (first == last) return;
+
+            char* begin = (char*)p + first*page_size();
+            size_t size = std::min(len, last*page_size()) - first*page_size();
+
+#if defined(__linux__)
+            if (policy == NUMA_BLOCKED)
+                numa_bind(begin, size, MPOL_PREFERRED, {numa_current_node()});
+#endif
+
+            memset(begin, 0, size);
+        });
+    }
+}
+
+/*
+ * Allocator which controls the NUMA placement of its pages:
+ *
+ *  NUMA_LOCAL       all pages on the node of the allocating thread
+ *  NUMA_INTERLEAVE  pages round-robin over all online nodes
+ *  NUMA_BLOCKED     contiguous blocks on the nodes of the threads of the
+ *                   pool, in the order BLIS partitions work
+ *
+ * Memory is obtained directly with mmap and placed with the mbind system
+ * call (libnuma is not required), then zeroed by a parallel first-touch
+ * pass over the ThreadPool. For NUMA_BLOCKED to be effective the pool's
+ * threads should be pinned (e.g. with OMP_PROC_BIND/GOMP_CPU_AFFINITY or
+ * taskset) the same way as BLIS's.
+ */
+template <typename T, NumaPolicy Policy=NUMA_BLOCKED>
+class NumaAllocator
+{
+    private:
+        static size_t length(size_t n)
+        {
+            size_t ps = detail::page_size();
+            return (n*sizeof(T)+ps-1)/ps*ps;
+        }
+
+    public:
+        typedef T value_type;
+
+        NumaAllocator() {}
+
+        template <typename U, NumaPolicy UPolicy>
+        NumaAllocator(NumaAllocator<U,UPolicy> other) {}
+
+        T* allocate(size_t n) const
+        {
+            size_t len = length(n);
+
+#if defined(__linux__)
+            void* ptr = mmap(nullptr, len, PROT_READ|PROT_WRITE,
+                             MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+            if (ptr == MAP_FAILED) throw std::bad_alloc();
+
+            if (Policy == NUMA_LOCAL)
+                detail::numa_bind(ptr, len, MPOL_PREFERRED, {detail::numa_current_node()});
+            else if (Policy == NUMA_INTERLEAVE)
+                detail::numa_bind(ptr, len, MPOL_INTERLEAVE, detail::numa_nodes());
+#else
+            void* ptr;
+            if (posix_memalign(&ptr, detail::page_size(), len) != 0) throw std::bad_alloc();
+#endif
+
+            detail::numa_first_touch(ptr, len, Policy);
+
+            return (T*)ptr;
+        }
+
+        void deallocate(T* ptr, size_t n) const
+        {
+#if defined(__linux__)
+            munmap(ptr, length(n));
+#else
+            free(ptr);
+#endif
+        }
+
+        bool operator==(const NumaAllocator& other) const { return true; }
+
+        bool operator!=(const NumaAllocator& other) const { return false; }
+};
+
+/*
+ * Bump-pointer region for short-lived workspace. Allocations are carved
+ * out of large aligned blocks in O(1) and released all at once, in LIFO
+ * order, by rewinding to a previously taken mark (usually through an
+ * ArenaScope); blocks are kept for reuse.
+ */
+class MatrixArena
+{
+    public:
+        struct Mark
+        {
+            size_t block;
+            size_t used;
+        };
+
+    private:
+        struct Block
+        {
+            Memory<char,AlignedAllocator<char,MEMORY_DDR_4K,BLIS_PAGE_SIZE>> mem;
+            size_t size;
+            size_t used;
+
+            explicit Block(size_t size)
+            : mem(size), size(size), used(0) {}
+        };
+
+        std::vector<Block> _blocks;
+        size_t _current;
+        size_t _block_size;
+
+        char* carve(Block& block, size_t size, size_t alignment)
+        {
+            char* base = block.mem;
+            uintptr_t addr = (uintptr_t)(base+block.used);
+            addr += (alignment - addr%alignment)%alignment;
+            size_t off = addr - (uintptr_t)base;
+
+            if (off+size > block.size) return nullptr;
+
+            block.used = off+size;
+            return base+off;
+        }
+
+        static MatrixArena*& current_arena()
+        {
+            static thread_local MatrixArena* arena = nullptr;
+            return arena;
+        }
+
+        friend class ArenaScope;
+
+    public:
+        explicit MatrixArena(size_t block_size = 4*1024*1024)
+        : _current(0), _block_size(block_size) {}
+
+        MatrixArena(const MatrixArena&) = delete;
+
+        MatrixArena& operator=(const MatrixArena&) = delete;
+
+        /*
+         * Blocks past the current one are empty, having been kept by a
+         * rewind; they are used before a new one is allocated.
+         */
+        void* allocate(size_t size, size_t alignment = BLIS_HEAP_ADDR_ALIGN_SIZE)
+        {
+            for (;_current < _blocks.size();_current++)
+            {
+                char* ptr = carve(_blocks[_current], size, alignment);
+                if (ptr) return ptr;
+            }
+
+            _blocks.emplace_back(std::max(_block_size, size+alignment));
+            _current = _blocks.size()-1;
+            return carve(_blocks.back(), size, alignment);
+        }
+
+        template <typename T>
+        T* allocate(size_t n, size_t alignment = BLIS_HEAP_ADDR_ALIGN_SIZE)
+        {
+            return (T*)allocate(n*sizeof(T), alignment);
+        }
+
+        Mark mark() const
+        {
+            if (_blocks.empty()) return {0, 0};
+            return {_current, _blocks[_current].used};
+        }
+
+        /*
+         * Release everything allocated since the mark was taken; the
+         * blocks filled since then are kept, empty, for the allocations
+         * that follow. Rewinding the whole arena after it has spilled into
+         * several blocks merges them into one block big enough for the
+         * next round.
+         */
+        void rewind(Mark mark)
+        {
+            if (mark.block == 0 && mark.used == 0 && _blocks.size() > 1)
+            {
+                size_t total = 0;
+                for (const Block& block : _blocks) total += block.size;
+                _blocks.clear();
+                _current = 0;
+                _block_size = std::max(_block_size, total);
+                return;
+            }
+
+            if (_blocks.empty()) return;
+
+            for (size_t i = mark.block+1;i <= _current && i < _blocks.size();i++)
+                _blocks[i].used = 0;
+            _blocks[mark.block].used = mark.used;
+            _current = mark.block;
+        }
+
+        void clear()
+        {
+            _blocks.clear();
+            _current = 0;
+        }
+
+        static MatrixArena& thread_local_arena()
+        {
+            static thread_local MatrixArena arena;
+            return arena;
+        }
+
+        /*
+         * The arena of the innermost ArenaScope active on this thread, or
+         * the thread-local arena outside of any scope.
+         */
+        static MatrixArena& current()
+        {
+            MatrixArena* arena = current_arena();
+            return arena ? *arena : thread_local_arena();
+        }
+};
+
+/*
+ * Marks an arena on construction and rewinds it on destruction, releasing
+ * every allocation made in between. While the scope is alive the arena is
+ * also the one used by default-constructed ScratchAllocators on this
+ * thread, so
+ *
+ *     for (...)
+ *     {
+ *         ArenaScope scope;
+ *         Matrix<double,ScratchAllocator<double>> W(m, n);
+ *         ...
+ *     }
+ *
+ * allocates W in O(1) and frees it, along with any other workspace from
+ * the same iteration, in one step. Objects using the arena must be
+ * destroyed before their scope.
+ */
+class ArenaScope
+{
+    private:
+        MatrixArena& _arena;
+        MatrixArena::Mark _mark;
+        MatrixArena* _previous;
+
+    public:
+        explicit ArenaScope(MatrixArena& arena = MatrixArena::current())
+        : _arena(arena), _mark(arena.mark()), _previous(MatrixArena::current_arena())
+        {
+            MatrixArena::current_arena() = &arena;
+        }
+
+        ArenaScope(const ArenaScope&) = delete;
+
+        ArenaScope& operator=(const ArenaScope&) = delete;
+
+        ~ArenaScope()
+        {
+            _arena.rewind(_mark);
+            MatrixArena::current_arena() = _previous;
+        }
+
+        MatrixArena& arena() const
+        {
+            return _arena;
+        }
+};
+
+/*
+ * Allocator drawing from a MatrixArena, for use as the Allocator of
+ * Matrix or Memory. deallocate is a no-op: memory is reclaimed when the
+ * enclosing ArenaScope ends. Use Alignment=BLIS_PAGE_SIZE for page-aligned
+ * workspace.
+ */
+template <typename T, size_t Alignment=BLIS_HEAP_ADDR_ALIGN_SIZE>
+class ScratchAllocator
+{
+    template <typename U, size_t UAlignment> friend class ScratchAllocator;
+
+    private:
+        MatrixArena* _arena;
+
+    public:
+        typedef T value_type;
+
+        ScratchAllocator()
+        : _arena(&MatrixArena::current()) {}
+
+        explicit ScratchAllocator(MatrixArena& arena)
+        : _arena(&arena) {}
+
+        template <typename U, size_t UAlignment>
+        ScratchAllocator(const ScratchAllocator<U,UAlignment>& other)
+        : _arena(other._arena) {}
+
+        T* allocate(size_t n) const
+        {
+            return _arena->allocate<T>(n, std::max(Alignment, alignof(T)));
+        }
+
+        void deallocate(T*, size_t) const {}
+
+        bool operator==(const ScratchAllocator& other) const { return _arena == other._arena; }
+
+        bool operator!=(const ScratchAllocator& other) const { return _arena != other._arena; }
+};
+
 }
 
 #endif
@@ -0,0 +1,387 @@
+#ifndef _BLISPP_OUTOFCORE_HPP_
+#define _BLISPP_OUTOFCORE_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "blis++_mapped.hpp"
+#include "blis++_matrix.hpp"
+#include "blis++_partition.hpp"
+
+namespace blis
+{
+
+/*
+ * Default tile edge for gemm_out_of_core. Six tiles are resident at a
+ * time (two each of A, B and C), i.e. 768 MiB in double precision.
+ */
+constexpr dim_t OUT_OF_CORE_TILE = 4096;
+
+namespace detail
+{
+    /*
+     * A single background thread executing I/O requests in submission
+     * order. Each request returns a future which rethrows any error.
+     */
+    class IOQueue
+    {
+        private:
+            std::deque<std::packaged_task<void()>> _queue;
+            std::mutex _mutex;
+            std::condition_variable _ready;
+            bool _stop = false;
+            std::thread _thread;
+
+            void worker()
+            {
+                while (true)
+                {
+                    std::packaged_task<void()> task;
+
+                    {
+                        std::unique_lock<std::mutex> lock(_mutex);
+                        _ready.wait(lock, [&] { return _stop || !_queue.empty(); });
+                        if (_queue.empty()) return;
+                        task = std::move(_queue.front());
+                        _queue.pop_front();
+                    }
+
+                    task();
+                }
+            }
+
+        public:
+            IOQueue() : _thread(&IOQueue::worker, this) {}
+
+            IOQueue(const IOQueue&) = delete;
+
+            IOQueue& operator=(const IOQueue&) = delete;
+
+            ~IOQueue()
+            {
+                {
+                    std::lock_guard<std::mutex> guard(_mutex);
+                    _stop = true;
+                }
+                _ready.notify_one();
+                _thread.join();
+            }
+
+            template <typename Func>
+            std::future<void> submit(Func func)
+            {
+                std::packaged_task<void()> task(std::move(func));
+                std::future<void> result = task.get_future();
+
+                {
+                    std::lock_guard<std::mutex> guard(_mutex);
+                    _queue.push_back(std::move(task));
+                }
+                _ready.notify_one();
+
+                return result;
+            }
+    };
+
+    /*
+     * V = leading m x n block of A, carved out with the partitioning
+     * routines so that A itself is left untouched.
+     */
+    template <typename T>
+    void leading_block(Matrix<T>& A, dim_t m, dim_t n, Matrix<T>& V)
+    {
+        Matrix<T> A0, A1, A2, A01, A21;
+
+        PartitionDown(m,     A0,
+                             A1,
+                          A, A2);
+
+        PartitionAcross(n, A1,
+                        A01, V, A21);
+    }
+}
+
+/*
+ * A column-major matrix stored in a file, starting offset bytes in and
+ * with leading dimension ld (in elements, ld >= m). Nothing is mapped or
+ * cached; blocks are moved in and out explicitly with pread/pwrite, so
+ * the operand may be far larger than memory. Copies refer to the same
+ * open file.
+ */
+template <typename T>
+class DiskMatrix
+{
+    private:
+        std::shared_ptr<detail::FileDescriptor> _fd;
+        off_t _offset;
+        dim_t _m;
+        dim_t _n;
+        inc_t _ld;
+
+        off_t position(dim_t i, dim_t j) const
+        {
+            return _offset + (off_t)(i + j*_ld)*sizeof(T);
+        }
+
+        void check_block(dim_t i, dim_t j, const Matrix<T>& block) const
+        {
+            if (i < 0 || j < 0 || i+block.length() > _m || j+block.width() > _n)
+                throw std::logic_error("block out of range");
+
+            if (block.is_transposed() || (block.length() > 1 && block.row_stride() != 1))
+                throw std::logic_error("block must be column-major");
+        }
+
+        DiskMatrix(const std::string& path, int flags, dim_t m, dim_t n,
+                   off_t offset, inc_t ld)
+        : _fd(std::make_shared<detail::FileDescriptor>(path, flags)),
+          _offset(offset), _m(m), _n(n), _ld(ld == 0 ? std::max<dim_t>(m, 1) : ld)
+        {
+            if (m < 0 || n < 0 || offset < 0)
+                throw std::logic_error("parameter must be non-negative");
+
+            if (_ld < m)
+                throw std::logic_error("leading dimension must be at least the number of rows");
+        }
+
+    public:
+        DiskMatrix(const std::string& path, dim_t m, dim_t n, bool writable = false,
+                   off_t offset = 0, inc_t ld = 0)
+        : DiskMatrix(path, writable ? O_RDWR : O_RDONLY, m, n, offset, ld)
+        {
+            if (_fd->size() < position(0, _n))
+                throw std::runtime_error(path + " is too small for the requested matrix");
+        }
+
+        /*
+         * Create (or resize) a file holding an m x n matrix and open it
+         * for reading and writing.
+         */
+        static DiskMatrix create(const std::string& path, dim_t m, dim_t n,
+                                 off_t offset = 0, inc_t ld = 0)
+        {
+            DiskMatrix A(path, O_RDWR|O_CREAT, m, n, offset, ld);
+
+            if (ftruncate(*A._fd, A.position(0, n)) != 0)
+                detail::throw_errno("ftruncate " + path);
+
+            return A;
+        }
+
+        dim_t length() const { return _m; }
+
+        dim_t width() const { return _n; }
+
+        inc_t leading_dim() const { return _ld; }
+
+        /*
+         * Read the block of the stored matrix starting at (i,j) with the
+         * shape of block into block, which must have unit row stride.
+         * A block made of whole, adjacent columns is read with a single
+         * call, otherwise each column is read separately.
+         */
+        void read(dim_t i, dim_t j, Matrix<T>& block) const
+        {
+            check_block(i, j, block);
+
+            dim_t m = block.length();
+            dim_t n = block.width();
+            if (m == 0 || n == 0) return;
+
+            T* p = block.data();
+            inc_t cs = block.col_stride();
+
+            if (m == _ld && (n == 1 || cs == _ld))
+            {
+                detail::pread_all(*_fd, p, m*n*sizeof(T), position(i, j));
+                return;
+            }
+
+            for (dim_t c = 0;c < n;c++)
+                detail::pread_all(*_fd, p+c*cs, m*sizeof(T), position(i, j+c));
+        }
+
+        void write(dim_t i, dim_t j, const Matrix<T>& block)
+        {
+            check_block(i, j, block);
+
+            dim_t m = block.length();
+            dim_t n = block.width();
+            if (m == 0 || n == 0) return;
+
+            const T* p = block.data();
+            inc_t cs = block.col_stride();
+
+            if (m == _ld && (n == 1 || cs == _ld))
+            {
+                detail::pwrite_all(*_fd, p, m*n*sizeof(T), position(i, j));
+                return;
+            }
+
+            for (dim_t c = 0;c < n;c++)
+                detail::pwrite_all(*_fd, p+c*cs, m*sizeof(T), position(i, j+c));
+        }
+};
+
+/*
+ * C = alpha*A*B + beta*C for operands stored on disk, moving mb x kb
+ * tiles of A, kb x nb tiles of B and mb x nb tiles of C through memory.
+ *
+ * Every tile buffer is double-buffered: while bli_gemm works on one pair
+ * of A and B tiles, the I/O thread reads the next pair, and a finished C
+ * tile is written back while the next one is computed. C tiles are not
+ * read at all when beta is zero. A, B and C must not share storage.
+ */
+template <typename T>
+void gemm_out_of_core(const T& alpha, const DiskMatrix<T>& A, const DiskMatrix<T>& B,
+                      const T& beta, DiskMatrix<T>& C,
+                      dim_t mb = OUT_OF_CORE_TILE, dim_t nb = OUT_OF_CORE_TILE,
+                      dim_t kb = OUT_OF_CORE_TILE)
+{
+    dim_t m = C.length();
+    dim_t n = C.width();
+    dim_t k = A.width();
+
+    if (A.length() != m || B.width() != n || B.length() != k)
+        throw std::logic_error("dimensions must match");
+
+    if (mb <= 0 || nb <= 0 || kb <= 0)
+        throw std::logic_error("tile sizes must be positive");
+
+    if (m == 0 || n == 0) return;
+
+    mb = std::min(mb, m);
+    nb = std::min(nb, n);
+    kb = std::max<dim_t>(std::min(kb, k), 1);
+
+    dim_t mt = (m+mb-1)/mb;
+    dim_t nt = (n+nb-1)/nb;
+    dim_t kt = std::max<dim_t>((k+kb-1)/kb, 1);
+    dim_t nsteps = mt*nt*kt;
+    bool read_c = !(beta == T(0));
+
+    Matrix<T> Abuf[2] = {Matrix<T>(mb, kb), Matrix<T>(mb, kb)};
+    Matrix<T> Bbuf[2] = {Matrix<T>(kb, nb), Matrix<T>(kb, nb)};
+    Matrix<T> Cbuf[2] = {Matrix<T>(mb, nb), Matrix<T>(mb, nb)};
+    Matrix<T> At[2], Bt[2], Ct[2];
+
+    /*
+     * Step s works on tile (i,j) of C and the p-th tiles of A and B, with
+     * p running fastest and i next, so that consecutive C tiles are
+     * contiguous on disk for a column-major C.
+     */
+    auto tile = [&](dim_t s, dim_t& i, dim_t& j, dim_t& p)
+    {
+        p = s%kt;
+        i = (s/kt)%mt;
+        j = s/(kt*mt);
+    };
+
+    auto extent = [](dim_t t, dim_t b, dim_t total)
+    {
+        return std::min(b, total-t*b);
+    };
+
+    std::future<void> ab_loaded[2], c_loaded[2], c_stored[2];
+    detail::IOQueue io;
+
+    auto load_ab = [&](dim_t s)
+    {
+        dim_t i, j, p;
+        tile(s, i, j, p);
+        int slot = s%2;
+
+        detail::leading_block(Abuf[slot], extent(i, mb, m), std::min(kb, k-p*kb), At[slot]);
+        detail::leading_block(Bbuf[slot], std::min(kb, k-p*kb), extent(j, nb, n), Bt[slot]);
+
+        Matrix<T> Av = At[slot], Bv = Bt[slot];
+
+        ab_loaded[slot] = io.submit([&A, &B, Av, Bv, i, j, p, mb, nb, kb]() mutable
+        {
+            A.read(i*mb, p*kb, Av);
+            B.read(p*kb, j*nb, Bv);
+        });
+    };
+
+    auto load_c = [&](dim_t t)
+    {
+        dim_t i = t%mt;
+        dim_t j = t/mt;
+        int slot = t%2;
+
+        detail::leading_block(Cbuf[slot], extent(i, mb, m), extent(j, nb, n), Ct[slot]);
+
+        if (read_c)
+        {
+            Matrix<T> Cv = Ct[slot];
+
+            c_loaded[slot] = io.submit([&C, Cv, i, j, mb, nb]() mutable
+            {
+                C.read(i*mb, j*nb, Cv);
+            });
+        }
+    };
+
+    load_ab(0);
+    load_c(0);
+
+    for (dim_t s = 0;s < nsteps;s++)
+    {
+        dim_t i, j, p;
+        tile(s, i, j, p);
+        dim_t t = s/kt;
+        int slot = s%2;
+        int cslot = t%2;
+
+        ab_loaded[slot].get();
+        if (s+1 < nsteps) load_ab(s+1);
+
+        /*
+         * The I/O thread runs requests in order, so the read of the next C
+         * tile cannot overtake the write-back of the tile that last used
+         * its buffer. Only the computation has to wait for the write-back
+         * explicitly.
+         */
+        if (p == 0)
+        {
+            if (c_stored[cslot].valid()) c_stored[cslot].get();
+            if (read_c) c_loaded[cslot].get();
+            if (t+1 < mt*nt) load_c(t+1);
+        }
+
+        if (k > 0)
+        {
+            detail::assign_gemm(alpha, *static_cast<obj_t*>(At[slot]),
+                                *static_cast<obj_t*>(Bt[slot]), p == 0 ? beta : T(1),
+                                *static_cast<obj_t*>(Ct[cslot]));
+        }
+        else
+        {
+            detail::assign_terms((detail::Monomial<T,1>*)nullptr, 0,
+                                 *static_cast<obj_t*>(Ct[cslot]), beta);
+        }
+
+        if (p == kt-1)
+        {
+            Matrix<T> Cv = Ct[cslot];
+
+            c_stored[cslot] = io.submit([&C, Cv, i, j, mb, nb]
+            {
+                C.write(i*mb, j*nb, Cv);
+            });
+        }
+    }
+
+    for (std::future<void>& stored : c_stored)
+        if (stored.valid()) stored.get();
+}
+
+}
+
+#endif
@@ -1,8 +1,11 @@
 #ifndef _BLISPP_PARTITION_HPP_
 #define _BLISPP_PARTITION_HPP_
 
+#include <algorithm>
+#include <iterator>
 #include <stdexcept>
 #include "blis++_matrix.hpp"
+#include "blis++_view.hpp"
 
 namespace blis
 {
@@ -23,8 +26,8 @@ namespace detail
             throw std::logic_error("parameter must be non-negative");
     }
 
-    template <typename T>
-    void AssertLengthCompatible(const Matrix<T>& AL, const Matrix<T>& AR)
+    template <typename AbstractMatrix>
+    void AssertLengthCompatible(const AbstractMatrix& AL, const AbstractMatrix& AR)
     {
         if (AL.length() != AR.length())
             throw std::logic_error("number of rows must match");
@@ -35,12 +38,12 @@ namespace detail
         if (AL.col_stride() != AR.col_stride())
             throw std::logic_error("column stride must match");
 
-        if ((T*)AL + AL.width()*AL.col_stride() != (T*)AR)
+        if (AL.data() + AL.width()*AL.col_stride() != AR.data())
             throw std::logic_error("submatrices must be contiguous");
     }
 
-    template <typename T>
-    void AssertWidthCompatible(const Matrix<T>& AT, const Matrix<T>& AB)
+    template <typename AbstractMatrix>
+    void AssertWidthCompatible(const AbstractMatrix& AT, const AbstractMatrix& AB)
     {
         if (AT.width() != AB.width())
             throw std::logic_error("number of columns must match");
@@ -51,13 +54,13 @@ namespace detail
         if (AT.col_stride() != AB.col_stride())
             throw std::logic_error("column stride must match");
 
-        if ((T*)AT + AT.length()*AT.row_stride() != (T*)AB)
+        if (AT.data() + AT.length()*AT.row_stride() != AB.data())
             throw std::logic_error("submatrices must be contiguous");
     }
 }
 
-template <typename T>
-void View(Matrix<T>& A, Matrix<T>& V)
+template <typename AbstractMatrix>
+void View(AbstractMatrix& A, AbstractMatrix& V)
 {
     detail::AssertNotSelfView(A, V);
 
@@ -74,13 +77,11 @@ void View(Matrix<T>&& A, Matrix<T>& V)
     View(A, V);
 }
 
-template <typename T>
-void ViewNoTranspose(Matrix<T>& A, Matrix<T>& V)
+template <typename AbstractMatrix>
+void ViewNoTranspose(AbstractMatrix& A, AbstractMatrix& V)
 {
     detail::AssertNotSelfView(A, V);
 
-    if (A.is_conjugated()) V.conjugate();
-
     if (A.is_transposed())
     {
         V.reset(A.width(), A.length(), A.data(),
@@ -91,6 +92,8 @@ void ViewNoTranspose(Matrix<T>& A, Matrix<T>& V)
         V.reset(A.length(), A.width(), A.data(),
                 A.row_stride(), A.col_stride());
     }
+
+    if (A.is_conjugated()) V.conjugate();
 }
 
 template <typename T>
@@ -99,10 +102,10 @@ void ViewNoTranspose(Matrix<T>&& A, Matrix<T>& V)
     ViewNoTranspose(A, V);
 }
 
-template <typename T>
-void PartitionTop(dim_t k,               Matrix<T>& AT,
-                           /***********/ /************/
-                           Matrix<T>& A, Matrix<T>& AB )
+template <typename AbstractMatrix>
+void PartitionTop(dim_t k,                    AbstractMatrix& AT,
+                           /****************/ /*****************/
+                           AbstractMatrix& A, AbstractMatrix& AB )
 {
     detail::AssertNonNegative(k);
     detail::AssertNotSelfView(A, AT);
@@ -112,7 +115,7 @@ void PartitionTop(dim_t k,               Matrix<T>& AT,
     dim_t n = A.width();
     inc_t rs = A.row_stride();
     inc_t cs = A.col_stride();
-    T* p = A;
+    typename AbstractMatrix::type* p = A.data();
 
     k = std::min(m,k);
     m -= k;
@@ -121,10 +124,10 @@ void PartitionTop(dim_t k,               Matrix<T>& AT,
     AB.reset(m, n, p+rs*k, rs, cs);
 }
 
-template <typename T>
-void PartitionBottom(dim_t k, Matrix<T>& A, Matrix<T>& AT,
-                              /***********/ /************/
-                                            Matrix<T>& AB )
+template <typename AbstractMatrix>
+void PartitionBottom(dim_t k, AbstractMatrix& A, AbstractMatrix& AT,
+                              /****************/ /*****************/
+                                                 AbstractMatrix& AB )
 {
     detail::AssertNonNegative(k);
     detail::AssertNotSelfView(A, AT);
@@ -134,7 +137,7 @@ void PartitionBottom(dim_t k, Matrix<T>& A, Matrix<T>& AT,
     dim_t n = A.width();
     inc_t rs = A.row_stride();
     inc_t cs = A.col_stride();
-    T* p = A;
+    typename AbstractMatrix::type* p = A.data();
 
     k = std::min(m,k);
     m -= k;
@@ -143,9 +146,9 @@ void PartitionBottom(dim_t k, Matrix<T>& A, Matrix<T>& AT,
     AB.reset(k, n, p+rs*k, rs, cs);
 }
 
-template <typename T>
-void PartitionLeft(dim_t k,                /**/ Matrix<T>&  A,
-                            Matrix<T>& AL, /**/ Matrix<T>& AR)
+template <typename AbstractMatrix>
+void PartitionLeft(dim_t k,                     /**/ AbstractMatrix&  A,
+                            AbstractMatrix& AL, /**/ AbstractMatrix& AR)
 {
     detail::AssertNonNegative(k);
     detail::AssertNotSelfView(A, AL);
@@ -155,7 +158,7 @@ void PartitionLeft(dim_t k,                /**/ Matrix<T>&  A,
     dim_t n = A.width();
     inc_t rs = A.row_stride();
     inc_t cs = A.col_stride();
-    T* p = A;
+    typename AbstractMatrix::type* p = A.data();
 
     k = std::min(n,k);
     n -= k;
@@ -164,9 +167,9 @@ void PartitionLeft(dim_t k,                /**/ Matrix<T>&  A,
     AR.reset(m, n, p+cs*k, rs, cs);
 }
 
-template <typename T>
-void PartitionRight(dim_t k, Matrix<T>&  A, /**/
-                             Matrix<T>& AL, /**/ Matrix<T>& AR)
+template <typename AbstractMatrix>
+void PartitionRight(dim_t k, AbstractMatrix&  A, /**/
+                             AbstractMatrix& AL, /**/ AbstractMatrix& AR)
 {
     detail::AssertNonNegative(k);
     detail::AssertNotSelfView(A, AL);
@@ -176,7 +179,7 @@ void PartitionRight(dim_t k, Matrix<T>&  A, /**/
     dim_t n = A.width();
     inc_t rs = A.row_stride();
     inc_t cs = A.col_stride();
-    T* p = A;
+    typename AbstractMatrix::type* p = A.data();
 
     k = std::min(n,k);
     n -= k;
@@ -185,10 +188,10 @@ void PartitionRight(dim_t k, Matrix<T>&  A, /**/
     AR.reset(m, k, p+cs*n, rs, cs);
 }
 
-template <typename T>
-void UnpartitionTop(Matrix<T>& AT,
-                    /************/ /***********/
-                    Matrix<T>& AB, Matrix<T>& A )
+template <typename AbstractMatrix>
+void UnpartitionTop(AbstractMatrix& AT,
+                    /*****************/ /****************/
+                    AbstractMatrix& AB, AbstractMatrix& A )
 {
     detail::AssertWidthCompatible(AT, AB);
     detail::AssertNotSelfView(A, AT);
@@ -199,15 +202,15 @@ void UnpartitionTop(Matrix<T>& AT,
     dim_t n = AT.width();
     inc_t rs = AT.row_stride();
     inc_t cs = AT.col_stride();
-    T* p = AT;
+    typename AbstractMatrix::type* p = AT.data();
 
     A.reset(m+k, n, p, rs, cs);
 }
 
-template <typename T>
-void UnpartitionBottom(Matrix<T>& AT, Matrix<T>& A,
-                       /************/ /***********/
-                       Matrix<T>& AB               )
+template <typename AbstractMatrix>
+void UnpartitionBottom(AbstractMatrix& AT, AbstractMatrix& A,
+                       /*****************/ /****************/
+                       AbstractMatrix& AB                    )
 {
     detail::AssertWidthCompatible(AT, AB);
     detail::AssertNotSelfView(A, AT);
@@ -218,14 +221,14 @@ void UnpartitionBottom(Matrix<T>& AT, Matrix<T>& A,
     dim_t n = AT.width();
     inc_t rs = AT.row_stride();
     inc_t cs = AT.col_stride();
-    T* p = AT;
+    typename AbstractMatrix::type* p = AT.data();
 
     A.reset(m+k, n, p, rs, cs);
 }
 
-template <typename T>
-void UnpartitionLeft(Matrix<T>& AL, /**/ Matrix<T>& AR,
-                                    /**/ Matrix<T>&  A)
+template <typename AbstractMatrix>
+void UnpartitionLeft(AbstractMatrix& AL, /**/ AbstractMatrix& AR,
+                                         /**/ AbstractMatrix&  A)
 {
     detail::AssertLengthCompatible(AL, AR);
     detail::AssertNotSelfView(A, AL);
@@ -236,14 +239,14 @@ void UnpartitionLeft(Matrix<T>& AL, /**/ Matrix<T>& AR,
     dim_t n = AR.width();
     inc_t rs = AL.row_stride();
     inc_t cs = AL.col_stride();
-    T* p = AL;
+    typename AbstractMatrix::type* p = AL.data();
 
     A.reset(m, n+k, p, rs, cs);
 }
 
-template <typename T>
-void UnpartitionRight(Matrix<T>& AL, /**/ Matrix<T>& AR,
-                      Matrix<T>&  A  /**/              )
+template <typename AbstractMatrix>
+void UnpartitionRight(AbstractMatrix& AL, /**/ AbstractMatrix& AR,
+                      AbstractMatrix&  A  /**/                   )
 {
     detail::AssertLengthCompatible(AL, AR);
     detail::AssertNotSelfView(A, AL);
@@ -254,16 +257,16 @@ void UnpartitionRight(Matrix<T>& AL, /**/ Matrix<T>& AR,
     dim_t k = AR.width();
     inc_t rs = AL.row_stride();
     inc_t cs = AL.col_stride();
-    T* p = AL;
+    typename AbstractMatrix::type* p = AL.data();
 
     A.reset(m, n+k, p, rs, cs);
 }
 
-template <typename T>
-void PartitionDown(dim_t k,               Matrix<T>& A0,
-                                          Matrix<T>& A1,
-                            /***********/ /************/
-                            Matrix<T>& A, Matrix<T>& A2 )
+template <typename AbstractMatrix>
+void PartitionDown(dim_t k,                    AbstractMatrix& A0,
+                                               AbstractMatrix& A1,
+                            /****************/ /*****************/
+                            AbstractMatrix& A, AbstractMatrix& A2 )
 {
     detail::AssertNonNegative(k);
     detail::AssertNotSelfView(A, A0);
@@ -274,7 +277,7 @@ void PartitionDown(dim_t k,               Matrix<T>& A0,
     dim_t n = A.width();
     inc_t rs = A.row_stride();
     inc_t cs = A.col_stride();
-    T* p = A;
+    typename AbstractMatrix::type* p = A.data();
 
     k = std::min(m,k);
     m -= k;
@@ -284,9 +287,9 @@ void PartitionDown(dim_t k,               Matrix<T>& A0,
     A2.reset(m, n, p+rs*k, rs, cs);
 }
 
-template <typename T>
-void PartitionAcross(dim_t k,                               /**/ Matrix<T>&  A,
-                              Matrix<T>& A0, Matrix<T>& A1, /**/ Matrix<T>& A2)
+template <typename AbstractMatrix>
+void PartitionAcross(dim_t k,                                         /**/ AbstractMatrix&  A,
+                              AbstractMatrix& A0, AbstractMatrix& A1, /**/ AbstractMatrix& A2)
 {
     detail::AssertNonNegative(k);
     detail::AssertNotSelfView(A, A0);
@@ -297,7 +300,7 @@ void PartitionAcross(dim_t k,                               /**/ Matrix<T>&  A,
     dim_t n = A.width();
     inc_t rs = A.row_stride();
     inc_t cs = A.col_stride();
-    T* p = A;
+    typename AbstractMatrix::type* p = A.data();
 
     k = std::min(n,k);
     n -= k;
@@ -307,10 +310,10 @@ void PartitionAcross(dim_t k,                               /**/ Matrix<T>&  A,
     A2.reset(m, n, p+cs*k, rs, cs);
 }
 
-template <typename T>
-void SlidePartitionDown(Matrix<T>& A0,
-                        Matrix<T>& A1,
-                        Matrix<T>& A2)
+template <typename AbstractMatrix>
+void SlidePartitionDown(AbstractMatrix& A0,
+                        AbstractMatrix& A1,
+                        AbstractMatrix& A2)
 {
     dim_t k = A1.length();
     UnpartitionBottom(A0, A0,
@@ -319,8 +322,8 @@ void SlidePartitionDown(Matrix<T>& A0,
                       A2, A2);
 }
 
-template <typename T>
-void SlidePartitionAcross(Matrix<T>& A0, Matrix<T>& A1, Matrix<T>& A2)
+template <typename AbstractMatrix>
+void SlidePartitionAcross(AbstractMatrix& A0, AbstractMatrix& A1, AbstractMatrix& A2)
 {
     dim_t k = A1.width();
     UnpartitionRight(A0, A1,
@@ -329,6 +332,294 @@ void SlidePartitionAcross(Matrix<T>& A0, Matrix<T>& A1, Matrix<T>& A2)
                      A1, A2);
 }
 
+/*
+ * The quadrant named in a 2x2 or 3x3 (re)partitioning: for Partition2x2
+ * the one whose size is given, for Repartition2x2To3x3 the one A11 is
+ * split off from, and for Continue3x3To2x2 the one A11 is merged into.
+ */
+enum Quadrant
+{
+    QUADRANT_TL,
+    QUADRANT_TR,
+    QUADRANT_BL,
+    QUADRANT_BR
+};
+
+namespace detail
+{
+    inline bool IsTop(Quadrant quad)
+    {
+        return quad == QUADRANT_TL || quad == QUADRANT_TR;
+    }
+
+    inline bool IsLeft(Quadrant quad)
+    {
+        return quad == QUADRANT_TL || quad == QUADRANT_BL;
+    }
+
+    /*
+     * Point the nine blocks at consecutive row ranges m[0..2] and column
+     * ranges n[0..2] of the matrix starting at p.
+     */
+    template <typename AbstractMatrix>
+    void Set3x3(typename AbstractMatrix::type* p, inc_t rs, inc_t cs,
+                const dim_t (&m)[3], const dim_t (&n)[3],
+                AbstractMatrix& A00, AbstractMatrix& A01, AbstractMatrix& A02,
+                AbstractMatrix& A10, AbstractMatrix& A11, AbstractMatrix& A12,
+                AbstractMatrix& A20, AbstractMatrix& A21, AbstractMatrix& A22)
+    {
+        typename AbstractMatrix::type* p1 = p  + rs*m[0];
+        typename AbstractMatrix::type* p2 = p1 + rs*m[1];
+
+        A00.reset(m[0], n[0], p                 , rs, cs);
+        A01.reset(m[0], n[1], p +cs*n[0]        , rs, cs);
+        A02.reset(m[0], n[2], p +cs*(n[0]+n[1]) , rs, cs);
+        A10.reset(m[1], n[0], p1                , rs, cs);
+        A11.reset(m[1], n[1], p1+cs*n[0]        , rs, cs);
+        A12.reset(m[1], n[2], p1+cs*(n[0]+n[1]) , rs, cs);
+        A20.reset(m[2], n[0], p2                , rs, cs);
+        A21.reset(m[2], n[1], p2+cs*n[0]        , rs, cs);
+        A22.reset(m[2], n[2], p2+cs*(n[0]+n[1]) , rs, cs);
+    }
+}
+
+/*
+ * Split A into quadrants, the one named by quad being (at most) mb x nb.
+ */
+template <typename AbstractMatrix>
+void Partition2x2(dim_t mb, dim_t nb, Quadrant quad,
+                  AbstractMatrix& A, /**/ AbstractMatrix& ATL, AbstractMatrix& ATR,
+                                     /**/
+                                     /**/ AbstractMatrix& ABL, AbstractMatrix& ABR)
+{
+    detail::AssertNonNegative(mb);
+    detail::AssertNonNegative(nb);
+    detail::AssertNotSelfView(A, ATL);
+    detail::AssertNotSelfView(A, ATR);
+    detail::AssertNotSelfView(A, ABL);
+    detail::AssertNotSelfView(A, ABR);
+
+    dim_t m = A.length();
+    dim_t n = A.width();
+    inc_t rs = A.row_stride();
+    inc_t cs = A.col_stride();
+    typename AbstractMatrix::type* p = A.data();
+
+    mb = std::min(m,mb);
+    nb = std::min(n,nb);
+
+    dim_t mt = detail::IsTop(quad) ? mb : m-mb;
+    dim_t nl = detail::IsLeft(quad) ? nb : n-nb;
+
+    ATL.reset(  mt,   nl, p             , rs, cs);
+    ATR.reset(  mt, n-nl, p      +cs*nl , rs, cs);
+    ABL.reset(m-mt,   nl, p+rs*mt       , rs, cs);
+    ABR.reset(m-mt, n-nl, p+rs*mt+cs*nl , rs, cs);
+}
+
+/*
+ * Split an mb x nb (at most) block A11 off the inner corner of quadrant
+ * quad, so that it becomes the center of a 3x3 partitioning. Moving
+ * forward through a matrix uses QUADRANT_BR, backward QUADRANT_TL.
+ */
+template <typename AbstractMatrix>
+void Repartition2x2To3x3(dim_t mb, dim_t nb, Quadrant quad,
+                         AbstractMatrix& ATL, AbstractMatrix& ATR, /**/ AbstractMatrix& A00, AbstractMatrix& A01, AbstractMatrix& A02,
+                                                                   /**/ AbstractMatrix& A10, AbstractMatrix& A11, AbstractMatrix& A12,
+                         AbstractMatrix& ABL, AbstractMatrix& ABR, /**/ AbstractMatrix& A20, AbstractMatrix& A21, AbstractMatrix& A22)
+{
+    detail::AssertNonNegative(mb);
+    detail::AssertNonNegative(nb);
+
+    dim_t mt = ATL.length();
+    dim_t mbot = ABL.length();
+    dim_t nl = ATL.width();
+    dim_t nr = ATR.width();
+    inc_t rs = ATL.row_stride();
+    inc_t cs = ATL.col_stride();
+    typename AbstractMatrix::type* p = ATL.data();
+
+    mb = std::min(detail::IsTop(quad) ? mt : mbot, mb);
+    nb = std::min(detail::IsLeft(quad) ? nl : nr, nb);
+
+    dim_t m[3], n[3];
+
+    if (detail::IsTop(quad))
+    {
+        m[0] = mt-mb; m[1] = mb; m[2] = mbot;
+    }
+    else
+    {
+        m[0] = mt; m[1] = mb; m[2] = mbot-mb;
+    }
+
+    if (detail::IsLeft(quad))
+    {
+        n[0] = nl-nb; n[1] = nb; n[2] = nr;
+    }
+    else
+    {
+        n[0] = nl; n[1] = nb; n[2] = nr-nb;
+    }
+
+    detail::Set3x3(p, rs, cs, m, n, A00, A01, A02,
+                                    A10, A11, A12,
+                                    A20, A21, A22);
+}
+
+/*
+ * Merge the 3x3 partitioning back into quadrants, with A11 joining quad.
+ * Moving forward through a matrix uses QUADRANT_TL, backward QUADRANT_BR.
+ */
+template <typename AbstractMatrix>
+void Continue3x3To2x2(Quadrant quad,
+                      AbstractMatrix& ATL, AbstractMatrix& ATR, /**/ AbstractMatrix& A00, AbstractMatrix& A01, AbstractMatrix& A02,
+                                                                /**/ AbstractMatrix& A10, AbstractMatrix& A11, AbstractMatrix& A12,
+                      AbstractMatrix& ABL, AbstractMatrix& ABR, /**/ AbstractMatrix& A20, AbstractMatrix& A21, AbstractMatrix& A22)
+{
+    dim_t m0 = A00.length();
+    dim_t m1 = A11.length();
+    dim_t m2 = A22.length();
+    dim_t n0 = A00.width();
+    dim_t n1 = A11.width();
+    dim_t n2 = A22.width();
+    inc_t rs = A00.row_stride();
+    inc_t cs = A00.col_stride();
+    typename AbstractMatrix::type* p = A00.data();
+
+    dim_t m = m0+m1+m2;
+    dim_t n = n0+n1+n2;
+    dim_t mt = detail::IsTop(quad) ? m0+m1 : m0;
+    dim_t nl = detail::IsLeft(quad) ? n0+n1 : n0;
+
+    ATL.reset(  mt,   nl, p             , rs, cs);
+    ATR.reset(  mt, n-nl, p      +cs*nl , rs, cs);
+    ABL.reset(m-mt,   nl, p+rs*mt       , rs, cs);
+    ABR.reset(m-mt, n-nl, p+rs*mt+cs*nl , rs, cs);
+}
+
+/*
+ * The 3x3 partitioning at one step of a blocked sweep down the diagonal.
+ */
+template <typename AbstractMatrix>
+struct Blocks3x3
+{
+    AbstractMatrix A00, A01, A02;
+    AbstractMatrix A10, A11, A12;
+    AbstractMatrix A20, A21, A22;
+};
+
+/*
+ * Range over the steps of a forward blocked algorithm:
+ *
+ *     for (auto& b : blocked_diagonal(A, nb))
+ *     {
+ *         ... b.A11, b.A21, b.A22 ...
+ *     }
+ *
+ * At each step A11 is the next (at most) nb x nb diagonal block and the
+ * other eight blocks surround it, exactly as Repartition2x2To3x3 with
+ * QUADRANT_BR would produce. The blocks are computed directly from the
+ * offset into A rather than by repeated Continue/Repartition calls.
+ */
+template <typename AbstractMatrix>
+class BlockedDiagonal
+{
+    private:
+        typename AbstractMatrix::type* _p;
+        dim_t _m;
+        dim_t _n;
+        inc_t _rs;
+        inc_t _cs;
+        dim_t _nb;
+
+    public:
+        class iterator
+        {
+            friend class BlockedDiagonal;
+
+            private:
+                const BlockedDiagonal* _range;
+                dim_t _k;
+                Blocks3x3<AbstractMatrix> _blocks;
+
+                iterator(const BlockedDiagonal* range, dim_t k)
+                : _range(range), _k(k) {}
+
+                dim_t step() const
+                {
+                    return std::min(_range->_nb, std::min(_range->_m, _range->_n)-_k);
+                }
+
+            public:
+                typedef std::input_iterator_tag iterator_category;
+                typedef Blocks3x3<AbstractMatrix> value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef value_type* pointer;
+                typedef value_type& reference;
+
+                value_type& operator*()
+                {
+                    const BlockedDiagonal& r = *_range;
+                    dim_t b = step();
+                    dim_t m[3] = {_k, b, r._m-_k-b};
+                    dim_t n[3] = {_k, b, r._n-_k-b};
+
+                    detail::Set3x3(r._p, r._rs, r._cs, m, n,
+                                   _blocks.A00, _blocks.A01, _blocks.A02,
+                                   _blocks.A10, _blocks.A11, _blocks.A12,
+                                   _blocks.A20, _blocks.A21, _blocks.A22);
+
+                    return _blocks;
+                }
+
+                value_type* operator->()
+                {
+                    return &**this;
+                }
+
+                iterator& operator++()
+                {
+                    _k += step();
+                    return *this;
+                }
+
+                bool operator==(const iterator& other) const
+                {
+                    return _k == other._k;
+                }
+
+                bool operator!=(const iterator& other) const
+                {
+                    return _k != other._k;
+                }
+        };
+
+        BlockedDiagonal(AbstractMatrix& A, dim_t nb)
+        : _p(A.data()), _m(A.length()), _n(A.width()),
+          _rs(A.row_stride()), _cs(A.col_stride()), _nb(nb)
+        {
+            if (nb <= 0)
+                throw std::logic_error("block size must be positive");
+        }
+
+        iterator begin() const
+        {
+            return iterator(this, 0);
+        }
+
+        iterator end() const
+        {
+            return iterator(this, std::min(_m, _n));
+        }
+};
+
+template <typename AbstractMatrix>
+BlockedDiagonal<AbstractMatrix> blocked_diagonal(AbstractMatrix& A, dim_t nb)
+{
+    return BlockedDiagonal<AbstractMatrix>(A, nb);
+}
+
 }
 
 #endif
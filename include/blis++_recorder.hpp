@@ -0,0 +1,491 @@
+#ifndef _BLISPP_RECORDER_HPP_
+#define _BLISPP_RECORDER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "blis/blis.h"
+
+#include "blis++_autotune.hpp"
+#include "blis++_thread.hpp"
+
+namespace blis
+{
+
+/*
+ * One operation as issued through the wrapper. variant uses the letters
+ * of blis_bench (n, t, c, h for the conjtrans() of each operand; l/u and
+ * n/u for uplo and diag), so that recorded shapes can be replayed
+ * directly. nested is set for operations issued by another recorded
+ * operation on the same thread (the gemms inside potrf, say).
+ */
+struct ShapeRecord
+{
+    char op[16];
+    char variant[8];
+    char dt;
+    uint8_t nested;
+    uint8_t trans_a;
+    uint8_t trans_b;
+    int32_t threads;
+    int64_t m, n, k;
+    int64_t rs_a, cs_a;
+    int64_t rs_b, cs_b;
+    int64_t rs_c, cs_c;
+    double seconds;
+};
+
+static_assert(std::is_pod<ShapeRecord>::value, "ShapeRecord is written as raw bytes");
+
+namespace detail
+{
+    inline char trans_char(trans_t trans)
+    {
+        switch (trans)
+        {
+            case BLIS_TRANSPOSE:         return 't';
+            case BLIS_CONJ_NO_TRANSPOSE: return 'c';
+            case BLIS_CONJ_TRANSPOSE:    return 'h';
+            default:                     return 'n';
+        }
+    }
+
+    /*
+     * Single-producer, single-consumer ring of records: the owning thread
+     * pushes without locking and the dumper drains. A full ring drops the
+     * record (and counts it) rather than block the caller.
+     */
+    class ShapeRing
+    {
+        private:
+            static constexpr size_t CAPACITY = 4096;
+
+            ShapeRecord _records[CAPACITY];
+            std::atomic<size_t> _head;
+            std::atomic<size_t> _tail;
+            std::atomic<size_t> _dropped;
+
+        public:
+            ShapeRing()
+            : _head(0), _tail(0), _dropped(0) {}
+
+            void push(const ShapeRecord& record)
+            {
+                size_t head = _head.load(std::memory_order_relaxed);
+
+                if (head - _tail.load(std::memory_order_acquire) == CAPACITY)
+                {
+                    _dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+
+                _records[head%CAPACITY] = record;
+                _head.store(head+1, std::memory_order_release);
+            }
+
+            template <typename Func>
+            void drain(Func func)
+            {
+                size_t tail = _tail.load(std::memory_order_relaxed);
+                size_t head = _head.load(std::memory_order_acquire);
+
+                for (;tail != head;tail++) func(_records[tail%CAPACITY]);
+
+                _tail.store(tail, std::memory_order_release);
+            }
+
+            size_t take_dropped()
+            {
+                return _dropped.exchange(0, std::memory_order_relaxed);
+            }
+    };
+
+    constexpr char SHAPE_RECORD_MAGIC[8] = {'B','L','I','S','R','E','C','1'};
+}
+
+/*
+ * Opt-in log of every operation issued through the wrapper (expression
+ * assignment, gemm_batch and the lapack routines), for tuning against
+ * real traffic rather than synthetic sweeps. Each thread appends to its
+ * own lock-free ring, and a background thread appends the rings to a
+ * binary file every interval seconds: an 8-byte magic, the record size
+ * as a uint32_t, then raw ShapeRecords. read_shape_records() reads it
+ * back, and blis_bench --replay re-runs the shape histogram.
+ *
+ * Recording is off by default, and then costs one relaxed load per
+ * operation. enable(path) or BLISPP_RECORD=path in the environment turns
+ * it on (BLISPP_RECORD_INTERVAL sets the dump interval). The file is
+ * machine and build specific like any raw dump.
+ */
+class ShapeRecorder
+{
+    public:
+        /*
+         * Times one operation and records it when it completes. The
+         * caller fills in record() after construction if active().
+         */
+        class Scope
+        {
+            private:
+                ShapeRecord _record;
+                double _t0 = 0;
+                unsigned _generation = 0;
+                bool _active;
+
+            public:
+                Scope(const char* op, num_t dt)
+                : _active(ShapeRecorder::instance().enabled())
+                {
+                    if (!_active) return;
+
+                    _generation = ShapeRecorder::instance().generation();
+                    memset(&_record, 0, sizeof(_record));
+                    strncpy(_record.op, op, sizeof(_record.op)-1);
+                    _record.dt = detail::datatype_char(dt);
+                    _record.nested = depth() > 0;
+                    _record.threads = threads() > 0 ? threads() : detail::env_num_threads();
+
+                    depth()++;
+                    _t0 = bli_clock();
+                }
+
+                Scope(const Scope&) = delete;
+
+                Scope& operator=(const Scope&) = delete;
+
+                /*
+                 * Operations still running when recording is disabled (or
+                 * restarted) are not recorded, so that they do not end up
+                 * in the next recording.
+                 */
+                ~Scope()
+                {
+                    if (!_active) return;
+
+                    _record.seconds = bli_clock()-_t0;
+                    depth()--;
+
+                    ShapeRecorder& recorder = ShapeRecorder::instance();
+                    if (recorder.enabled() && recorder.generation() == _generation)
+                        recorder.ring().push(_record);
+                }
+
+                bool active() const
+                {
+                    return _active;
+                }
+
+                ShapeRecord& record()
+                {
+                    return _record;
+                }
+
+                void variant(const std::string& v)
+                {
+                    strncpy(_record.variant, v.c_str(), sizeof(_record.variant)-1);
+                }
+
+                void operand_a(const obj_t& A)
+                {
+                    _record.trans_a = bli_obj_conjtrans_status(A);
+                    _record.rs_a = bli_obj_row_stride(A);
+                    _record.cs_a = bli_obj_col_stride(A);
+                }
+
+                void operand_b(const obj_t& B)
+                {
+                    _record.trans_b = bli_obj_conjtrans_status(B);
+                    _record.rs_b = bli_obj_row_stride(B);
+                    _record.cs_b = bli_obj_col_stride(B);
+                }
+
+                void operand_c(const obj_t& C)
+                {
+                    _record.rs_c = bli_obj_row_stride(C);
+                    _record.cs_c = bli_obj_col_stride(C);
+                }
+
+                void shape(dim_t m, dim_t n, dim_t k)
+                {
+                    _record.m = m;
+                    _record.n = n;
+                    _record.k = k;
+                }
+        };
+
+        /*
+         * Overrides the thread count recorded for operations issued by
+         * this thread, for code that knows its BLIS calls run with a
+         * different thread count than BLIS_NUM_THREADS gives.
+         */
+        class Threads
+        {
+            private:
+                int _old;
+
+            public:
+                explicit Threads(int nthreads)
+                : _old(threads())
+                {
+                    threads() = nthreads;
+                }
+
+                Threads(const Threads&) = delete;
+
+                Threads& operator=(const Threads&) = delete;
+
+                ~Threads()
+                {
+                    threads() = _old;
+                }
+        };
+
+        /*
+         * Marks operations issued by this thread as nested, for work that
+         * a recorded operation hands to other threads.
+         */
+        class Nested
+        {
+            public:
+                Nested()
+                {
+                    depth()++;
+                }
+
+                Nested(const Nested&) = delete;
+
+                Nested& operator=(const Nested&) = delete;
+
+                ~Nested()
+                {
+                    depth()--;
+                }
+        };
+
+    private:
+        std::atomic<bool> _enabled;
+        std::atomic<unsigned> _generation;
+        std::string _path;
+        double _interval = 1;
+        FILE* _file = nullptr;
+        size_t _dropped = 0;
+        std::vector<std::shared_ptr<detail::ShapeRing>> _rings;
+        std::mutex _mutex;
+        std::thread _dumper;
+        std::condition_variable _wake;
+        bool _stop = false;
+
+        static int& depth()
+        {
+            static thread_local int depth = 0;
+            return depth;
+        }
+
+        static int& threads()
+        {
+            static thread_local int threads = 0;
+            return threads;
+        }
+
+        detail::ShapeRing& ring()
+        {
+            static thread_local std::shared_ptr<detail::ShapeRing> ring;
+
+            if (!ring)
+            {
+                ring = std::make_shared<detail::ShapeRing>();
+                std::lock_guard<std::mutex> guard(_mutex);
+                _rings.push_back(ring);
+            }
+
+            return *ring;
+        }
+
+        /*
+         * Must be called with _mutex held. The rings of threads that have
+         * exited (held only here) are released once they are drained.
+         */
+        void dump()
+        {
+            for (auto it = _rings.begin();it != _rings.end();)
+            {
+                bool orphaned = it->use_count() == 1;
+
+                (*it)->drain([&](const ShapeRecord& record)
+                {
+                    if (_file) fwrite(&record, sizeof(record), 1, _file);
+                });
+                _dropped += (*it)->take_dropped();
+
+                it = orphaned ? _rings.erase(it) : it+1;
+            }
+
+            if (_file) fflush(_file);
+        }
+
+        void dumper()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            while (!_stop)
+            {
+                _wake.wait_for(lock, std::chrono::duration<double>(_interval));
+                dump();
+            }
+        }
+
+    public:
+        ShapeRecorder()
+        : _enabled(false), _generation(0)
+        {
+            const char* path = getenv("BLISPP_RECORD");
+            const char* interval = getenv("BLISPP_RECORD_INTERVAL");
+
+            if (path && *path)
+                enable(path, interval && atof(interval) > 0 ? atof(interval) : 1.0);
+        }
+
+        ShapeRecorder(const ShapeRecorder&) = delete;
+
+        ShapeRecorder& operator=(const ShapeRecorder&) = delete;
+
+        ~ShapeRecorder()
+        {
+            disable();
+        }
+
+        /*
+         * Start recording to path (which is truncated), dumping every
+         * interval seconds.
+         */
+        void enable(const std::string& path, double interval = 1.0)
+        {
+            disable();
+
+            std::lock_guard<std::mutex> guard(_mutex);
+
+            /*
+             * Discard anything pushed since the last dump of the previous
+             * recording.
+             */
+            dump();
+
+            _file = fopen(path.c_str(), "wb");
+            if (!_file) throw std::runtime_error("cannot write " + path);
+
+            uint32_t size = sizeof(ShapeRecord);
+            fwrite(detail::SHAPE_RECORD_MAGIC, sizeof(detail::SHAPE_RECORD_MAGIC), 1, _file);
+            fwrite(&size, sizeof(size), 1, _file);
+
+            _path = path;
+            _interval = interval;
+            _dropped = 0;
+            _stop = false;
+            _dumper = std::thread(&ShapeRecorder::dumper, this);
+            _generation++;
+            _enabled = true;
+        }
+
+        /*
+         * Stop recording and write out everything recorded so far.
+         */
+        void disable()
+        {
+            _enabled = false;
+
+            {
+                std::lock_guard<std::mutex> guard(_mutex);
+                _stop = true;
+            }
+            _wake.notify_one();
+            if (_dumper.joinable()) _dumper.join();
+
+            std::lock_guard<std::mutex> guard(_mutex);
+            dump();
+            if (_file) fclose(_file);
+            _file = nullptr;
+        }
+
+        bool enabled() const
+        {
+            return _enabled.load(std::memory_order_relaxed);
+        }
+
+        /*
+         * Incremented by every enable().
+         */
+        unsigned generation() const
+        {
+            return _generation.load(std::memory_order_relaxed);
+        }
+
+        /*
+         * Write out what has been recorded so far without waiting for
+         * the next interval.
+         */
+        void flush()
+        {
+            std::lock_guard<std::mutex> guard(_mutex);
+            dump();
+        }
+
+        /*
+         * Records lost because a thread's ring was full between dumps.
+         */
+        size_t dropped()
+        {
+            std::lock_guard<std::mutex> guard(_mutex);
+            return _dropped;
+        }
+
+        static ShapeRecorder& instance()
+        {
+            static ShapeRecorder recorder;
+            return recorder;
+        }
+};
+
+inline std::vector<ShapeRecord> read_shape_records(const std::string& path)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) throw std::runtime_error("cannot read " + path);
+
+    char magic[sizeof(detail::SHAPE_RECORD_MAGIC)];
+    uint32_t size;
+    if (fread(magic, sizeof(magic), 1, fp) != 1 || fread(&size, sizeof(size), 1, fp) != 1 ||
+        memcmp(magic, detail::SHAPE_RECORD_MAGIC, sizeof(magic)) != 0 ||
+        size != sizeof(ShapeRecord))
+    {
+        fclose(fp);
+        throw std::runtime_error(path + " is not a shape record file from this build");
+    }
+
+    std::vector<ShapeRecord> records;
+    ShapeRecord record;
+    while (fread(&record, sizeof(record), 1, fp) == 1)
+    {
+        record.op[sizeof(record.op)-1] = 0;
+        record.variant[sizeof(record.variant)-1] = 0;
+        records.push_back(record);
+    }
+
+    fclose(fp);
+
+    return records;
+}
+
+}
+
+#endif
@@ -0,0 +1,604 @@
+#ifndef _BLISPP_RECURSIVE_HPP_
+#define _BLISPP_RECURSIVE_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <initializer_list>
+#include <stdexcept>
+#include <vector>
+
+#include "blis++_lapack.hpp"
+#include "blis++_matrix.hpp"
+#include "blis++_partition.hpp"
+#include "blis++_tasks.hpp"
+#include "blis++_view.hpp"
+
+namespace blis
+{
+
+/*
+ * Operations are split in half along their longest dimension until every
+ * dimension is at most leaf_size, and the leaves are handed to BLIS. With
+ * parallel set, the leaves are recorded in a TaskGraph instead and run
+ * out of order as their dependencies allow.
+ */
+struct RecursiveOptions
+{
+    dim_t leaf_size = 64;
+    bool parallel = false;
+};
+
+namespace recursive
+{
+
+namespace detail
+{
+    template <typename T>
+    dim_t rows(const MatrixView<T>& A)
+    {
+        return A.is_transposed() ? A.width() : A.length();
+    }
+
+    template <typename T>
+    dim_t cols(const MatrixView<T>& A)
+    {
+        return A.is_transposed() ? A.length() : A.width();
+    }
+
+    /*
+     * PartitionTop and PartitionLeft in terms of the logical (possibly
+     * transposed) matrix, keeping the transpose and conjugate flags.
+     */
+    template <typename T>
+    void split_rows(MatrixView<T> A, dim_t k, MatrixView<T>& A1, MatrixView<T>& A2)
+    {
+        if (A.is_transposed())
+            PartitionLeft(k, A, A1, A2);
+        else
+            PartitionTop(k, A1, A, A2);
+
+        for (MatrixView<T>* X : {&A1, &A2})
+        {
+            X->transpose(A.is_transposed());
+            X->conjugate(A.is_conjugated());
+        }
+    }
+
+    template <typename T>
+    void split_cols(MatrixView<T> A, dim_t k, MatrixView<T>& A1, MatrixView<T>& A2)
+    {
+        if (A.is_transposed())
+            PartitionTop(k, A1, A, A2);
+        else
+            PartitionLeft(k, A, A1, A2);
+
+        for (MatrixView<T>* X : {&A1, &A2})
+        {
+            X->transpose(A.is_transposed());
+            X->conjugate(A.is_conjugated());
+        }
+    }
+
+    /*
+     * Where leaves go: straight to BLIS, or into a task graph.
+     */
+    class Recursion
+    {
+        private:
+            dim_t _leaf_size;
+            TaskGraph* _graph;
+
+        public:
+            Recursion(dim_t leaf_size, TaskGraph* graph)
+            : _leaf_size(leaf_size), _graph(graph)
+            {
+                if (leaf_size <= 0)
+                    throw std::logic_error("leaf size must be positive");
+            }
+
+            dim_t leaf_size() const
+            {
+                return _leaf_size;
+            }
+
+            void leaf(std::function<void()> func,
+                      std::initializer_list<blis::detail::TaskRegion> regions) const
+            {
+                if (_graph)
+                    _graph->add(std::move(func), regions);
+                else
+                    func();
+            }
+    };
+
+    /*
+     * The driver: call leaf() if no extent exceeds the leaf size,
+     * otherwise split(d, h) to halve the longest extent d at h. Ties go
+     * to the first extent, so list the dimensions whose halves are
+     * independent first.
+     */
+    template <typename Leaf, typename Split>
+    void halve_longest(const Recursion& r, std::initializer_list<dim_t> extents,
+                       Leaf leaf, Split split)
+    {
+        const dim_t* longest = std::max_element(extents.begin(), extents.end());
+
+        if (*longest <= r.leaf_size())
+            leaf();
+        else
+            split(longest-extents.begin(), *longest/2);
+    }
+
+    template <typename F>
+    void drive(const RecursiveOptions& options, F f)
+    {
+        TaskGraph graph;
+        Recursion r(options.leaf_size, options.parallel ? &graph : nullptr);
+        f(r);
+        graph.execute();
+    }
+
+    template <typename T>
+    void gemm(const Recursion& r, const T& alpha, MatrixView<T> A, MatrixView<T> B,
+              const T& beta, MatrixView<T> C)
+    {
+        dim_t m = C.length();
+        dim_t n = C.width();
+        dim_t k = cols(A);
+
+        if (m == 0 || n == 0) return;
+
+        halve_longest(r, {m, n, k},
+        [&]
+        {
+            r.leaf([=] { lapack::detail::gemm(alpha, A, B, beta, C); },
+                   {reads(A), reads(B), writes(C)});
+        },
+        [&](int d, dim_t h)
+        {
+            MatrixView<T> X1, X2, C1, C2;
+
+            if (d == 0)
+            {
+                split_rows(A, h, X1, X2);
+                split_rows(C, h, C1, C2);
+                gemm(r, alpha, X1, B, beta, C1);
+                gemm(r, alpha, X2, B, beta, C2);
+            }
+            else if (d == 1)
+            {
+                split_cols(B, h, X1, X2);
+                split_cols(C, h, C1, C2);
+                gemm(r, alpha, A, X1, beta, C1);
+                gemm(r, alpha, A, X2, beta, C2);
+            }
+            else
+            {
+                MatrixView<T> B1, B2;
+                split_cols(A, h, X1, X2);
+                split_rows(B, h, B1, B2);
+                gemm(r, alpha, X1, B1, beta, C);
+                gemm(r, alpha, X2, B2, T(1), C);
+            }
+        });
+    }
+
+    /*
+     * B = alpha*inv(tri(A))*B
+     */
+    template <typename T>
+    void trsm(const Recursion& r, uplo_t uplo, diag_t diag, const T& alpha,
+              MatrixView<T> A, MatrixView<T> B)
+    {
+        dim_t m = B.length();
+        dim_t n = B.width();
+
+        if (m == 0 || n == 0) return;
+
+        halve_longest(r, {n, m},
+        [&]
+        {
+            r.leaf([=] { lapack::detail::trsm(BLIS_LEFT, uplo, diag, alpha, A, B); },
+                   {reads(A), writes(B)});
+        },
+        [&](int d, dim_t h)
+        {
+            MatrixView<T> B1, B2;
+
+            if (d == 0)
+            {
+                split_cols(B, h, B1, B2);
+                trsm(r, uplo, diag, alpha, A, B1);
+                trsm(r, uplo, diag, alpha, A, B2);
+                return;
+            }
+
+            MatrixView<T> A11, A12,
+                          A21, A22;
+            Partition2x2(h, h, QUADRANT_TL, A, A11, A12, A21, A22);
+            split_rows(B, h, B1, B2);
+
+            if (uplo == BLIS_LOWER)
+            {
+                trsm(r, uplo, diag, alpha, A11, B1);
+                gemm(r, T(-1), A21, B1, alpha, B2);
+                trsm(r, uplo, diag, T(1), A22, B2);
+            }
+            else
+            {
+                trsm(r, uplo, diag, alpha, A22, B2);
+                gemm(r, T(-1), A12, B2, alpha, B1);
+                trsm(r, uplo, diag, T(1), A11, B1);
+            }
+        });
+    }
+
+    /*
+     * B = alpha*tri(A)*B
+     */
+    template <typename T>
+    void trmm(const Recursion& r, uplo_t uplo, diag_t diag, const T& alpha,
+              MatrixView<T> A, MatrixView<T> B)
+    {
+        dim_t m = B.length();
+        dim_t n = B.width();
+
+        if (m == 0 || n == 0) return;
+
+        halve_longest(r, {n, m},
+        [&]
+        {
+            r.leaf([=] { lapack::detail::trmm(BLIS_LEFT, uplo, diag, alpha, A, B); },
+                   {reads(A), writes(B)});
+        },
+        [&](int d, dim_t h)
+        {
+            MatrixView<T> B1, B2;
+
+            if (d == 0)
+            {
+                split_cols(B, h, B1, B2);
+                trmm(r, uplo, diag, alpha, A, B1);
+                trmm(r, uplo, diag, alpha, A, B2);
+                return;
+            }
+
+            MatrixView<T> A11, A12,
+                          A21, A22;
+            Partition2x2(h, h, QUADRANT_TL, A, A11, A12, A21, A22);
+            split_rows(B, h, B1, B2);
+
+            if (uplo == BLIS_LOWER)
+            {
+                trmm(r, uplo, diag, alpha, A22, B2);
+                gemm(r, alpha, A21, B1, T(1), B2);
+                trmm(r, uplo, diag, alpha, A11, B1);
+            }
+            else
+            {
+                trmm(r, uplo, diag, alpha, A11, B1);
+                gemm(r, alpha, A12, B2, T(1), B1);
+                trmm(r, uplo, diag, alpha, A22, B2);
+            }
+        });
+    }
+
+    /*
+     * The uplo triangle of C = alpha*A*A^H + beta*C.
+     */
+    template <typename T>
+    void herk(const Recursion& r, uplo_t uplo, const T& alpha, MatrixView<T> A,
+              const T& beta, MatrixView<T> C)
+    {
+        dim_t n = C.length();
+        dim_t k = cols(A);
+
+        if (n == 0) return;
+
+        halve_longest(r, {n, k},
+        [&]
+        {
+            r.leaf([=]
+            {
+                blis::detail::ScalarConstant<T> a_(alpha), b_(beta);
+                obj_t a = A.obj().obj, c = C.obj().obj;
+                bli_obj_set_struc(BLIS_HERMITIAN, c);
+                bli_obj_set_uplo(uplo, c);
+                bli_herk(a_, &a, b_, &c);
+            },
+            {reads(A), writes(C)});
+        },
+        [&](int d, dim_t h)
+        {
+            MatrixView<T> A1, A2;
+
+            if (d == 1)
+            {
+                split_cols(A, h, A1, A2);
+                herk(r, uplo, alpha, A1, beta, C);
+                herk(r, uplo, alpha, A2, T(1), C);
+                return;
+            }
+
+            MatrixView<T> C11, C12,
+                          C21, C22;
+            Partition2x2(h, h, QUADRANT_TL, C, C11, C12, C21, C22);
+            split_rows(A, h, A1, A2);
+
+            herk(r, uplo, alpha, A1, beta, C11);
+            if (uplo == BLIS_LOWER)
+                gemm(r, alpha, A2, lapack::detail::herm(A1), beta, C21);
+            else
+                gemm(r, alpha, A1, lapack::detail::herm(A2), beta, C12);
+            herk(r, uplo, alpha, A2, beta, C22);
+        });
+    }
+
+    /*
+     * B = A^T
+     */
+    template <typename T>
+    void transpose(const Recursion& r, MatrixView<T> A, MatrixView<T> B)
+    {
+        dim_t m = rows(A);
+        dim_t n = cols(A);
+
+        if (m == 0 || n == 0) return;
+
+        halve_longest(r, {m, n},
+        [&]
+        {
+            MatrixView<T> At = A;
+            At.transpose();
+            r.leaf([=] { lapack::detail::copy(At, B); }, {reads(A), writes(B)});
+        },
+        [&](int d, dim_t h)
+        {
+            MatrixView<T> A1, A2, B1, B2;
+
+            if (d == 0)
+            {
+                split_rows(A, h, A1, A2);
+                split_cols(B, h, B1, B2);
+            }
+            else
+            {
+                split_cols(A, h, A1, A2);
+                split_rows(B, h, B1, B2);
+            }
+
+            transpose(r, A1, B1);
+            transpose(r, A2, B2);
+        });
+    }
+
+    inline void record_info(std::atomic<dim_t>& info, dim_t i)
+    {
+        dim_t old = info;
+        while ((old == 0 || i < old) && !info.compare_exchange_weak(old, i));
+    }
+
+    inline MatrixView<dim_t> pivots(dim_t* ipiv, dim_t n)
+    {
+        return MatrixView<dim_t>(n, 1, ipiv);
+    }
+
+    /*
+     * LU with partial pivoting of an m x n matrix (m >= n) by halving the
+     * columns, as in lapack::getrf's panel factorization but with the
+     * recursive trsm and gemm for the updates. ipiv is relative to A and
+     * the first zero pivot (plus offset) goes to info.
+     */
+    template <typename T>
+    void getrf(const Recursion& r, MatrixView<T> A, dim_t* ipiv, dim_t offset,
+               std::atomic<dim_t>& info)
+    {
+        dim_t n = A.width();
+
+        if (n == 0) return;
+
+        std::atomic<dim_t>* pinfo = &info;
+
+        halve_longest(r, {n},
+        [&]
+        {
+            r.leaf([=]
+            {
+                dim_t i = lapack::detail::getrf_recursive(A, ipiv);
+                if (i) record_info(*pinfo, i+offset);
+            },
+            {writes(A), writes(pivots(ipiv, n))});
+        },
+        [&](int, dim_t h)
+        {
+            MatrixView<T> AL, AR, A11, A21, A12, A22;
+            PartitionLeft(h, A, AL, AR);
+            PartitionTop(h, A11, AL, A21);
+            PartitionTop(h, A12, AR, A22);
+
+            getrf(r, AL, ipiv, offset, info);
+
+            r.leaf([=] { lapack::detail::laswp(AR, ipiv, 0, h); },
+                   {reads(pivots(ipiv, h)), writes(AR)});
+
+            trsm(r, BLIS_LOWER, BLIS_UNIT_DIAG, T(1), A11, A12);
+            gemm(r, T(-1), A21, A12, T(1), A22);
+
+            getrf(r, A22, ipiv+h, offset+h, info);
+
+            r.leaf([=]
+            {
+                for (dim_t i = h;i < n;i++) ipiv[i] += h;
+                lapack::detail::laswp(AL, ipiv, h, n);
+            },
+            {writes(pivots(ipiv+h, n-h)), writes(AL)});
+        });
+    }
+
+    template <typename T>
+    void check_triangular(const MatrixView<T>& A, dim_t m)
+    {
+        if (A.length() != A.width() || A.length() != m)
+            throw std::logic_error("incompatible dimensions");
+    }
+}
+
+/*
+ * C = alpha*A*B + beta*C. A and B may be transposed and/or conjugated.
+ */
+template <typename T>
+void gemm(const T& alpha, MatrixView<T> A, MatrixView<T> B, const T& beta,
+          MatrixView<T> C, const RecursiveOptions& options = RecursiveOptions())
+{
+    C = lapack::detail::logical(C);
+
+    if (detail::rows(A) != C.length() || detail::cols(B) != C.width() ||
+        detail::cols(A) != detail::rows(B))
+        throw std::logic_error("incompatible dimensions");
+
+    detail::drive(options, [&](const detail::Recursion& r)
+    {
+        detail::gemm(r, alpha, A, B, beta, C);
+    });
+}
+
+/*
+ * B = alpha*inv(tri(A))*B (side left) or alpha*B*inv(tri(A)), where
+ * tri(A) is the uplo triangle of A with a unit or non-unit diagonal.
+ */
+template <typename T>
+void trsm(side_t side, uplo_t uplo, diag_t diag, const T& alpha, MatrixView<T> A,
+          MatrixView<T> B, const RecursiveOptions& options = RecursiveOptions())
+{
+    if (A.is_transposed()) uplo = uplo == BLIS_LOWER ? BLIS_UPPER : BLIS_LOWER;
+    A = lapack::detail::logical(A);
+    B = lapack::detail::logical(B);
+
+    /*
+     * B*inv(A) = (inv(A^T)*B^T)^T
+     */
+    if (side == BLIS_RIGHT)
+    {
+        A = lapack::detail::transposed(A);
+        B = lapack::detail::transposed(B);
+        uplo = uplo == BLIS_LOWER ? BLIS_UPPER : BLIS_LOWER;
+    }
+
+    detail::check_triangular(A, B.length());
+
+    detail::drive(options, [&](const detail::Recursion& r)
+    {
+        detail::trsm(r, uplo, diag, alpha, A, B);
+    });
+}
+
+/*
+ * B = alpha*tri(A)*B (side left) or alpha*B*tri(A).
+ */
+template <typename T>
+void trmm(side_t side, uplo_t uplo, diag_t diag, const T& alpha, MatrixView<T> A,
+          MatrixView<T> B, const RecursiveOptions& options = RecursiveOptions())
+{
+    if (A.is_transposed()) uplo = uplo == BLIS_LOWER ? BLIS_UPPER : BLIS_LOWER;
+    A = lapack::detail::logical(A);
+    B = lapack::detail::logical(B);
+
+    if (side == BLIS_RIGHT)
+    {
+        A = lapack::detail::transposed(A);
+        B = lapack::detail::transposed(B);
+        uplo = uplo == BLIS_LOWER ? BLIS_UPPER : BLIS_LOWER;
+    }
+
+    detail::check_triangular(A, B.length());
+
+    detail::drive(options, [&](const detail::Recursion& r)
+    {
+        detail::trmm(r, uplo, diag, alpha, A, B);
+    });
+}
+
+/*
+ * The uplo triangle of C = alpha*A*A^H + beta*C (alpha and beta real).
+ * For real T this is syrk.
+ */
+template <typename T>
+void herk(uplo_t uplo, const T& alpha, MatrixView<T> A, const T& beta,
+          MatrixView<T> C, const RecursiveOptions& options = RecursiveOptions())
+{
+    C = lapack::detail::logical(C);
+
+    if (C.length() != C.width() || detail::rows(A) != C.length())
+        throw std::logic_error("incompatible dimensions");
+
+    detail::drive(options, [&](const detail::Recursion& r)
+    {
+        detail::herk(r, uplo, alpha, A, beta, C);
+    });
+}
+
+/*
+ * B = A^T, out of place.
+ */
+template <typename T>
+void transpose(MatrixView<T> A, MatrixView<T> B,
+               const RecursiveOptions& options = RecursiveOptions())
+{
+    B = lapack::detail::logical(B);
+
+    if (detail::rows(A) != B.width() || detail::cols(A) != B.length())
+        throw std::logic_error("incompatible dimensions");
+
+    detail::drive(options, [&](const detail::Recursion& r)
+    {
+        detail::transpose(r, A, B);
+    });
+}
+
+/*
+ * LU factorization with partial pivoting, with the same conventions as
+ * lapack::getrf.
+ */
+template <typename T>
+dim_t getrf(MatrixView<T> A, std::vector<dim_t>& ipiv,
+            const RecursiveOptions& options = RecursiveOptions())
+{
+    A = lapack::detail::logical(A);
+
+    dim_t m = A.length();
+    dim_t n = A.width();
+    dim_t k = std::min(m, n);
+
+    ipiv.resize(k);
+    std::atomic<dim_t> info(0);
+
+    detail::drive(options, [&](const detail::Recursion& r)
+    {
+        /*
+         * A wide matrix is factored in its leading square block, and the
+         * rest of U is a triangular solve.
+         */
+        MatrixView<T> AL, AR;
+        PartitionLeft(k, A, AL, AR);
+
+        detail::getrf(r, AL, ipiv.data(), 0, info);
+
+        if (AR.width() > 0)
+        {
+            dim_t* p = ipiv.data();
+            r.leaf([=] { lapack::detail::laswp(AR, p, 0, k); },
+                   {reads(detail::pivots(p, k)), writes(AR)});
+
+            MatrixView<T> A11 = lapack::detail::block(AL, 0, 0, k, k);
+            detail::trsm(r, BLIS_LOWER, BLIS_UNIT_DIAG, T(1), A11, AR);
+        }
+    });
+
+    return info;
+}
+
+}
+}
+
+#endif
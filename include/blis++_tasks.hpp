@@ -0,0 +1,346 @@
+#ifndef _BLISPP_TASKS_HPP_
+#define _BLISPP_TASKS_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "blis++_matrix.hpp"
+#include "blis++_thread.hpp"
+#include "blis++_view.hpp"
+
+namespace blis
+{
+
+namespace detail
+{
+    /*
+     * The elements of a view touched by a task, as raw addresses.
+     */
+    struct TaskRegion
+    {
+        intptr_t p;
+        dim_t m;
+        dim_t n;
+        inc_t rs;
+        inc_t cs;
+        inc_t size;
+        bool write;
+    };
+
+    inline dim_t floor_div(dim_t a, dim_t b)
+    {
+        return a/b - (a%b != 0 && (a < 0) != (b < 0));
+    }
+
+    inline dim_t ceil_div(dim_t a, dim_t b)
+    {
+        return -floor_div(-a, b);
+    }
+
+    /*
+     * Whether two regions share any element. Regions with the same
+     * (positive) strides, one of them unit, are tested exactly: they are
+     * sets of equally spaced intervals, and two such sets intersect iff
+     * some column offset t = j-k brings a column of one onto a column of
+     * the other. This keeps e.g. A11 and A21 of one matrix independent.
+     * Anything else is compared by address range, which is conservative.
+     */
+    inline bool overlaps(const TaskRegion& a, const TaskRegion& b)
+    {
+        if (a.m == 0 || a.n == 0 || b.m == 0 || b.n == 0) return false;
+
+        auto extent = [](const TaskRegion& r, intptr_t& lo, intptr_t& hi)
+        {
+            lo = hi = r.p;
+            for (inc_t step : {(r.m-1)*r.rs*r.size, (r.n-1)*r.cs*r.size})
+                (step < 0 ? lo : hi) += step;
+            hi += r.size;
+        };
+
+        intptr_t alo, ahi, blo, bhi;
+        extent(a, alo, ahi);
+        extent(b, blo, bhi);
+        if (ahi <= blo || bhi <= alo) return false;
+
+        if (a.size != b.size || a.rs != b.rs || a.cs != b.cs ||
+            a.rs <= 0 || a.cs <= 0 || (a.rs != 1 && a.cs != 1) ||
+            (b.p-a.p)%a.size != 0) return true;
+
+        bool cols = a.rs == 1;
+        dim_t lena = cols ? a.m : a.n;
+        dim_t lenb = cols ? b.m : b.n;
+        dim_t cnta = cols ? a.n : a.m;
+        dim_t cntb = cols ? b.n : b.m;
+        inc_t ld = cols ? a.cs : a.rs;
+        dim_t d = (b.p-a.p)/a.size;
+
+        dim_t tlo = std::max(ceil_div(d-lena+1, ld), -(cntb-1));
+        dim_t thi = std::min(floor_div(d+lenb-1, ld), cnta-1);
+
+        return tlo <= thi;
+    }
+}
+
+template <typename T>
+detail::TaskRegion reads(const MatrixView<T>& A)
+{
+    return {(intptr_t)A.data(), A.length(), A.width(),
+            A.row_stride(), A.col_stride(), sizeof(T), false};
+}
+
+template <typename T>
+detail::TaskRegion writes(const MatrixView<T>& A)
+{
+    return {(intptr_t)A.data(), A.length(), A.width(),
+            A.row_stride(), A.col_stride(), sizeof(T), true};
+}
+
+/*
+ * Deferred execution of a blocked algorithm, in the manner of
+ * SuperMatrix: operations on views are recorded as tasks rather than run,
+ * each task's dependencies on earlier tasks are inferred from which views
+ * it reads and writes, and execute() then runs the whole graph out of
+ * order on a thread pool. Each thread works depth-first from its own
+ * queue of ready tasks and steals the oldest ready task from another
+ * thread when its queue runs dry.
+ *
+ * The BLIS calls inside tasks should be single-threaded (parallelism
+ * comes from running independent tasks at once), so pass a pool sized
+ * for the machine if BLIS_NUM_THREADS is set to 1 for that purpose.
+ * Views passed to a graph must stay valid until execute() returns.
+ */
+class TaskGraph
+{
+    private:
+        struct Task
+        {
+            std::function<void()> func;
+            std::vector<detail::TaskRegion> regions;
+            std::vector<Task*> successors;
+            int ndeps = 0;
+            std::atomic<int> pending;
+        };
+
+        struct ReadyQueue
+        {
+            std::mutex mutex;
+            std::deque<Task*> tasks;
+        };
+
+        std::vector<std::unique_ptr<Task>> _tasks;
+
+        static bool conflicts(const Task& a, const Task& b)
+        {
+            for (const detail::TaskRegion& ra : a.regions)
+                for (const detail::TaskRegion& rb : b.regions)
+                    if ((ra.write || rb.write) && detail::overlaps(ra, rb))
+                        return true;
+
+            return false;
+        }
+
+    public:
+        TaskGraph() {}
+
+        TaskGraph(const TaskGraph&) = delete;
+
+        TaskGraph& operator=(const TaskGraph&) = delete;
+
+        size_t size() const
+        {
+            return _tasks.size();
+        }
+
+        /*
+         * Record func as a task touching the given regions (built with
+         * reads() and writes()). It will run after every earlier task
+         * with a conflicting access to an overlapping region.
+         */
+        void add(std::function<void()> func,
+                 std::initializer_list<detail::TaskRegion> regions)
+        {
+            std::unique_ptr<Task> task(new Task);
+            task->func = std::move(func);
+            task->regions.assign(regions.begin(), regions.end());
+
+            for (std::unique_ptr<Task>& prev : _tasks)
+            {
+                if (conflicts(*prev, *task))
+                {
+                    prev->successors.push_back(task.get());
+                    task->ndeps++;
+                }
+            }
+
+            _tasks.push_back(std::move(task));
+        }
+
+        /*
+         * C = alpha*A*B + beta*C
+         */
+        template <typename T>
+        void gemm(const T& alpha, MatrixView<T> A, MatrixView<T> B,
+                  const T& beta, MatrixView<T> C)
+        {
+            add([=]
+            {
+                obj_t a = A.obj().obj, b = B.obj().obj, c = C.obj().obj;
+                detail::assign_gemm(alpha, a, b, beta, c);
+            },
+            {reads(A), reads(B), writes(C)});
+        }
+
+        /*
+         * B = alpha*inv(tri(A))*B (side left) or alpha*B*inv(tri(A)).
+         */
+        template <typename T>
+        void trsm(side_t side, uplo_t uplo, diag_t diag, const T& alpha,
+                  MatrixView<T> A, MatrixView<T> B)
+        {
+            add([=]
+            {
+                detail::ScalarConstant<T> s(alpha);
+                obj_t a = A.obj().obj, b = B.obj().obj;
+                detail::set_triangular(a, uplo, diag);
+                bli_trsm(side, s, &a, &b);
+            },
+            {reads(A), writes(B)});
+        }
+
+        /*
+         * B = alpha*tri(A)*B (side left) or alpha*B*tri(A).
+         */
+        template <typename T>
+        void trmm(side_t side, uplo_t uplo, diag_t diag, const T& alpha,
+                  MatrixView<T> A, MatrixView<T> B)
+        {
+            add([=]
+            {
+                detail::ScalarConstant<T> s(alpha);
+                obj_t a = A.obj().obj, b = B.obj().obj;
+                detail::set_triangular(a, uplo, diag);
+                bli_trmm(side, s, &a, &b);
+            },
+            {reads(A), writes(B)});
+        }
+
+        /*
+         * The uplo triangle of C = alpha*A*A^H + beta*C.
+         */
+        template <typename T>
+        void herk(uplo_t uplo, const T& alpha, MatrixView<T> A,
+                  const T& beta, MatrixView<T> C)
+        {
+            add([=]
+            {
+                detail::ScalarConstant<T> a_(alpha), b_(beta);
+                obj_t a = A.obj().obj, c = C.obj().obj;
+                bli_obj_set_struc(BLIS_HERMITIAN, c);
+                bli_obj_set_uplo(uplo, c);
+                bli_herk(a_, &a, b_, &c);
+            },
+            {reads(A), writes(C)});
+        }
+
+        /*
+         * Run all recorded tasks and wait for them; the graph is empty
+         * afterwards. If a task throws, no new tasks are started and the
+         * first exception is rethrown.
+         */
+        void execute(ThreadPool& pool = ThreadPool::instance())
+        {
+            if (_tasks.empty()) return;
+
+            int nqueues = pool.num_threads();
+            std::vector<ReadyQueue> queues(nqueues);
+            std::atomic<size_t> remaining(_tasks.size());
+            std::atomic<bool> failed(false);
+            std::exception_ptr error;
+            std::mutex error_mutex;
+
+            int next = 0;
+            for (std::unique_ptr<Task>& task : _tasks)
+            {
+                task->pending = task->ndeps;
+                if (task->ndeps == 0)
+                {
+                    queues[next].tasks.push_back(task.get());
+                    next = (next+1)%nqueues;
+                }
+            }
+
+            pool.run([&](int tid, int)
+            {
+                while (remaining > 0 && !failed)
+                {
+                    Task* task = nullptr;
+
+                    {
+                        ReadyQueue& own = queues[tid];
+                        std::lock_guard<std::mutex> guard(own.mutex);
+                        if (!own.tasks.empty())
+                        {
+                            task = own.tasks.back();
+                            own.tasks.pop_back();
+                        }
+                    }
+
+                    for (int i = 1;!task && i < nqueues;i++)
+                    {
+                        ReadyQueue& victim = queues[(tid+i)%nqueues];
+                        std::lock_guard<std::mutex> guard(victim.mutex);
+                        if (!victim.tasks.empty())
+                        {
+                            task = victim.tasks.front();
+                            victim.tasks.pop_front();
+                        }
+                    }
+
+                    if (!task)
+                    {
+                        std::this_thread::yield();
+                        continue;
+                    }
+
+                    try
+                    {
+                        task->func();
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> guard(error_mutex);
+                        if (!error) error = std::current_exception();
+                        failed = true;
+                    }
+
+                    for (Task* succ : task->successors)
+                    {
+                        if (--succ->pending == 0)
+                        {
+                            ReadyQueue& own = queues[tid];
+                            std::lock_guard<std::mutex> guard(own.mutex);
+                            own.tasks.push_back(succ);
+                        }
+                    }
+
+                    remaining--;
+                }
+            });
+
+            _tasks.clear();
+
+            if (error) std::rethrow_exception(error);
+        }
+};
+
+}
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef _BLISPP_THREAD_HPP_
+#define _BLISPP_THREAD_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "blis/blis.h"
+
+namespace blis
+{
+
+namespace detail
+{
+    inline int env_num_threads()
+    {
+        for (const char* name : {"BLIS_NUM_THREADS", "OMP_NUM_THREADS"})
+        {
+            const char* str = getenv(name);
+            if (str && atoi(str) > 0) return atoi(str);
+        }
+
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+/*
+ * Fixed set of persistent worker threads. The calling thread takes part
+ * as thread 0. Calls made while the pool is already busy (from another
+ * application thread, or nested from inside a task) run serially on the
+ * caller instead of blocking.
+ */
+class ThreadPool
+{
+    private:
+        std::vector<std::thread> _threads;
+        std::mutex _mutex;
+        std::mutex _run_mutex;
+        std::condition_variable _start;
+        std::condition_variable _done;
+        const std::function<void(int,int)>* _task = nullptr;
+        unsigned _generation = 0;
+        int _running = 0;
+        bool _stop = false;
+        std::exception_ptr _error;
+
+        static bool& in_pool()
+        {
+            static thread_local bool flag = false;
+            return flag;
+        }
+
+        void execute(int tid)
+        {
+            try
+            {
+                (*_task)(tid, num_threads());
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(_mutex);
+                if (!_error) _error = std::current_exception();
+            }
+        }
+
+        void worker(int tid)
+        {
+            in_pool() = true;
+            unsigned generation = 0;
+
+            while (true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _start.wait(lock, [&] { return _stop || _generation != generation; });
+                    if (_stop) return;
+                    generation = _generation;
+                }
+
+                execute(tid);
+
+                std::lock_guard<std::mutex> guard(_mutex);
+                if (--_running == 0) _done.notify_one();
+            }
+        }
+
+    public:
+        explicit ThreadPool(int nthreads = detail::env_num_threads())
+        {
+            for (int tid = 1;tid < nthreads;tid++)
+                _threads.emplace_back(&ThreadPool::worker, this, tid);
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> guard(_mutex);
+                _stop = true;
+            }
+            _start.notify_all();
+            for (std::thread& thread : _threads) thread.join();
+        }
+
+        int num_threads() const
+        {
+            return _threads.size()+1;
+        }
+
+        /*
+         * Run task(tid, nthreads) on every thread of the pool and wait for
+         * all of them to finish. The first exception thrown is rethrown.
+         */
+        void run(const std::function<void(int,int)>& task)
+        {
+            std::unique_lock<std::mutex> busy(_run_mutex, std::try_to_lock);
+
+            if (!busy || in_pool() || _threads.empty())
+            {
+                task(0, 1);
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(_mutex);
+                _task = &task;
+                _running = _threads.size();
+                _error = nullptr;
+                _generation++;
+            }
+            _start.notify_all();
+
+            in_pool() = true;
+            execute(0);
+            in_pool() = false;
+
+            std::unique_lock<std::mutex> lock(_mutex);
+            _done.wait(lock, [&] { return _running == 0; });
+            _task = nullptr;
+
+            if (_error) std::rethrow_exception(_error);
+        }
+
+        /*
+         * Call body(i) for 0 <= i < n, handing out iterations dynamically so
+         * that uneven work balances itself.
+         */
+        template <typename Body>
+        void parallel_for(dim_t n, Body body)
+        {
+            std::atomic<dim_t> next(0);
+
+            run([&](int, int)
+            {
+                for (dim_t i;(i = next++) < n;) body(i);
+            });
+        }
+
+        static ThreadPool& instance()
+        {
+            static ThreadPool pool;
+            return pool;
+        }
+};
+
+}
+
+#endif
@@ -0,0 +1,421 @@
+#ifndef _BLISPP_TSQR_HPP_
+#define _BLISPP_TSQR_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <stdexcept>
+#include <vector>
+
+#include "blis++_lapack.hpp"
+#include "blis++_matrix.hpp"
+#include "blis++_partition.hpp"
+#include "blis++_thread.hpp"
+#include "blis++_view.hpp"
+
+namespace blis
+{
+namespace lapack
+{
+
+namespace detail
+{
+    /*
+     * Generate the elementary reflector H = I - tau*v*v^H with
+     * H^H*x = beta*e1 and v(0) = 1, overwriting x(0) with beta and the
+     * rest of x with v(1:m-1). Returns tau.
+     */
+    template <typename T>
+    T larfg(const MatrixView<T>& x)
+    {
+        typedef real_type_t<T> R;
+
+        dim_t m = x.length();
+        T alpha = x(0, 0);
+
+        R xnorm2 = 0;
+        for (dim_t i = 1;i < m;i++) xnorm2 += std::real(norm2(x(i, 0)));
+
+        if (xnorm2 == R(0) && std::imag(complex_type_t<T>(alpha)) == R(0))
+            return T(0);
+
+        R beta = std::sqrt(std::real(norm2(alpha)) + xnorm2);
+        if (std::real(alpha) > R(0)) beta = -beta;
+
+        T scale = T(1)/(alpha-beta);
+        for (dim_t i = 1;i < m;i++) x(i, 0) *= scale;
+        x(0, 0) = beta;
+
+        return (T(beta)-alpha)/T(beta);
+    }
+
+    /*
+     * C = (I - V*T*V^H)*C, or with T^H if adjoint, where V is unit lower
+     * trapezoidal (only its strictly lower part is referenced) and T is
+     * upper triangular.
+     */
+    template <typename T>
+    void larfb(bool adjoint, const MatrixView<T>& V, const MatrixView<T>& Tf,
+               const MatrixView<T>& C)
+    {
+        dim_t m = C.length();
+        dim_t k = V.width();
+        dim_t nc = C.width();
+
+        if (k == 0 || nc == 0) return;
+
+        MatrixView<T> V1 = block(V, 0, 0, k, k);
+        MatrixView<T> V2 = block(V, k, 0, m-k, k);
+        MatrixView<T> C1 = block(C, 0, 0, k, nc);
+        MatrixView<T> C2 = block(C, k, 0, m-k, nc);
+
+        Matrix<T> W_(k, nc);
+        MatrixView<T> W(W_);
+
+        copy(C1, W);
+        trmm(BLIS_LEFT, BLIS_LOWER, BLIS_UNIT_DIAG, T(1), herm(V1), W);
+        gemm(T(1), herm(V2), C2, T(1), W);
+        trmm(BLIS_LEFT, BLIS_UPPER, BLIS_NONUNIT_DIAG, T(1),
+             adjoint ? herm(Tf) : Tf, W);
+        gemm(T(-1), V2, W, T(1), C2);
+        trmm(BLIS_LEFT, BLIS_LOWER, BLIS_UNIT_DIAG, T(1), V1, W);
+
+        blis::detail::ScalarConstant<T> minus_one(T(-1));
+        bli_axpym(minus_one, W.obj(), C1.obj());
+    }
+
+    /*
+     * Recursive Householder QR of an m x n matrix (m >= n): A = Q*R with
+     * Q = I - V*T*V^H, V stored below the diagonal of A, R on and above
+     * it, and the upper triangular T in Tf. Splitting the columns in half
+     * puts almost all of the work into gemm and trmm.
+     */
+    template <typename T>
+    void geqrt(MatrixView<T> A, MatrixView<T> Tf)
+    {
+        dim_t m = A.length();
+        dim_t n = A.width();
+
+        if (n == 0) return;
+
+        if (n == 1)
+        {
+            Tf(0, 0) = larfg(A);
+            return;
+        }
+
+        dim_t n1 = n/2;
+        dim_t n2 = n-n1;
+
+        MatrixView<T> ATL, ATR,
+                      ABL, ABR;
+        Partition2x2(n1, n1, QUADRANT_TL, A, ATL, ATR, ABL, ABR);
+
+        MatrixView<T> T11 = block(Tf, 0, 0, n1, n1);
+        MatrixView<T> T12 = block(Tf, 0, n1, n1, n2);
+        MatrixView<T> T22 = block(Tf, n1, n1, n2, n2);
+
+        MatrixView<T> AL = block(A, 0, 0, m, n1);
+        MatrixView<T> AR = block(A, 0, n1, m, n2);
+
+        geqrt(AL, T11);
+        larfb(true, AL, T11, AR);
+        geqrt(ABR, T22);
+
+        /*
+         * T12 = -T11*(V1^H*V2)*T22, where V2 starts at row n1 with a unit
+         * lower triangular n2 x n2 block.
+         */
+        MatrixView<T> V21 = block(A, n1, 0, n2, n1);
+        MatrixView<T> V31 = block(A, n, 0, m-n, n1);
+        MatrixView<T> V22 = block(A, n1, n1, n2, n2);
+        MatrixView<T> V32 = block(A, n, n1, m-n, n2);
+
+        for (dim_t j = 0;j < n2;j++)
+            for (dim_t i = 0;i < n1;i++)
+                T12(i, j) = blis::conj(V21(j, i));
+
+        trmm(BLIS_RIGHT, BLIS_LOWER, BLIS_UNIT_DIAG, T(1), V22, T12);
+        gemm(T(1), herm(V31), V32, T(1), T12);
+        trmm(BLIS_LEFT, BLIS_UPPER, BLIS_NONUNIT_DIAG, T(-1), T11, T12);
+        trmm(BLIS_RIGHT, BLIS_UPPER, BLIS_NONUNIT_DIAG, T(1), T22, T12);
+    }
+}
+
+/*
+ * Tall-skinny QR. The m x n matrix A (m >> n) is split into row blocks of
+ * at least n rows, each block is factored independently, and the n x n R
+ * factors are then combined pairwise up a binary tree, each tree node
+ * being the QR factorization of two stacked triangles. A is read from
+ * memory once, by the block factorizations, which all run in parallel;
+ * the tree only ever touches n x n triangles.
+ *
+ * As with geqrf, A is overwritten: R is left in the upper triangle of its
+ * top n rows and the Householder vectors of each block below the block's
+ * diagonal. The tree's reflectors are kept in the TSQR object, so A must
+ * stay alive for as long as Q is applied. Q is never formed; apply_q and
+ * apply_qh apply it to an m x k matrix with gemm/trmm, which for a least
+ * squares problem min ||A*x - b|| gives x = R^-1 * (Q^H*b)(0:n-1).
+ */
+template <typename T>
+class TSQR
+{
+    private:
+        struct Node
+        {
+            dim_t top;
+            dim_t bottom;
+            MatrixView<T> V;
+            MatrixView<T> Tf;
+        };
+
+        MatrixView<T> _A;
+        std::vector<MatrixView<T>> _blocks;
+        std::vector<dim_t> _offsets;
+        std::vector<MatrixView<T>> _block_t;
+        std::vector<Node> _nodes;
+        std::vector<size_t> _levels;
+        std::vector<T> _t;
+        std::vector<T> _v;
+
+        MatrixView<T> top(dim_t block) const
+        {
+            dim_t n = _A.width();
+            return MatrixView<T>(n, n, _blocks[block].data(),
+                                 _A.row_stride(), _A.col_stride());
+        }
+
+        void partition(dim_t mb)
+        {
+            dim_t m = _A.length();
+            dim_t n = _A.width();
+
+            if (mb <= 0)
+            {
+                dim_t nt = ThreadPool::instance().num_threads();
+                mb = std::max(2*n, (m+nt-1)/nt);
+            }
+            mb = std::max(mb, std::max(n, dim_t(1)));
+
+            dim_t nblocks = std::max(dim_t(1), m/mb);
+
+            /*
+             * Blocks of mb rows, with the remainder going to the last.
+             */
+            MatrixView<T> A0, A1, A2;
+            PartitionDown(mb, A0, A1, _A, A2);
+            for (dim_t i = 0;i < nblocks-1;i++)
+            {
+                _offsets.push_back(A0.length());
+                _blocks.push_back(A1);
+                SlidePartitionDown(A0, A1, A2);
+            }
+            _offsets.push_back(A0.length());
+            _blocks.push_back(MatrixView<T>(A1.length()+A2.length(), n, A1.data(),
+                                            _A.row_stride(), _A.col_stride()));
+
+            /*
+             * Pair up the surviving R factors until one is left; the
+             * survivor of each pair is the upper block.
+             */
+            std::vector<dim_t> alive(nblocks);
+            for (dim_t i = 0;i < nblocks;i++) alive[i] = i;
+
+            while (alive.size() > 1)
+            {
+                _levels.push_back(_nodes.size());
+
+                std::vector<dim_t> next;
+                for (size_t i = 0;i < alive.size();i += 2)
+                {
+                    if (i+1 < alive.size())
+                        _nodes.push_back({alive[i], alive[i+1], {}, {}});
+                    next.push_back(alive[i]);
+                }
+
+                alive.swap(next);
+            }
+            _levels.push_back(_nodes.size());
+
+            _t.resize(n*n*(nblocks+_nodes.size()));
+            _v.resize(2*n*n*_nodes.size());
+
+            T* t = _t.data();
+            for (dim_t i = 0;i < nblocks;i++, t += n*n)
+                _block_t.push_back(MatrixView<T>(n, n, t));
+
+            T* v = _v.data();
+            for (Node& node : _nodes)
+            {
+                node.V.reset(2*n, n, v);
+                node.Tf.reset(n, n, t);
+                v += 2*n*n;
+                t += n*n;
+            }
+        }
+
+        void factor()
+        {
+            dim_t n = _A.width();
+            ThreadPool& pool = ThreadPool::instance();
+
+            pool.parallel_for(_blocks.size(),
+            [&](dim_t i)
+            {
+                detail::geqrt(_blocks[i], _block_t[i]);
+            });
+
+            for (size_t l = 0;l+1 < _levels.size();l++)
+            {
+                pool.parallel_for(_levels[l+1]-_levels[l],
+                [&](dim_t i)
+                {
+                    Node& node = _nodes[_levels[l]+i];
+                    MatrixView<T> R1 = top(node.top);
+                    MatrixView<T> R2 = top(node.bottom);
+
+                    for (dim_t j = 0;j < n;j++)
+                    {
+                        for (dim_t r = 0;r < n;r++)
+                        {
+                            node.V(r  , j) = r <= j ? R1(r, j) : T(0);
+                            node.V(r+n, j) = r <= j ? R2(r, j) : T(0);
+                        }
+                    }
+
+                    detail::geqrt(node.V, node.Tf);
+
+                    for (dim_t j = 0;j < n;j++)
+                        for (dim_t r = 0;r <= j;r++)
+                            R1(r, j) = node.V(r, j);
+                });
+            }
+        }
+
+        void apply_node(bool adjoint, const Node& node, const MatrixView<T>& B) const
+        {
+            dim_t n = _A.width();
+            dim_t k = B.width();
+            dim_t i1 = _offsets[node.top];
+            dim_t i2 = _offsets[node.bottom];
+
+            Matrix<T> W_(2*n, k);
+            MatrixView<T> W(W_);
+            MatrixView<T> W1 = detail::block(W, 0, 0, n, k);
+            MatrixView<T> W2 = detail::block(W, n, 0, n, k);
+
+            detail::copy(detail::block(B, i1, 0, n, k), W1);
+            detail::copy(detail::block(B, i2, 0, n, k), W2);
+            detail::larfb(adjoint, node.V, node.Tf, W);
+            detail::copy(W1, detail::block(B, i1, 0, n, k));
+            detail::copy(W2, detail::block(B, i2, 0, n, k));
+        }
+
+        void apply_block(bool adjoint, dim_t i, const MatrixView<T>& B) const
+        {
+            detail::larfb(adjoint, _blocks[i], _block_t[i],
+                          detail::block(B, _offsets[i], 0, _blocks[i].length(), B.width()));
+        }
+
+        MatrixView<T> check(MatrixView<T> B) const
+        {
+            B = detail::logical(B);
+
+            if (B.length() != _A.length())
+                throw std::logic_error("incompatible dimensions");
+
+            return B;
+        }
+
+    public:
+        /*
+         * Factor A in place using row blocks of mb rows (0 picks a block
+         * count matching the thread pool).
+         */
+        TSQR(MatrixView<T> A, dim_t mb = 0)
+        : _A(detail::logical(A))
+        {
+            if (_A.length() < _A.width())
+                throw std::logic_error("matrix must have at least as many rows as columns");
+
+            if (_A.width() == 0) return;
+
+            partition(mb);
+            factor();
+        }
+
+        TSQR(const TSQR&) = delete;
+
+        TSQR& operator=(const TSQR&) = delete;
+
+        /*
+         * The upper triangle of this view holds R.
+         */
+        MatrixView<T> R() const
+        {
+            dim_t n = _A.width();
+            return MatrixView<T>(n, n, _A.data(), _A.row_stride(), _A.col_stride());
+        }
+
+        dim_t num_blocks() const
+        {
+            return _blocks.size();
+        }
+
+        /*
+         * B = Q^H*B
+         */
+        void apply_qh(MatrixView<T> B) const
+        {
+            B = check(B);
+            if (_blocks.empty()) return;
+
+            ThreadPool& pool = ThreadPool::instance();
+
+            pool.parallel_for(_blocks.size(),
+            [&](dim_t i)
+            {
+                apply_block(true, i, B);
+            });
+
+            for (size_t l = 0;l+1 < _levels.size();l++)
+            {
+                pool.parallel_for(_levels[l+1]-_levels[l],
+                [&](dim_t i)
+                {
+                    apply_node(true, _nodes[_levels[l]+i], B);
+                });
+            }
+        }
+
+        /*
+         * B = Q*B
+         */
+        void apply_q(MatrixView<T> B) const
+        {
+            B = check(B);
+            if (_blocks.empty()) return;
+
+            ThreadPool& pool = ThreadPool::instance();
+
+            for (size_t l = _levels.size()-1;l > 0;l--)
+            {
+                pool.parallel_for(_levels[l]-_levels[l-1],
+                [&](dim_t i)
+                {
+                    apply_node(false, _nodes[_levels[l-1]+i], B);
+                });
+            }
+
+            pool.parallel_for(_blocks.size(),
+            [&](dim_t i)
+            {
+                apply_block(false, i, B);
+            });
+        }
+};
+
+}
+}
+
+#endif
@@ -50,6 +50,13 @@ namespace detail
                 return *this;
             }
 
+            template <typename Expr, typename=detail::if_expression<Expr>>
+            Vector& operator=(const Expr& expr)
+            {
+                Matrix<type>::operator=(expr);
+                return *this;
+            }
+
             Vector& operator=(const type& val)
             {
                 Matrix<T> s(val);
@@ -0,0 +1,190 @@
+#ifndef _BLISPP_VIEW_HPP_
+#define _BLISPP_VIEW_HPP_
+
+#include <type_traits>
+
+#include "blis++_matrix.hpp"
+
+namespace blis
+{
+
+namespace detail
+{
+    /*
+     * An obj_t built on demand, valid for as long as the temporary lives
+     * (normally the full expression containing the BLIS call).
+     */
+    struct ViewObject
+    {
+        obj_t obj;
+
+        operator obj_t*() { return &obj; }
+    };
+
+    inline void set_triangular(obj_t& a, uplo_t uplo, diag_t diag)
+    {
+        bli_obj_set_struc(BLIS_TRIANGULAR, a);
+        bli_obj_set_uplo(uplo, a);
+        bli_obj_set_diag(diag, a);
+    }
+}
+
+/*
+ * Non-owning view of a matrix: buffer pointer, dimensions, strides and
+ * the transpose/conjugate bits, and nothing else. As with Matrix, the
+ * dimensions and strides describe the stored matrix and transposition is
+ * a flag on top. Unlike Matrix views, creating, copying and partitioning
+ * a MatrixView is plain arithmetic; a BLIS object is only filled in by
+ * obj() when the view is handed to a BLIS operation:
+ *
+ *     bli_gemm(&BLIS_ONE, A11.obj(), B1.obj(), &BLIS_ONE, C1.obj());
+ */
+template <typename T>
+class MatrixView
+{
+    public:
+        typedef T type;
+        typedef typename real_type<T>::type real_type;
+
+    private:
+        T* _p;
+        dim_t _m;
+        dim_t _n;
+        inc_t _rs;
+        inc_t _cs;
+        bool _trans;
+        bool _conj;
+
+    public:
+        MatrixView()
+        : _p(nullptr), _m(0), _n(0), _rs(1), _cs(1), _trans(false), _conj(false) {}
+
+        MatrixView(dim_t m, dim_t n, T* p)
+        : _p(p), _m(m), _n(n), _rs(1), _cs(m), _trans(false), _conj(false) {}
+
+        MatrixView(dim_t m, dim_t n, T* p, inc_t rs, inc_t cs)
+        : _p(p), _m(m), _n(n), _rs(rs), _cs(cs), _trans(false), _conj(false) {}
+
+        template <typename Allocator>
+        MatrixView(Matrix<T,Allocator>& A)
+        : _p(A.data()), _m(A.length()), _n(A.width()),
+          _rs(A.row_stride()), _cs(A.col_stride()),
+          _trans(A.is_transposed()), _conj(A.is_conjugated()) {}
+
+        void reset()
+        {
+            *this = MatrixView();
+        }
+
+        void reset(dim_t m, dim_t n, T* p)
+        {
+            *this = MatrixView(m, n, p);
+        }
+
+        void reset(dim_t m, dim_t n, T* p, inc_t rs, inc_t cs)
+        {
+            *this = MatrixView(m, n, p, rs, cs);
+        }
+
+        bool is_view() const
+        {
+            return true;
+        }
+
+        bool is_transposed() const
+        {
+            return _trans;
+        }
+
+        bool transpose()
+        {
+            bool old = _trans;
+            _trans = !_trans;
+            return old;
+        }
+
+        bool transpose(bool trans)
+        {
+            bool old = _trans;
+            _trans = trans;
+            return old;
+        }
+
+        bool is_conjugated() const
+        {
+            return _conj;
+        }
+
+        bool conjugate()
+        {
+            bool old = _conj;
+            _conj = !_conj;
+            return old;
+        }
+
+        bool conjugate(bool conj)
+        {
+            bool old = _conj;
+            _conj = conj;
+            return old;
+        }
+
+        dim_t length() const
+        {
+            return _m;
+        }
+
+        dim_t width() const
+        {
+            return _n;
+        }
+
+        inc_t row_stride() const
+        {
+            return _rs;
+        }
+
+        inc_t col_stride() const
+        {
+            return _cs;
+        }
+
+        T* data() const
+        {
+            return _p;
+        }
+
+        T& operator()(dim_t i, dim_t j) const
+        {
+            return _p[i*_rs + j*_cs];
+        }
+
+        detail::ViewObject obj() const
+        {
+            detail::ViewObject o;
+            bli_obj_create_with_attached_buffer(datatype<T>::value, _m, _n,
+                                                _p, _rs, _cs, &o.obj);
+            if (_trans) bli_obj_set_onlytrans(BLIS_TRANSPOSE, o.obj);
+            if (_conj) bli_obj_set_conj(BLIS_CONJUGATE, o.obj);
+            return o;
+        }
+
+        /*
+         * A Matrix view of the same elements, for use with the expression
+         * operators.
+         */
+        Matrix<T> matrix() const
+        {
+            Matrix<T> A(_m, _n, _p, _rs, _cs);
+            A.transpose(_trans);
+            A.conjugate(_conj);
+            return A;
+        }
+};
+
+static_assert(std::is_trivially_copyable<MatrixView<double>>::value,
+              "MatrixView must be trivially copyable");
+
+}
+
+#endif
@@ -0,0 +1,1096 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <getopt.h>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "blis++.hpp"
+#include "profile.hpp"
+
+using namespace std;
+using namespace blis;
+
+/*
+ * Each operation's variants are strings with one letter per option, drawn
+ * from the alphabets below:
+ *
+ *     gemm        transA transB           [ntch][ntch]
+ *     hemm, symm  side uplo conjA transB  [lr][lu][nc][ntch]
+ *     herk, syrk  uplo transA             [lu][ntch]
+ *     trmm, trsm  side uplo transA diag   [lr][lu][ntch][nu]
+ *     gemv        transA conjx            [ntch][nc]
+ *     axpyv,copyv conjx                   [nc]
+ *     dotv        conjx conjy             [nc][nc]
+ *     scalv,normfv (none)
+ *     axpym,copym transA                  [ntch]
+ *     potrf       uplo                    [lu]
+ *     getrf       (none)
+ *     trtri       uplo diag               [lu][nu]
+ *
+ * where n, t, c and h are no transpose, transpose, conjugate and
+ * conjugate transpose, as in trans_op_t.
+ *
+ * The operands are named A, B and C for the purpose of placing them in
+ * memory, with x counting as B and y as C in the vector operations.
+ * potrf, getrf and trtri are those of blis::lapack, with the block size
+ * chosen as usual, or as recorded when replaying.
+ */
+struct Operation
+{
+    const char* name;
+    vector<string> options;
+    string operands;
+};
+
+const vector<Operation> operations =
+{
+    {"gemm",   {"ntch", "ntch"},             "ABC"},
+    {"hemm",   {"lr", "lu", "nc", "ntch"},   "ABC"},
+    {"symm",   {"lr", "lu", "nc", "ntch"},   "ABC"},
+    {"herk",   {"lu", "ntch"},               "AC"},
+    {"syrk",   {"lu", "ntch"},               "AC"},
+    {"trmm",   {"lr", "lu", "ntch", "nu"},   "AB"},
+    {"trsm",   {"lr", "lu", "ntch", "nu"},   "AB"},
+    {"gemv",   {"ntch", "nc"},               "ABC"},
+    {"axpyv",  {"nc"},                       "BC"},
+    {"copyv",  {"nc"},                       "BC"},
+    {"dotv",   {"nc", "nc"},                 "BC"},
+    {"scalv",  {},                           "B"},
+    {"normfv", {},                           "B"},
+    {"axpym",  {"ntch"},                     "AC"},
+    {"copym",  {"ntch"},                     "AC"},
+    {"potrf",  {"lu"},                       "A"},
+    {"getrf",  {},                           "A"},
+    {"trtri",  {"lu", "nu"},                 "A"}
+};
+
+const char OPERANDS[] = "ABC";
+
+const Operation* lookup_operation(const string& name)
+{
+    for (const Operation& op : operations)
+        if (name == op.name) return &op;
+
+    return nullptr;
+}
+
+const Operation& find_operation(const string& name)
+{
+    const Operation* op = lookup_operation(name);
+    if (op) return *op;
+
+    cerr << "Unknown operation: " << name << endl;
+    exit(1);
+}
+
+/*
+ * Every variant of op, leaving out the conjugated ones for real types
+ * (where they duplicate the unconjugated ones).
+ */
+vector<string> all_variants(const Operation& op, bool complex)
+{
+    vector<string> variants(1);
+
+    for (const string& alphabet : op.options)
+    {
+        vector<string> next;
+        for (const string& prefix : variants)
+            for (char c : alphabet)
+                if (complex || (c != 'c' && c != 'h'))
+                    next.push_back(prefix + c);
+        variants.swap(next);
+    }
+
+    return variants;
+}
+
+bool valid_variant(const Operation& op, const string& variant)
+{
+    if (variant.size() != op.options.size()) return false;
+
+    for (size_t i = 0;i < variant.size();i++)
+        if (op.options[i].find(variant[i]) == string::npos) return false;
+
+    return true;
+}
+
+trans_op_t trans_op(char c)
+{
+    switch (c)
+    {
+        case 't': return transpose::T;
+        case 'c': return transpose::C;
+        case 'h': return transpose::H;
+        default:  return trans_op_t();
+    }
+}
+
+bool transposed(char c)
+{
+    return c == 't' || c == 'h';
+}
+
+struct Options
+{
+    vector<string> ops = {"gemm"};
+    string dts = "d";
+    string m = "1000";
+    string n = "0";
+    string k = "0";
+    vector<string> variants;
+    bool all_variants = false;
+    vector<MemoryType> memory[3] = {{MEMORY_DDR_4K}, {MEMORY_DDR_4K}, {MEMORY_DDR_4K}};
+    int reps = 10;
+    int warmup = 2;
+    bool cold = false;
+    bool counters = false;
+    size_t flush_size = CacheFlusher::default_size();
+    vector<double> percentiles = {5, 25, 75, 95};
+    string format = "table";
+    string output;
+    vector<string> replay;
+    size_t replay_top = 0;
+    bool nested = false;
+};
+
+/*
+ * nb is the block size of the lapack operations (0 to choose it as
+ * usual); calls and recorded are the number of calls and the total time
+ * of a replayed shape in the recording.
+ */
+struct Case
+{
+    string op;
+    char dt;
+    string variant;
+    dim_t m, n, k;
+    MemoryType memory[3];
+    dim_t nb;
+    size_t calls;
+    double recorded;
+};
+
+/*
+ * Where an operand actually ended up; used is false for operands the
+ * operation does not have.
+ */
+struct Placement
+{
+    bool used;
+    MemoryType type;
+    size_t page_size;
+    int node;
+};
+
+struct Result
+{
+    Case c;
+    Statistics time;
+    double flops;
+    double bytes;
+    Placement placement[3];
+    CounterValues counters;
+};
+
+/*
+ * Uniform random values in [-1,1) (both parts for complex types) from a
+ * fixed seed, so runs are repeatable.
+ */
+template <typename T>
+typename enable_if<!is_complex<T>::value,T>::type random_value(uint64_t& state)
+{
+    state = state*6364136223846793005ull + 1442695040888963407ull;
+    return T((state >> 11)*(2.0/9007199254740992.0) - 1);
+}
+
+template <typename T>
+typename enable_if<is_complex<T>::value,T>::type random_value(uint64_t& state)
+{
+    typedef real_type_t<T> R;
+    R re = random_value<R>(state);
+    R im = random_value<R>(state);
+    return T(re, im);
+}
+
+/*
+ * Fill the stored elements of A, adding diag to the diagonal (to keep
+ * triangular solves well conditioned).
+ */
+template <typename T, typename Allocator>
+void randomize(Matrix<T,Allocator>& A, double diag = 0)
+{
+    static uint64_t state = 1;
+
+    T* p = A.data();
+    for (dim_t j = 0;j < A.width();j++)
+        for (dim_t i = 0;i < A.length();i++)
+            p[i*A.row_stride() + j*A.col_stride()] =
+                random_value<T>(state) + (i == j ? T(diag) : T(0));
+}
+
+double clock_bias()
+{
+    double bias = numeric_limits<double>::max();
+    for (int r = 0;r < 100;r++)
+    {
+        double t0 = bli_clock();
+        double t1 = bli_clock();
+        bias = min(bias, t1-t0);
+    }
+    return bias;
+}
+
+template <typename T>
+Result run_case(const Options& opt, const Case& c, CacheFlusher* flusher,
+                PerfCounters* counters)
+{
+    typedef real_type_t<T> R;
+
+    const string& v = c.variant;
+    dim_t m = c.m, n = c.n, k = c.k;
+
+    Matrix<T> A, B, C, A0, B0, x, y;
+    PlacedMemory<T> mem[3], mem_a0, mem_b0;
+    vector<dim_t> ipiv;
+    Scalar<T> alpha(1.0), beta(1.0), rho(0.0), scale(-1.0);
+    Scalar<R> norm(0.0);
+    obj_t a, cobj;
+
+    function<void()> call;
+    function<void()> reset = []{};
+    double flops = 0;
+    double elems = 0;
+
+    /*
+     * Every operand is a view of a buffer of its requested memory type.
+     */
+    auto place = [&](Matrix<T>& M, PlacedMemory<T>& buf, MemoryType type,
+                     dim_t m, dim_t n)
+    {
+        M.reset(m, n, buf.reset(type, m*n));
+    };
+    auto operand = [&](Matrix<T>& M, int i, dim_t m, dim_t n)
+    {
+        place(M, mem[i], c.memory[i], m, n);
+    };
+
+    if (c.op == "gemm")
+    {
+        operand(A, 0, transposed(v[0]) ? k : m, transposed(v[0]) ? m : k);
+        operand(B, 1, transposed(v[1]) ? n : k, transposed(v[1]) ? k : n);
+        operand(C, 2, m, n);
+        randomize(A);
+        randomize(B);
+        randomize(C);
+        A.conjtrans(trans_op(v[0]));
+        B.conjtrans(trans_op(v[1]));
+
+        call = [&] { bli_gemm(alpha, A, B, beta, C); };
+        flops = 2.0*m*n*k;
+        elems = m*k + k*n + 2.0*m*n;
+    }
+    else if (c.op == "hemm" || c.op == "symm")
+    {
+        side_t side = v[0] == 'l' ? BLIS_LEFT : BLIS_RIGHT;
+        dim_t ma = side == BLIS_LEFT ? m : n;
+
+        operand(A, 0, ma, ma);
+        operand(B, 1, transposed(v[3]) ? n : m, transposed(v[3]) ? m : n);
+        operand(C, 2, m, n);
+        randomize(A);
+        randomize(B);
+        randomize(C);
+        A.conjugate(v[2] == 'c');
+        B.conjtrans(trans_op(v[3]));
+
+        a = *static_cast<obj_t*>(A);
+        bli_obj_set_struc(c.op == "hemm" ? BLIS_HERMITIAN : BLIS_SYMMETRIC, a);
+        bli_obj_set_uplo(v[1] == 'l' ? BLIS_LOWER : BLIS_UPPER, a);
+
+        if (c.op == "hemm")
+            call = [&,side] { bli_hemm(side, alpha, &a, B, beta, C); };
+        else
+            call = [&,side] { bli_symm(side, alpha, &a, B, beta, C); };
+        flops = 2.0*m*n*ma;
+        elems = ma*ma + 3.0*m*n;
+    }
+    else if (c.op == "herk" || c.op == "syrk")
+    {
+        operand(A, 0, transposed(v[1]) ? k : m, transposed(v[1]) ? m : k);
+        operand(C, 2, m, m);
+        randomize(A);
+        randomize(C);
+        A.conjtrans(trans_op(v[1]));
+
+        cobj = *static_cast<obj_t*>(C);
+        bli_obj_set_struc(c.op == "herk" ? BLIS_HERMITIAN : BLIS_SYMMETRIC, cobj);
+        bli_obj_set_uplo(v[0] == 'l' ? BLIS_LOWER : BLIS_UPPER, cobj);
+
+        if (c.op == "herk")
+            call = [&] { bli_herk(alpha, A, beta, &cobj); };
+        else
+            call = [&] { bli_syrk(alpha, A, beta, &cobj); };
+        flops = 1.0*m*(m+1)*k;
+        elems = m*k + 1.0*m*(m+1);
+    }
+    else if (c.op == "trmm" || c.op == "trsm")
+    {
+        side_t side = v[0] == 'l' ? BLIS_LEFT : BLIS_RIGHT;
+        dim_t ma = side == BLIS_LEFT ? m : n;
+
+        operand(A, 0, ma, ma);
+        operand(B, 1, m, n);
+        place(B0, mem_b0, c.memory[1], m, n);
+        randomize(A, ma);
+        randomize(B0);
+
+        a = *static_cast<obj_t*>(A);
+        bli_obj_set_struc(BLIS_TRIANGULAR, a);
+        bli_obj_set_uplo(v[1] == 'l' ? BLIS_LOWER : BLIS_UPPER, a);
+        bli_obj_set_conjtrans(trans_op(v[2]), a);
+        bli_obj_set_diag(v[3] == 'u' ? BLIS_UNIT_DIAG : BLIS_NONUNIT_DIAG, a);
+
+        /*
+         * B is overwritten, so restore it (untimed) before every run.
+         */
+        reset = [&] { bli_copym(B0, B); };
+        if (c.op == "trmm")
+            call = [&,side] { bli_trmm(side, alpha, &a, B); };
+        else
+            call = [&,side] { bli_trsm(side, alpha, &a, B); };
+        flops = 1.0*m*n*ma;
+        elems = ma*(ma+1)/2.0 + 2.0*m*n;
+    }
+    else if (c.op == "axpym" || c.op == "copym")
+    {
+        operand(A, 0, transposed(v[0]) ? n : m, transposed(v[0]) ? m : n);
+        operand(C, 2, m, n);
+        randomize(A);
+        randomize(C);
+        A.conjtrans(trans_op(v[0]));
+
+        if (c.op == "axpym")
+        {
+            call = [&] { bli_axpym(alpha, A, C); };
+            flops = 2.0*m*n;
+            elems = 3.0*m*n;
+        }
+        else
+        {
+            call = [&] { bli_copym(A, C); };
+            elems = 2.0*m*n;
+        }
+    }
+    else if (c.op == "potrf" || c.op == "getrf" || c.op == "trtri")
+    {
+        if (c.op != "getrf") n = m;
+
+        operand(A, 0, m, n);
+        place(A0, mem_a0, c.memory[0], m, n);
+        randomize(A0, c.op == "getrf" ? 0 : 2.0*m);
+
+        /*
+         * A is overwritten, so restore it (untimed) before every run. A
+         * real diagonal of 2m makes it Hermitian positive definite for
+         * potrf (which only reads one triangle) and well conditioned for
+         * trtri.
+         */
+        if (c.op == "potrf")
+        {
+            T* p = A0.data();
+            for (dim_t i = 0;i < m;i++)
+                p[i*(A0.row_stride() + A0.col_stride())] = T(2.0*m);
+        }
+        reset = [&] { bli_copym(A0, A); };
+
+        uplo_t uplo = v.size() > 0 && v[0] == 'u' ? BLIS_UPPER : BLIS_LOWER;
+        diag_t diag = v.size() > 1 && v[1] == 'u' ? BLIS_UNIT_DIAG : BLIS_NONUNIT_DIAG;
+        dim_t nb = c.nb;
+
+        if (c.op == "potrf")
+        {
+            call = [&,uplo,nb] { lapack::potrf(uplo, A, nb); };
+            flops = m*(double)m*m/3;
+        }
+        else if (c.op == "getrf")
+        {
+            dim_t mn = min(m, n);
+            call = [&,nb] { lapack::getrf(A, ipiv, nb); };
+            flops = 2*(m*(double)n*mn - (m+n)*(double)mn*mn/2 + (double)mn*mn*mn/3);
+        }
+        else
+        {
+            call = [&,uplo,diag,nb] { lapack::trtri(uplo, diag, A, nb); };
+            flops = m*(double)m*m/3;
+        }
+        elems = 2.0*m*n;
+    }
+    else if (c.op == "gemv")
+    {
+        bool trans = transposed(v[0]);
+
+        operand(A, 0, trans ? n : m, trans ? m : n);
+        operand(x, 1, trans ? m : n, 1);
+        operand(y, 2, trans ? n : m, 1);
+        randomize(A);
+        randomize(x);
+        randomize(y);
+        A.conjtrans(trans_op(v[0]));
+        x.conjugate(v[1] == 'c');
+
+        call = [&] { bli_gemv(alpha, A, x, beta, y); };
+        flops = 2.0*m*n;
+        elems = m*n + x.length() + 2.0*y.length();
+    }
+    else
+    {
+        operand(x, 1, m, 1);
+        operand(y, 2, m, 1);
+        randomize(x);
+        randomize(y);
+        if (!v.empty()) x.conjugate(v[0] == 'c');
+        if (v.size() > 1) y.conjugate(v[1] == 'c');
+
+        if (c.op == "axpyv")
+        {
+            call = [&] { bli_axpyv(alpha, x, y); };
+            flops = 2.0*m;
+            elems = 3.0*m;
+        }
+        else if (c.op == "copyv")
+        {
+            call = [&] { bli_copyv(x, y); };
+            elems = 2.0*m;
+        }
+        else if (c.op == "dotv")
+        {
+            call = [&] { bli_dotv(x, y, rho); };
+            flops = 2.0*m;
+            elems = 2.0*m;
+        }
+        else if (c.op == "scalv")
+        {
+            /*
+             * BLIS returns straight away when alpha is 1, and repeated
+             * scaling by anything but -1 would drift into denormals.
+             */
+            call = [&] { bli_scalv(scale, x); };
+            flops = m;
+            elems = 2.0*m;
+        }
+        else
+        {
+            call = [&] { bli_normfv(x, norm); };
+            flops = 2.0*m;
+            elems = m;
+        }
+    }
+
+    if (is_complex<T>::value) flops *= 4;
+
+    for (int r = 0;r < opt.warmup;r++)
+    {
+        reset();
+        call();
+    }
+
+    double bias = clock_bias();
+
+    vector<double> samples;
+    CounterValues counts;
+    for (int r = 0;r < opt.reps;r++)
+    {
+        reset();
+        if (flusher) flusher->flush();
+
+        /*
+         * The counters are started and stopped outside of the timed
+         * region, so that the system calls do not show up in the times.
+         */
+        if (counters) counters->start();
+
+        double t0 = bli_clock();
+        call();
+        double t1 = bli_clock();
+
+        if (counters) counts += counters->stop();
+
+        samples.push_back(max(t1-t0-bias, 0.0));
+    }
+
+    counts /= opt.reps;
+
+    Result result{c, summarize(samples, opt.percentiles), flops, elems*sizeof(T),
+                  {}, counts};
+
+    /*
+     * The page size and node are looked up only now that every page has
+     * been touched.
+     */
+    const string& operands = find_operation(c.op).operands;
+    for (int i = 0;i < 3;i++)
+        result.placement[i] = {operands.find(OPERANDS[i]) != string::npos,
+                               mem[i].type(), mem[i].page_size(), mem[i].numa_node()};
+
+    return result;
+}
+
+class Reporter
+{
+    private:
+        FILE* _out;
+        string _format;
+        vector<double> _percentiles;
+        bool _replay;
+        bool _first = true;
+
+        static string label(double p)
+        {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "p%g", p);
+            return buf;
+        }
+
+    public:
+        Reporter(FILE* out, const string& format, const vector<double>& percentiles,
+                 bool replay)
+        : _out(out), _format(format), _percentiles(percentiles), _replay(replay)
+        {
+            if (_format == "csv")
+            {
+                fprintf(_out, "op,dt,variant,m,n,k,reps,min,median,mean,max,stddev,variance");
+                for (double p : _percentiles) fprintf(_out, ",%s", label(p).c_str());
+                fprintf(_out, ",gflops,gbytes_per_s");
+                for (char o : string(OPERANDS))
+                    fprintf(_out, ",mem_%c,page_%c,node_%c", tolower(o), tolower(o), tolower(o));
+                for (int i = 0;i < COUNTER_EVENTS;i++)
+                    fprintf(_out, ",%s", counter_name(CounterEvent(i)));
+                if (_replay) fprintf(_out, ",calls,recorded");
+                fprintf(_out, "\n");
+            }
+            else if (_format == "json")
+            {
+                fprintf(_out, "[");
+            }
+            else
+            {
+                fprintf(_out, "%-7s %2s %-5s %7s %7s %7s %11s", "op", "dt", "var",
+                        "m", "n", "k", "median(ms)");
+                for (double p : _percentiles)
+                    fprintf(_out, " %9s", (label(p) + "(ms)").c_str());
+                fprintf(_out, " %10s %9s %9s", "stddev(ms)", "GFLOPS", "GB/s");
+                if (_replay) fprintf(_out, " %8s %12s", "calls", "recorded(ms)");
+                fprintf(_out, "  %s\n", "memory/page/node");
+            }
+        }
+
+        ~Reporter()
+        {
+            if (_format == "json") fprintf(_out, "\n]\n");
+            fflush(_out);
+        }
+
+        void report(const Result& r)
+        {
+            const Statistics& s = r.time;
+            double gflops = s.median > 0 ? r.flops*1e-9/s.median : 0;
+            double gbs = s.median > 0 ? r.bytes*1e-9/s.median : 0;
+            const char* variant = r.c.variant.empty() ? "-" : r.c.variant.c_str();
+
+            if (_format == "csv")
+            {
+                fprintf(_out, "%s,%c,%s,%ld,%ld,%ld,%zu,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g",
+                        r.c.op.c_str(), r.c.dt, variant, (long)r.c.m, (long)r.c.n,
+                        (long)r.c.k, s.count,
+                        s.min, s.median, s.mean, s.max, s.stddev, s.variance);
+                for (double x : s.percentiles) fprintf(_out, ",%.9g", x);
+                fprintf(_out, ",%.6g,%.6g", gflops, gbs);
+                for (const Placement& p : r.placement)
+                {
+                    if (p.used)
+                        fprintf(_out, ",%s,%zu,%d", memory_type_name(p.type), p.page_size, p.node);
+                    else
+                        fprintf(_out, ",,,");
+                }
+                for (int i = 0;i < COUNTER_EVENTS;i++)
+                {
+                    if (r.counters.available[i])
+                        fprintf(_out, ",%.6g", r.counters.value[i]);
+                    else
+                        fprintf(_out, ",");
+                }
+                if (_replay) fprintf(_out, ",%zu,%.9g", r.c.calls, r.c.recorded);
+                fprintf(_out, "\n");
+            }
+            else if (_format == "json")
+            {
+                fprintf(_out, "%s\n  {\"op\": \"%s\", \"dt\": \"%c\", \"variant\": \"%s\", "
+                        "\"m\": %ld, \"n\": %ld, \"k\": %ld, \"reps\": %zu, \"min\": %.9g, "
+                        "\"median\": %.9g, \"mean\": %.9g, \"max\": %.9g, "
+                        "\"stddev\": %.9g, \"variance\": %.9g, \"percentiles\": {",
+                        _first ? "" : ",", r.c.op.c_str(), r.c.dt, variant,
+                        (long)r.c.m, (long)r.c.n, (long)r.c.k, s.count, s.min, s.median,
+                        s.mean, s.max, s.stddev, s.variance);
+                for (size_t i = 0;i < s.percentiles.size();i++)
+                    fprintf(_out, "%s\"%s\": %.9g", i ? ", " : "",
+                            label(_percentiles[i]).c_str(), s.percentiles[i]);
+                fprintf(_out, "}, \"gflops\": %.6g, \"gbytes_per_s\": %.6g, \"memory\": {",
+                        gflops, gbs);
+                bool first = true;
+                for (int i = 0;i < 3;i++)
+                {
+                    const Placement& p = r.placement[i];
+                    if (!p.used) continue;
+                    fprintf(_out, "%s\"%c\": {\"type\": \"%s\", \"page_size\": %zu, "
+                            "\"node\": %d}", first ? "" : ", ", OPERANDS[i],
+                            memory_type_name(p.type), p.page_size, p.node);
+                    first = false;
+                }
+                fprintf(_out, "}, \"counters\": {");
+                first = true;
+                for (int i = 0;i < COUNTER_EVENTS;i++)
+                {
+                    if (!r.counters.available[i]) continue;
+                    fprintf(_out, "%s\"%s\": %.6g", first ? "" : ", ",
+                            counter_name(CounterEvent(i)), r.counters.value[i]);
+                    first = false;
+                }
+                fprintf(_out, "}");
+                if (_replay)
+                    fprintf(_out, ", \"calls\": %zu, \"recorded\": %.9g", r.c.calls,
+                            r.c.recorded);
+                fprintf(_out, "}");
+            }
+            else
+            {
+                fprintf(_out, "%-7s %2c %-5s %7ld %7ld %7ld %11.4f", r.c.op.c_str(),
+                        r.c.dt, variant, (long)r.c.m, (long)r.c.n, (long)r.c.k,
+                        s.median*1e3);
+                for (double x : s.percentiles) fprintf(_out, " %9.4f", x*1e3);
+                fprintf(_out, " %10.4f %9.3f %9.3f", s.stddev*1e3, gflops, gbs);
+                if (_replay) fprintf(_out, " %8zu %12.4f", r.c.calls, r.c.recorded*1e3);
+                fprintf(_out, " ");
+                for (int i = 0;i < 3;i++)
+                {
+                    const Placement& p = r.placement[i];
+                    if (p.used)
+                        fprintf(_out, " %c=%s/%s/%d", OPERANDS[i], memory_type_name(p.type),
+                                page_size_name(p.page_size).c_str(), p.node);
+                }
+                for (int i = 0;i < COUNTER_EVENTS;i++)
+                    if (r.counters.available[i])
+                        fprintf(_out, " %s=%.4g", counter_name(CounterEvent(i)),
+                                r.counters.value[i]);
+                fprintf(_out, "\n");
+            }
+
+            _first = false;
+            fflush(_out);
+        }
+};
+
+void usage(const char* prog)
+{
+    cerr <<
+"Usage: " << prog << " [options]\n"
+"\n"
+"  -o, --op=LIST           operations to time (comma separated, or \"all\"):\n"
+"                          gemm hemm symm herk syrk trmm trsm gemv axpyv\n"
+"                          copyv dotv scalv normfv axpym copym potrf getrf\n"
+"                          trtri (default gemm)\n"
+"  -d, --dt=TYPES          datatypes, any of sdcz (default d)\n"
+"  -m, --m=RANGE           sizes as N, MIN:MAX or MIN:MAX:STEP (default 1000)\n"
+"  -n, --n=RANGE           (default 0, meaning equal to m)\n"
+"  -k, --k=RANGE           (default 0, meaning equal to m)\n"
+"  -v, --variant=LIST      transpose/conjugate/side/uplo/diag variants, e.g.\n"
+"                          nt,hc for gemm, or \"all\" (default: the first)\n"
+"  -r, --reps=N            timed repetitions (default 10)\n"
+"  -w, --warmup=N          untimed runs before timing (default 2)\n"
+"  -M, --memory=LIST       memory types for all operands, any of ddr_4k hbm_4k\n"
+"                          ddr_2m hbm_2m ddr_1g hbm_1g (default ddr_4k)\n"
+"      --mem-a=LIST        memory types for A only (and likewise --mem-b,\n"
+"                          --mem-c; x is placed as B and y as C)\n"
+"  -c, --cold              flush the caches before every timed run\n"
+"  -P, --counters          count hardware events (perf_event_open) during\n"
+"                          the timed runs, falling back to software events\n"
+"  -F, --flush-size=BYTES  bytes written by each flush (default 4x LLC)\n"
+"  -p, --percentiles=LIST  percentiles to report (default 5,25,75,95)\n"
+"  -f, --format=FMT        table, csv or json (default table)\n"
+"  -O, --output=FILE       write results to FILE instead of stdout\n"
+"      --replay=FILES      time the shapes recorded (BLISPP_RECORD) in FILES\n"
+"                          instead of sweeping -o/-d/-m/-n/-k/-v\n"
+"      --replay-top=N      only the N shapes with the most recorded time\n"
+"      --nested            include operations issued by other recorded ones\n"
+"                          (the gemms inside potrf, say)\n"
+"\n"
+"Vector operations use m as the length. Times are reported in seconds in\n"
+"CSV and JSON and milliseconds in the table; GFLOPS and GB/s (compulsory\n"
+"traffic) are computed from the median. Every combination of the memory\n"
+"types given is run, and the page size and NUMA node actually obtained\n"
+"for each operand are reported alongside. Counter values are per run,\n"
+"averaged over the timed runs; counters that could not be opened are left\n"
+"out of the table and JSON and empty in the CSV.\n"
+"\n"
+"A replay runs each distinct recorded shape (operation, datatype, variant\n"
+"and sizes) once, in order of total recorded time, and reports how many\n"
+"calls and how much time it accounted for. Shapes are run with the\n"
+"current threading, whatever the recorded thread count, and operations\n"
+"blis_bench does not time are skipped.\n";
+}
+
+Options parse_options(int argc, char** argv)
+{
+    Options opt;
+
+    static const option longopts[] =
+    {
+        {"op",          required_argument, nullptr, 'o'},
+        {"dt",          required_argument, nullptr, 'd'},
+        {"m",           required_argument, nullptr, 'm'},
+        {"n",           required_argument, nullptr, 'n'},
+        {"k",           required_argument, nullptr, 'k'},
+        {"variant",     required_argument, nullptr, 'v'},
+        {"reps",        required_argument, nullptr, 'r'},
+        {"warmup",      required_argument, nullptr, 'w'},
+        {"memory",      required_argument, nullptr, 'M'},
+        {"mem-a",       required_argument, nullptr, 'A'},
+        {"mem-b",       required_argument, nullptr, 'B'},
+        {"mem-c",       required_argument, nullptr, 'C'},
+        {"cold",        no_argument,       nullptr, 'c'},
+        {"counters",    no_argument,       nullptr, 'P'},
+        {"flush-size",  required_argument, nullptr, 'F'},
+        {"percentiles", required_argument, nullptr, 'p'},
+        {"format",      required_argument, nullptr, 'f'},
+        {"output",      required_argument, nullptr, 'O'},
+        {"replay",      required_argument, nullptr, 'R'},
+        {"replay-top",  required_argument, nullptr, 'T'},
+        {"nested",      no_argument,       nullptr, 'N'},
+        {"help",        no_argument,       nullptr, 'h'},
+        {nullptr,       0,                 nullptr,  0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "o:d:m:n:k:v:r:w:M:cPF:p:f:O:h", longopts, nullptr)) != -1)
+    {
+        switch (c)
+        {
+            case 'o': opt.ops = split_list(optarg); break;
+            case 'd': opt.dts = optarg; break;
+            case 'm': opt.m = optarg; break;
+            case 'n': opt.n = optarg; break;
+            case 'k': opt.k = optarg; break;
+            case 'v':
+                opt.all_variants = string(optarg) == "all";
+                opt.variants = opt.all_variants ? vector<string>() : split_list(optarg);
+                break;
+            case 'r': opt.reps = atoi(optarg); break;
+            case 'w': opt.warmup = atoi(optarg); break;
+            case 'M':
+            case 'A':
+            case 'B':
+            case 'C':
+                {
+                    vector<MemoryType> types;
+                    for (const string& t : split_list(optarg))
+                    {
+                        try
+                        {
+                            types.push_back(parse_memory_type(t));
+                        }
+                        catch (const invalid_argument& e)
+                        {
+                            cerr << e.what() << endl;
+                            exit(1);
+                        }
+                    }
+
+                    for (int i = 0;i < 3;i++)
+                        if (c == 'M' || c == OPERANDS[i]) opt.memory[i] = types;
+                }
+                break;
+            case 'c': opt.cold = true; break;
+            case 'P': opt.counters = true; break;
+            case 'F': opt.flush_size = strtoull(optarg, nullptr, 10); break;
+            case 'p':
+                opt.percentiles.clear();
+                for (const string& p : split_list(optarg)) opt.percentiles.push_back(stod(p));
+                break;
+            case 'f': opt.format = optarg; break;
+            case 'O': opt.output = optarg; break;
+            case 'R': opt.replay = split_list(optarg); break;
+            case 'T': opt.replay_top = strtoull(optarg, nullptr, 10); break;
+            case 'N': opt.nested = true; break;
+            case 'h': usage(argv[0]); exit(0);
+            default:  usage(argv[0]); exit(1);
+        }
+    }
+
+    if (opt.ops.size() == 1 && opt.ops[0] == "all")
+    {
+        opt.ops.clear();
+        for (const Operation& op : operations) opt.ops.push_back(op.name);
+    }
+
+    for (char dt : opt.dts)
+    {
+        if (string("sdcz").find(dt) == string::npos)
+        {
+            cerr << "Unknown datatype: " << dt << endl;
+            exit(1);
+        }
+    }
+
+    if (opt.format != "table" && opt.format != "csv" && opt.format != "json")
+    {
+        cerr << "Unknown format: " << opt.format << endl;
+        exit(1);
+    }
+
+    for (const vector<MemoryType>& types : opt.memory)
+    {
+        if (types.empty())
+        {
+            cerr << "No memory type given" << endl;
+            exit(1);
+        }
+    }
+
+    if (opt.reps < 1)
+    {
+        cerr << "At least one repetition is required" << endl;
+        exit(1);
+    }
+
+    return opt;
+}
+
+/*
+ * Every combination of the memory types given, sweeping only the
+ * placements of operands the operation has.
+ */
+vector<array<MemoryType,3>> memory_combinations(const Options& opt, const Operation& op)
+{
+    vector<MemoryType> memory[3];
+    for (int i = 0;i < 3;i++)
+    {
+        memory[i] = opt.memory[i];
+        if (op.operands.find(OPERANDS[i]) == string::npos)
+            memory[i].resize(1);
+    }
+
+    vector<array<MemoryType,3>> combinations;
+    for (MemoryType mem_a : memory[0])
+    for (MemoryType mem_b : memory[1])
+    for (MemoryType mem_c : memory[2])
+        combinations.push_back({{mem_a, mem_b, mem_c}});
+
+    return combinations;
+}
+
+Result run_case(const Options& opt, const Case& c, CacheFlusher* flusher,
+                PerfCounters* counters)
+{
+    switch (c.dt)
+    {
+        case 's': return run_case<   float>(opt, c, flusher, counters);
+        case 'd': return run_case<  double>(opt, c, flusher, counters);
+        case 'c': return run_case<sComplex>(opt, c, flusher, counters);
+        default:  return run_case<dComplex>(opt, c, flusher, counters);
+    }
+}
+
+/*
+ * Every combination of the operations, datatypes, variants, memory types
+ * and sizes given.
+ */
+vector<Case> sweep_cases(const Options& opt)
+{
+    vector<Case> cases;
+
+    for (const string& name : opt.ops)
+    {
+        const Operation& op = find_operation(name);
+
+        for (char dt : opt.dts)
+        {
+            bool complex = dt == 'c' || dt == 'z';
+
+            /*
+             * Variants given on the command line apply to the operations
+             * they are valid for.
+             */
+            vector<string> variants;
+            if (opt.all_variants)
+            {
+                variants = all_variants(op, complex);
+            }
+            else if (opt.variants.empty())
+            {
+                variants.push_back(all_variants(op, false)[0]);
+            }
+            else
+            {
+                for (const string& variant : opt.variants)
+                    if (valid_variant(op, variant)) variants.push_back(variant);
+
+                if (variants.empty())
+                {
+                    cerr << "No valid variant for " << name << endl;
+                    exit(1);
+                }
+            }
+
+            for (const string& variant : variants)
+            for (const array<MemoryType,3>& memory : memory_combinations(opt, op))
+            for (dim_t m : parse_range(opt.m))
+            for (dim_t n : parse_range(opt.n))
+            for (dim_t k : parse_range(opt.k))
+                cases.push_back(Case{name, dt, variant, m, n > 0 ? n : m, k > 0 ? k : m,
+                                     {memory[0], memory[1], memory[2]}, 0, 0, 0.0});
+        }
+    }
+
+    return cases;
+}
+
+/*
+ * The histogram of the shapes in the recordings, most recorded time
+ * first. Conjugation is dropped from the variants of real operations,
+ * where it makes no difference.
+ */
+vector<Case> replay_cases(const Options& opt)
+{
+    typedef tuple<string,char,string,dim_t,dim_t,dim_t> Shape;
+    map<Shape,Case> shapes;
+    size_t nested = 0, skipped = 0;
+
+    for (const string& path : opt.replay)
+    {
+        vector<ShapeRecord> records;
+        try
+        {
+            records = read_shape_records(path);
+        }
+        catch (const runtime_error& e)
+        {
+            cerr << e.what() << endl;
+            exit(1);
+        }
+
+        for (const ShapeRecord& r : records)
+        {
+            if (r.nested && !opt.nested)
+            {
+                nested++;
+                continue;
+            }
+
+            string variant = r.variant;
+            if (r.dt == 's' || r.dt == 'd')
+            {
+                for (char& v : variant)
+                {
+                    if (v == 'c') v = 'n';
+                    if (v == 'h') v = 't';
+                }
+            }
+
+            const Operation* op = lookup_operation(r.op);
+            if (!op || string("sdcz").find(r.dt) == string::npos ||
+                !valid_variant(*op, variant))
+            {
+                skipped++;
+                continue;
+            }
+
+            Shape shape(r.op, r.dt, variant, r.m, r.n, r.k);
+            auto it = shapes.find(shape);
+            if (it == shapes.end())
+            {
+                bool lapack = op->operands == "A";
+                Case c{r.op, r.dt, variant, r.m, r.n, r.k, {}, lapack ? (dim_t)r.k : 0, 0, 0.0};
+                it = shapes.insert(make_pair(shape, c)).first;
+            }
+
+            it->second.calls++;
+            it->second.recorded += r.seconds;
+        }
+    }
+
+    if (nested)
+        cerr << "Left out " << nested << " nested calls (see --nested)" << endl;
+    if (skipped)
+        cerr << "Skipped " << skipped << " calls to operations blis_bench does not time" << endl;
+
+    vector<Case> histogram;
+    for (auto& shape : shapes) histogram.push_back(shape.second);
+
+    stable_sort(histogram.begin(), histogram.end(),
+                [](const Case& a, const Case& b) { return a.recorded > b.recorded; });
+    if (opt.replay_top > 0 && histogram.size() > opt.replay_top)
+        histogram.resize(opt.replay_top);
+
+    vector<Case> cases;
+    for (const Case& shape : histogram)
+    {
+        for (const array<MemoryType,3>& memory : memory_combinations(opt, find_operation(shape.op)))
+        {
+            Case c = shape;
+            copy(memory.begin(), memory.end(), c.memory);
+            cases.push_back(c);
+        }
+    }
+
+    return cases;
+}
+
+int main(int argc, char** argv)
+{
+    Options opt = parse_options(argc, argv);
+
+    bli_init();
+
+    FILE* out = stdout;
+    if (!opt.output.empty() && !(out = fopen(opt.output.c_str(), "w")))
+    {
+        perror(opt.output.c_str());
+        exit(1);
+    }
+
+    unique_ptr<CacheFlusher> flusher;
+    if (opt.cold) flusher.reset(new CacheFlusher(opt.flush_size));
+
+    unique_ptr<PerfCounters> counters;
+    if (opt.counters)
+    {
+        counters.reset(new PerfCounters);
+        if (!counters->hardware())
+            cerr << "Hardware counters unavailable, counting software events only" << endl;
+    }
+
+    {
+        vector<Case> cases = opt.replay.empty() ? sweep_cases(opt) : replay_cases(opt);
+
+        Reporter reporter(out, opt.format, opt.percentiles, !opt.replay.empty());
+
+        for (const Case& c : cases)
+            reporter.report(run_case(opt, c, flusher.get(), counters.get()));
+    }
+
+    if (out != stdout) fclose(out);
+
+    bli_finalize();
+
+    return 0;
+}
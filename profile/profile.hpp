@@ -0,0 +1,468 @@
+#ifndef _BLISPP_PROFILE_HPP_
+#define _BLISPP_PROFILE_HPP_
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "blis++.hpp"
+
+/*
+ * Helpers shared by the profiling drivers.
+ */
+
+class range
+{
+    public:
+        class range_iterator : std::iterator<std::random_access_iterator_tag,dim_t,inc_t,dim_t*,dim_t>
+        {
+            private:
+                typedef std::iterator<std::random_access_iterator_tag,dim_t,inc_t,dim_t*,dim_t> iterator_base_;
+
+            public:
+                using typename iterator_base_::value_type;
+                using typename iterator_base_::difference_type;
+                using typename iterator_base_::pointer;
+                using typename iterator_base_::reference;
+                using typename iterator_base_::iterator_category;
+
+                range_iterator()
+                : pos_(0), delta_(0) {}
+
+                range_iterator(dim_t pos, inc_t delta)
+                : pos_(pos), delta_(delta) {}
+
+                range_iterator(const range_iterator& other) = default;
+
+                range_iterator& operator=(const range_iterator& other) = default;
+
+                range_iterator& operator++()
+                {
+                    pos_ += delta_;
+                    return *this;
+                }
+
+                range_iterator& operator--()
+                {
+                    pos_ -= delta_;
+                    return *this;
+                }
+
+                range_iterator operator++(int x)
+                {
+                    range_iterator old(*this);
+                    ++old;
+                    return old;
+                }
+
+                range_iterator operator--(int x)
+                {
+                    range_iterator old(*this);
+                    --old;
+                    return old;
+                }
+
+                reference operator*() const
+                {
+                    return pos_;
+                }
+
+                pointer operator->() const
+                {
+                    return nullptr;
+                }
+
+                range_iterator& operator+=(difference_type n)
+                {
+                    pos_ += n*delta_;
+                    return *this;
+                }
+
+                range_iterator& operator-=(difference_type n)
+                {
+                    pos_ -= n*delta_;
+                    return *this;
+                }
+
+                range_iterator operator+(difference_type n) const
+                {
+                    range_iterator ret(*this);
+                    ret += n;
+                    return ret;
+                }
+
+                friend range_iterator operator+(difference_type n, const range_iterator& x)
+                {
+                    range_iterator ret(x);
+                    ret += n;
+                    return ret;
+                }
+
+                range_iterator operator-(difference_type n) const
+                {
+                    range_iterator ret(*this);
+                    ret -= n;
+                    return ret;
+                }
+
+                difference_type operator-(const range_iterator& x) const
+                {
+                    return pos_ - x.pos_;
+                }
+
+                reference operator[](difference_type i) const
+                {
+                    return pos_ + i*delta_;
+                }
+
+                bool operator==(const range_iterator& other) const
+                {
+                    return pos_ == other.pos_;
+                }
+
+                bool operator!=(const range_iterator& other) const
+                {
+                    return !(*this == other);
+                }
+
+                bool operator<(const range_iterator& other) const
+                {
+                    return pos_ < other.pos_;
+                }
+
+                bool operator>(const range_iterator& other) const
+                {
+                    return other < *this;
+                }
+
+                bool operator<=(const range_iterator& other) const
+                {
+                    return !(other < *this);
+                }
+
+                bool operator>=(const range_iterator& other) const
+                {
+                    return !(*this < other);
+                }
+
+            private:
+                dim_t pos_;
+                inc_t delta_;
+        };
+
+        range(dim_t start, dim_t stop, inc_t delta)
+        : start_(start), stop_(stop), delta_(delta == 0 ? stop-start : delta) {}
+
+        range_iterator begin() const
+        {
+            return range_iterator(start_, delta_);
+        }
+
+        range_iterator end() const
+        {
+            return range_iterator(stop_+delta_, delta_);
+        }
+
+        range_iterator cbegin() const
+        {
+            return range_iterator(stop_, -delta_);
+        }
+
+        range_iterator cend() const
+        {
+            return range_iterator(start_-delta_, -delta_);
+        }
+
+    private:
+        dim_t start_, stop_;
+        inc_t delta_;
+};
+
+inline range parse_range(const std::string& s)
+{
+    dim_t mn, mx;
+    inc_t delta = 1;
+
+    size_t colon1 = s.find(':');
+    size_t colon2 = s.find(':', colon1 == std::string::npos ? colon1 : colon1+1);
+
+    if (colon1 == std::string::npos)
+    {
+        mn = mx = std::stol(s);
+    }
+    else if (colon2 == std::string::npos)
+    {
+        mn = std::stol(s.substr(0,colon1));
+        mx = std::stol(s.substr(colon1+1));
+    }
+    else
+    {
+        mn = std::stol(s.substr(0,colon1));
+        mx = std::stol(s.substr(colon1+1,colon2-colon1-1));
+        delta = std::stol(s.substr(colon2+1));
+    }
+
+    return range(mn, mx, delta);
+}
+
+inline std::vector<std::string> split_list(const std::string& s, char sep = ',')
+{
+    std::vector<std::string> items;
+
+    size_t pos = 0;
+    while (pos <= s.size())
+    {
+        size_t next = s.find(sep, pos);
+        if (next == std::string::npos) next = s.size();
+        if (next > pos) items.push_back(s.substr(pos, next-pos));
+        pos = next+1;
+    }
+
+    return items;
+}
+
+/*
+ * Summary of a set of timings. Percentiles interpolate linearly between
+ * the order statistics; the variance is the unbiased sample variance.
+ */
+struct Statistics
+{
+    size_t count = 0;
+    double min = 0;
+    double max = 0;
+    double mean = 0;
+    double median = 0;
+    double variance = 0;
+    double stddev = 0;
+    std::vector<double> percentiles;
+};
+
+inline double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty()) return 0;
+
+    double pos = std::min(std::max(p, 0.0), 100.0)/100*(sorted.size()-1);
+    size_t lo = (size_t)pos;
+    size_t hi = std::min(lo+1, sorted.size()-1);
+
+    return sorted[lo] + (pos-lo)*(sorted[hi]-sorted[lo]);
+}
+
+inline Statistics summarize(std::vector<double> samples, const std::vector<double>& pct)
+{
+    Statistics s;
+    if (samples.empty()) return s;
+
+    std::sort(samples.begin(), samples.end());
+
+    size_t n = samples.size();
+    s.count = n;
+    s.min = samples.front();
+    s.max = samples.back();
+    s.median = percentile(samples, 50);
+
+    for (double x : samples) s.mean += x;
+    s.mean /= n;
+
+    for (double x : samples) s.variance += (x-s.mean)*(x-s.mean);
+    s.variance = n > 1 ? s.variance/(n-1) : 0;
+    s.stddev = std::sqrt(s.variance);
+
+    for (double p : pct) s.percentiles.push_back(percentile(samples, p));
+
+    return s;
+}
+
+/*
+ * Evicts the caches before a cold run by having every thread of the pool
+ * write and read back its share of a buffer several times the size of
+ * the last-level cache.
+ */
+class CacheFlusher
+{
+    private:
+        std::vector<double> _buffer;
+        volatile double _sink = 0;
+
+    public:
+        static size_t default_size()
+        {
+            long llc = -1;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+            llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+            return llc > 0 ? 4*(size_t)llc : (size_t)64 << 20;
+        }
+
+        explicit CacheFlusher(size_t bytes = default_size())
+        : _buffer(bytes/sizeof(double), 1.0) {}
+
+        void flush()
+        {
+            blis::ThreadPool& pool = blis::ThreadPool::instance();
+            std::vector<double> sums(pool.num_threads());
+
+            pool.run([&](int tid, int nthreads)
+            {
+                size_t n = _buffer.size();
+                size_t first = n*tid/nthreads;
+                size_t last = n*(tid+1)/nthreads;
+
+                double sum = 0;
+                for (size_t i = first;i < last;i++)
+                {
+                    _buffer[i] += 1.0;
+                    sum += _buffer[i];
+                }
+                sums[tid] = sum;
+            });
+
+            for (double s : sums) _sink += s;
+        }
+};
+
+/*
+ * Memory types by name: ddr_4k, hbm_4k, ddr_2m, hbm_2m, ddr_1g and hbm_1g
+ * (case insensitive), with ddr and hbm meaning the 4K variants.
+ */
+inline const char* memory_type_name(blis::MemoryType type)
+{
+    switch (type)
+    {
+        case blis::MEMORY_DDR_4K: return "ddr_4k";
+        case blis::MEMORY_HBM_4K: return "hbm_4k";
+        case blis::MEMORY_DDR_2M: return "ddr_2m";
+        case blis::MEMORY_HBM_2M: return "hbm_2m";
+        case blis::MEMORY_DDR_1G: return "ddr_1g";
+        case blis::MEMORY_HBM_1G: return "hbm_1g";
+    }
+    return "unknown";
+}
+
+inline blis::MemoryType parse_memory_type(std::string s)
+{
+    for (char& c : s) c = tolower(c);
+
+    if (s == "ddr") return blis::MEMORY_DDR;
+    if (s == "hbm") return blis::MEMORY_HBM;
+
+    for (blis::MemoryType type : {blis::MEMORY_DDR_4K, blis::MEMORY_HBM_4K,
+                                  blis::MEMORY_DDR_2M, blis::MEMORY_HBM_2M,
+                                  blis::MEMORY_DDR_1G, blis::MEMORY_HBM_1G})
+        if (s == memory_type_name(type)) return type;
+
+    throw std::invalid_argument("unknown memory type: " + s);
+}
+
+/*
+ * Page sizes as 4K, 2M, 1G.
+ */
+inline std::string page_size_name(size_t size)
+{
+    const char* units = "BKMG";
+    int unit = 0;
+    while (unit < 3 && size >= 1024 && size%1024 == 0)
+    {
+        size /= 1024;
+        unit++;
+    }
+
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%zu%c", size, units[unit]);
+    return buf;
+}
+
+/*
+ * A buffer whose memory type is chosen at run time, so that a driver can
+ * sweep placements without being rebuilt for each one. The page size and
+ * NUMA node reported are what was actually obtained, which may differ
+ * from what was asked for when huge pages or high-bandwidth memory are
+ * not available; both are only meaningful once the buffer has been
+ * written.
+ */
+template <typename T>
+class PlacedMemory
+{
+    private:
+        std::shared_ptr<void> _mem;
+        T* _ptr = nullptr;
+        blis::MemoryType _type = blis::MEMORY_DDR_4K;
+
+        template <blis::MemoryType Type>
+        void allocate(size_t n)
+        {
+            auto mem = std::make_shared<blis::Memory<T,blis::AlignedAllocator<T,Type>>>(n);
+            _ptr = *mem;
+            _mem = mem;
+        }
+
+    public:
+        PlacedMemory() {}
+
+        PlacedMemory(blis::MemoryType type, size_t n)
+        {
+            reset(type, n);
+        }
+
+        T* reset(blis::MemoryType type, size_t n)
+        {
+            _mem.reset();
+            _ptr = nullptr;
+            _type = type;
+
+            if (n == 0) return _ptr;
+
+            switch (type)
+            {
+                case blis::MEMORY_DDR_4K: allocate<blis::MEMORY_DDR_4K>(n); break;
+                case blis::MEMORY_HBM_4K: allocate<blis::MEMORY_HBM_4K>(n); break;
+                case blis::MEMORY_DDR_2M: allocate<blis::MEMORY_DDR_2M>(n); break;
+                case blis::MEMORY_HBM_2M: allocate<blis::MEMORY_HBM_2M>(n); break;
+                case blis::MEMORY_DDR_1G: allocate<blis::MEMORY_DDR_1G>(n); break;
+                case blis::MEMORY_HBM_1G: allocate<blis::MEMORY_HBM_1G>(n); break;
+            }
+
+            return _ptr;
+        }
+
+        T* data() const
+        {
+            return _ptr;
+        }
+
+        blis::MemoryType type() const
+        {
+            return _type;
+        }
+
+        size_t page_size() const
+        {
+            return _ptr ? blis::detail::backing_page_size(_ptr) : 0;
+        }
+
+        int numa_node() const
+        {
+            return _ptr ? blis::detail::numa_node_of(_ptr) : -1;
+        }
+
+        /*
+         * Type, page size and node, e.g. hbm_2m/2M/1 (or hbm_2m/4K/0 if
+         * neither huge pages nor MCDRAM could be had).
+         */
+        std::string describe() const
+        {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "%s/%s/%d", memory_type_name(_type),
+                     page_size_name(page_size()).c_str(), numa_node());
+            return buf;
+        }
+};
+
+#endif
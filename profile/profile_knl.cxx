@@ -3,216 +3,36 @@
 #include <iostream>
 #include <limits>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include "blis++.hpp"
+#include "profile.hpp"
 
 using namespace std;
 using namespace blis;
 
-template <typename T>
-using AlignedMatrix = Matrix<T,AlignedAllocator<T,MEMORY_HBM>>;
-
 #define NREPEAT 5
 
-class range
+/*
+ * Each input line is
+ *
+ *     dt m_range n_range k_range [mem_A [mem_B mem_C]]
+ *
+ * where the optional memory types (see parse_memory_type) place A, B and
+ * C; a single type applies to all three, and the default is hbm_4k.
+ */
+struct Placement
 {
-    public:
-        class range_iterator : std::iterator<std::random_access_iterator_tag,dim_t,inc_t,dim_t*,dim_t>
-        {
-            private:
-                typedef std::iterator<std::random_access_iterator_tag,dim_t,inc_t,dim_t*,dim_t> iterator_base_;
-
-            public:
-                using typename iterator_base_::value_type;
-                using typename iterator_base_::difference_type;
-                using typename iterator_base_::pointer;
-                using typename iterator_base_::reference;
-                using typename iterator_base_::iterator_category;
-
-                range_iterator()
-                : pos_(0), delta_(0) {}
-
-                range_iterator(dim_t pos, inc_t delta)
-                : pos_(pos), delta_(delta) {}
-
-                range_iterator(const range_iterator& other) = default;
-
-                range_iterator& operator=(const range_iterator& other) = default;
-
-                range_iterator& operator++()
-                {
-                    pos_ += delta_;
-                    return *this;
-                }
-
-                range_iterator& operator--()
-                {
-                    pos_ -= delta_;
-                    return *this;
-                }
-
-                range_iterator operator++(int x)
-                {
-                    range_iterator old(*this);
-                    ++old;
-                    return old;
-                }
-
-                range_iterator operator--(int x)
-                {
-                    range_iterator old(*this);
-                    --old;
-                    return old;
-                }
-
-                reference operator*() const
-                {
-                    return pos_;
-                }
-
-                pointer operator->() const
-                {
-                    return nullptr;
-                }
-
-                range_iterator& operator+=(difference_type n)
-                {
-                    pos_ += n*delta_;
-                    return *this;
-                }
-
-                range_iterator& operator-=(difference_type n)
-                {
-                    pos_ -= n*delta_;
-                    return *this;
-                }
-
-                range_iterator operator+(difference_type n) const
-                {
-                    range_iterator ret(*this);
-                    ret += n;
-                    return ret;
-                }
-
-                friend range_iterator operator+(difference_type n, const range_iterator& x)
-                {
-                    range_iterator ret(x);
-                    ret += n;
-                    return ret;
-                }
-
-                range_iterator operator-(difference_type n) const
-                {
-                    range_iterator ret(*this);
-                    ret -= n;
-                    return ret;
-                }
-
-                difference_type operator-(const range_iterator& x) const
-                {
-                    return pos_ - x.pos_;
-                }
-
-                reference operator[](difference_type i) const
-                {
-                    return pos_ + i*delta_;
-                }
-
-                bool operator==(const range_iterator& other) const
-                {
-                    return pos_ == other.pos_;
-                }
-
-                bool operator!=(const range_iterator& other) const
-                {
-                    return !(*this == other);
-                }
-
-                bool operator<(const range_iterator& other) const
-                {
-                    return pos_ < other.pos_;
-                }
-
-                bool operator>(const range_iterator& other) const
-                {
-                    return other < *this;
-                }
-
-                bool operator<=(const range_iterator& other) const
-                {
-                    return !(other < *this);
-                }
-
-                bool operator>=(const range_iterator& other) const
-                {
-                    return !(*this < other);
-                }
-
-            private:
-                dim_t pos_;
-                inc_t delta_;
-        };
-
-        range(dim_t start, dim_t stop, inc_t delta)
-        : start_(start), stop_(stop), delta_(delta == 0 ? stop-start : delta) {}
-
-        range_iterator begin() const
-        {
-            return range_iterator(start_, delta_);
-        }
-
-        range_iterator end() const
-        {
-            return range_iterator(stop_+delta_, delta_);
-        }
-
-        range_iterator cbegin() const
-        {
-            return range_iterator(stop_, -delta_);
-        }
-
-        range_iterator cend() const
-        {
-            return range_iterator(start_-delta_, -delta_);
-        }
-
-    private:
-        dim_t start_, stop_;
-        inc_t delta_;
+    MemoryType type[3] = {MEMORY_HBM, MEMORY_HBM, MEMORY_HBM};
+    string obtained[3];
 };
 
-range parse_range(const string& s)
-{
-    dim_t mn, mx;
-    inc_t delta = 1;
-
-    size_t colon1 = s.find(':');
-    size_t colon2 = s.find(':', colon1 == string::npos ? colon1 : colon1+1);
-
-    if (colon1 == string::npos)
-    {
-        mn = mx = stol(s);
-    }
-    else if (colon2 == string::npos)
-    {
-        mn = stol(s.substr(0,colon1));
-        mx = stol(s.substr(colon1+1));
-    }
-    else
-    {
-        mn = stol(s.substr(0,colon1));
-        mx = stol(s.substr(colon1+1,colon2-colon1-1));
-        delta = stol(s.substr(colon2+1));
-    }
-
-    return range(mn, mx, delta);
-}
-
 template <typename T>
-double run_trial(dim_t m, dim_t n, dim_t k)
+double run_trial(dim_t m, dim_t n, dim_t k, Placement& placement)
 {
     double bias = numeric_limits<double>::max();
     for (dim_t r = 0;r < NREPEAT;r++)
@@ -222,7 +42,10 @@ double run_trial(dim_t m, dim_t n, dim_t k)
         bias = min(bias, t1-t0);
     }
 
-    AlignedMatrix<T> A(m,k), B(k,n), C(m,n);
+    PlacedMemory<T> mem_a(placement.type[0], m*k);
+    PlacedMemory<T> mem_b(placement.type[1], k*n);
+    PlacedMemory<T> mem_c(placement.type[2], m*n);
+    Matrix<T> A(m, k, mem_a.data()), B(k, n, mem_b.data()), C(m, n, mem_c.data());
     Scalar<T> alpha(1.0), beta(0.0);
 
     A = 0.0;
@@ -238,10 +61,15 @@ double run_trial(dim_t m, dim_t n, dim_t k)
         dt = min(dt, t1-t0);
     }
 
+    placement.obtained[0] = mem_a.describe();
+    placement.obtained[1] = mem_b.describe();
+    placement.obtained[2] = mem_c.describe();
+
     return 2*m*n*k*1e-9/(dt-bias);
 }
 
-void run_experiment(char dt, range m_range, range n_range, range k_range)
+void run_experiment(char dt, range m_range, range n_range, range k_range,
+                    Placement placement)
 {
     for (dim_t m : m_range)
     {
@@ -266,12 +94,14 @@ void run_experiment(char dt, range m_range, range n_range, range k_range)
                 double gflops;
                 switch (dt)
                 {
-                    case 's': gflops = run_trial<   float>(m, n, k); break;
-                    case 'd': gflops = run_trial<  double>(m, n, k); break;
-                    case 'c': gflops = run_trial<sComplex>(m, n, k); break;
-                    case 'z': gflops = run_trial<dComplex>(m, n, k); break;
+                    case 's': gflops = run_trial<   float>(m, n, k, placement); break;
+                    case 'd': gflops = run_trial<  double>(m, n, k, placement); break;
+                    case 'c': gflops = run_trial<sComplex>(m, n, k, placement); break;
+                    case 'z': gflops = run_trial<dComplex>(m, n, k, placement); break;
                 }
-                printf("%d %d %d %f\n", m, n, k, gflops);
+                printf("%d %d %d %f %s %s %s\n", m, n, k, gflops,
+                       placement.obtained[0].c_str(), placement.obtained[1].c_str(),
+                       placement.obtained[2].c_str());
 		fflush(stdout);
 
                 if (k <= 0) break;
@@ -292,7 +122,32 @@ int main(int argc, char** argv)
     string m_range, n_range, k_range;
     while (getline(cin, line) && !line.empty())
     {
-        istringstream(line) >> dt >> m_range >> n_range >> k_range;
+        istringstream iss(line);
+        iss >> dt >> m_range >> n_range >> k_range;
+
+        Placement placement;
+        vector<string> types;
+        string type;
+        while (iss >> type) types.push_back(type);
+
+        if (types.size() != 0 && types.size() != 1 && types.size() != 3)
+        {
+            cerr << "Expected one or three memory types" << endl;
+            exit(1);
+        }
+
+        try
+        {
+            for (int i = 0;i < (int)types.size();i++)
+                placement.type[i] = parse_memory_type(types[i]);
+            if (types.size() == 1)
+                placement.type[1] = placement.type[2] = placement.type[0];
+        }
+        catch (const invalid_argument& e)
+        {
+            cerr << e.what() << endl;
+            exit(1);
+        }
 
         if (string("sdcz").find(dt) == string::npos)
         {
@@ -306,7 +161,7 @@ int main(int argc, char** argv)
         range n = parse_range(n_range);
         range k = parse_range(k_range);
 
-        run_experiment(dt, m, n, k);
+        run_experiment(dt, m, n, k, placement);
     }
 
     bli_finalize();
@@ -0,0 +1,606 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <getopt.h>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blis++.hpp"
+#include "profile.hpp"
+
+using namespace std;
+using namespace blis;
+
+/*
+ * Machine ceilings for the roofline model: sustained memory bandwidth
+ * (the four STREAM kernels) for each placement and thread count, and the
+ * peak floating point rate for each datatype and thread count. Results
+ * from blis_bench (its CSV output) are then placed under the roof.
+ *
+ * Placements are the memory types of AlignedAllocator (ddr_4k ... hbm_1g,
+ * whose implementation is chosen at configure time) and the NumaAllocator
+ * policies numa_local, numa_interleave and numa_blocked.
+ */
+
+const char* aligned_allocator_backend()
+{
+#if BLISPP_HAVE_MEMKIND
+    return "memkind";
+#elif BLISPP_HAVE_LIBHUGETLBFS
+    return "libhugetlbfs";
+#elif defined(__linux__)
+    return "mmap";
+#else
+    return "posix_memalign";
+#endif
+}
+
+class StreamArray
+{
+    private:
+        PlacedMemory<double> _placed;
+        shared_ptr<void> _numa;
+        double* _ptr = nullptr;
+
+        template <NumaPolicy Policy>
+        void allocate_numa(size_t n)
+        {
+            auto mem = make_shared<Memory<double,NumaAllocator<double,Policy>>>(n);
+            _ptr = *mem;
+            _numa = mem;
+        }
+
+    public:
+        StreamArray(const string& placement, size_t n)
+        {
+            if      (placement == "numa_local")      allocate_numa<NUMA_LOCAL>(n);
+            else if (placement == "numa_interleave") allocate_numa<NUMA_INTERLEAVE>(n);
+            else if (placement == "numa_blocked")    allocate_numa<NUMA_BLOCKED>(n);
+            else _ptr = _placed.reset(parse_memory_type(placement), n);
+        }
+
+        double* data() const
+        {
+            return _ptr;
+        }
+
+        size_t page_size() const
+        {
+            return detail::backing_page_size(_ptr);
+        }
+
+        int numa_node() const
+        {
+            return detail::numa_node_of(_ptr);
+        }
+};
+
+enum StreamKernel
+{
+    STREAM_COPY,
+    STREAM_SCALE,
+    STREAM_ADD,
+    STREAM_TRIAD,
+    STREAM_KERNELS
+};
+
+const char* stream_names[STREAM_KERNELS] = {"copy", "scale", "add", "triad"};
+
+const double stream_words[STREAM_KERNELS] = {2, 2, 3, 3};
+
+struct Bandwidth
+{
+    string placement;
+    int threads;
+    size_t page_size;
+    int node;
+    double gbs[STREAM_KERNELS];
+};
+
+/*
+ * STREAM proper: the best of reps runs of each kernel (the first being
+ * discarded as warm-up), with every thread working on a fixed contiguous
+ * share of the arrays, the same share that it first touched.
+ */
+Bandwidth run_stream(const string& placement, int nthreads, size_t n, int reps)
+{
+    const double scalar = 3.0;
+
+    ThreadPool pool(nthreads);
+
+    StreamArray a_(placement, n), b_(placement, n), c_(placement, n);
+    double* a = a_.data();
+    double* b = b_.data();
+    double* c = c_.data();
+
+    auto parallel = [&](const function<void(size_t,size_t)>& body)
+    {
+        pool.run([&](int tid, int nt)
+        {
+            body(n*tid/nt, n*(tid+1)/nt);
+        });
+    };
+
+    parallel([&](size_t first, size_t last)
+    {
+        for (size_t i = first;i < last;i++)
+        {
+            a[i] = 1.0;
+            b[i] = 2.0;
+            c[i] = 0.0;
+        }
+    });
+
+    double best[STREAM_KERNELS];
+    for (int kernel = 0;kernel < STREAM_KERNELS;kernel++)
+        best[kernel] = numeric_limits<double>::max();
+
+    for (int r = 0;r < reps+1;r++)
+    {
+        double times[STREAM_KERNELS];
+        double t0;
+
+        t0 = bli_clock();
+        parallel([&](size_t first, size_t last)
+        {
+            for (size_t i = first;i < last;i++) c[i] = a[i];
+        });
+        times[STREAM_COPY] = bli_clock()-t0;
+
+        t0 = bli_clock();
+        parallel([&](size_t first, size_t last)
+        {
+            for (size_t i = first;i < last;i++) b[i] = scalar*c[i];
+        });
+        times[STREAM_SCALE] = bli_clock()-t0;
+
+        t0 = bli_clock();
+        parallel([&](size_t first, size_t last)
+        {
+            for (size_t i = first;i < last;i++) c[i] = a[i]+b[i];
+        });
+        times[STREAM_ADD] = bli_clock()-t0;
+
+        t0 = bli_clock();
+        parallel([&](size_t first, size_t last)
+        {
+            for (size_t i = first;i < last;i++) a[i] = b[i]+scalar*c[i];
+        });
+        times[STREAM_TRIAD] = bli_clock()-t0;
+
+        if (r == 0) continue;
+
+        for (int kernel = 0;kernel < STREAM_KERNELS;kernel++)
+            best[kernel] = min(best[kernel], times[kernel]);
+    }
+
+    /*
+     * Check the results against the same recurrence on scalars.
+     */
+    double aj = 1.0, bj = 2.0, cj = 0.0;
+    for (int r = 0;r < reps+1;r++)
+    {
+        cj = aj;
+        bj = scalar*cj;
+        cj = aj+bj;
+        aj = bj+scalar*cj;
+    }
+
+    double a_err = 0, b_err = 0, c_err = 0;
+    for (size_t i = 0;i < n;i++)
+    {
+        a_err += fabs(a[i]-aj);
+        b_err += fabs(b[i]-bj);
+        c_err += fabs(c[i]-cj);
+    }
+
+    if (a_err/n > 1e-13*fabs(aj) || b_err/n > 1e-13*fabs(bj) || c_err/n > 1e-13*fabs(cj))
+        cerr << "STREAM validation failed for " << placement << endl;
+
+    Bandwidth bw{placement, nthreads, a_.page_size(), a_.numa_node(), {}};
+    for (int kernel = 0;kernel < STREAM_KERNELS;kernel++)
+        bw.gbs[kernel] = stream_words[kernel]*sizeof(double)*n*1e-9/best[kernel];
+
+    return bw;
+}
+
+/*
+ * Peak rate as seen through BLIS: every thread repeatedly multiplies its
+ * own cache-resident size x size matrices for at least min_time seconds,
+ * so that nearly all of the time is spent in the gemm microkernel. The
+ * result is the sum of the per-thread rates. BLIS itself should be run
+ * single-threaded (e.g. BLIS_NUM_THREADS=1) so that it does not
+ * oversubscribe the cores.
+ */
+template <typename T>
+double probe_peak(int nthreads, dim_t size, double min_time)
+{
+    ThreadPool pool(nthreads);
+    vector<double> rates(nthreads);
+
+    double flops = 2.0*size*size*size;
+    if (is_complex<T>::value) flops *= 4;
+
+    pool.run([&](int tid, int)
+    {
+        Matrix<T> A(size, size), B(size, size), C(size, size);
+        Scalar<T> alpha(1.0), beta(0.0);
+
+        A = T(1);
+        B = T(1);
+        C = T(0);
+
+        bli_gemm(alpha, A, B, beta, C);
+
+        long calls = 0;
+        double t0 = bli_clock();
+        double t;
+        do
+        {
+            bli_gemm(alpha, A, B, beta, C);
+            calls++;
+        }
+        while ((t = bli_clock()-t0) < min_time);
+
+        rates[tid] = calls*flops/t;
+    });
+
+    double rate = 0;
+    for (double r : rates) rate += r;
+    return rate*1e-9;
+}
+
+double probe_peak(char dt, int nthreads, dim_t size, double min_time)
+{
+    switch (dt)
+    {
+        case 's': return probe_peak<   float>(nthreads, size, min_time);
+        case 'd': return probe_peak<  double>(nthreads, size, min_time);
+        case 'c': return probe_peak<sComplex>(nthreads, size, min_time);
+        default:  return probe_peak<dComplex>(nthreads, size, min_time);
+    }
+}
+
+/*
+ * One result row of blis_bench's CSV output.
+ */
+struct BenchResult
+{
+    string op;
+    char dt;
+    string variant;
+    long m, n, k;
+    double gflops;
+    double gbs;
+    vector<string> memory;
+};
+
+vector<string> split_csv(const string& line)
+{
+    vector<string> fields;
+
+    size_t pos = 0;
+    while (true)
+    {
+        size_t next = line.find(',', pos);
+        fields.push_back(line.substr(pos, next == string::npos ? string::npos : next-pos));
+        if (next == string::npos) break;
+        pos = next+1;
+    }
+
+    return fields;
+}
+
+vector<BenchResult> read_bench(const string& path)
+{
+    ifstream ifs(path);
+    if (!ifs) throw runtime_error("cannot read " + path);
+
+    string line;
+    if (!getline(ifs, line)) return {};
+
+    map<string,size_t> column;
+    vector<string> header = split_csv(line);
+    for (size_t i = 0;i < header.size();i++) column[header[i]] = i;
+
+    for (const char* name : {"op", "dt", "variant", "m", "n", "k", "gflops", "gbytes_per_s"})
+        if (!column.count(name))
+            throw runtime_error(path + " is not blis_bench CSV output (no " + name + " column)");
+
+    vector<BenchResult> results;
+    while (getline(ifs, line))
+    {
+        if (line.empty()) continue;
+
+        vector<string> f = split_csv(line);
+        if (f.size() != header.size())
+            throw runtime_error("malformed line in " + path + ": " + line);
+
+        BenchResult r;
+        r.op = f[column["op"]];
+        r.dt = f[column["dt"]][0];
+        r.variant = f[column["variant"]];
+        r.m = stol(f[column["m"]]);
+        r.n = stol(f[column["n"]]);
+        r.k = stol(f[column["k"]]);
+        r.gflops = stod(f[column["gflops"]]);
+        r.gbs = stod(f[column["gbytes_per_s"]]);
+
+        for (const char* name : {"mem_a", "mem_b", "mem_c"})
+            if (column.count(name) && !f[column[name]].empty())
+                r.memory.push_back(f[column[name]]);
+
+        results.push_back(r);
+    }
+
+    return results;
+}
+
+struct Options
+{
+    vector<string> placements = {"ddr_4k", "hbm_4k", "ddr_2m", "hbm_2m", "ddr_1g", "hbm_1g"};
+    vector<int> threads;
+    size_t length = CacheFlusher::default_size()/sizeof(double);
+    int reps = 10;
+    string dts = "sdcz";
+    dim_t probe_size = 192;
+    double probe_time = 0.5;
+    string bench;
+    int bench_threads = 0;
+};
+
+void usage(const char* prog)
+{
+    cerr <<
+"Usage: " << prog << " [options]\n"
+"\n"
+"  -M, --memory=LIST        placements to measure: any of ddr_4k hbm_4k ddr_2m\n"
+"                           hbm_2m ddr_1g hbm_1g (AlignedAllocator) and\n"
+"                           numa_local numa_interleave numa_blocked\n"
+"                           (NumaAllocator) (default: all memory types)\n"
+"  -t, --threads=LIST       thread counts, as N or MIN:MAX:STEP (default 1\n"
+"                           and the number of hardware threads)\n"
+"  -N, --length=N           STREAM array length (default 4x LLC per array)\n"
+"  -r, --reps=N             STREAM repetitions (default 10)\n"
+"  -d, --dt=TYPES           datatypes to probe, any of sdcz (default sdcz)\n"
+"  -s, --probe-size=N       matrix size for the peak probe (default 192)\n"
+"  -S, --probe-time=SEC     minimum time per peak probe (default 0.5)\n"
+"  -b, --bench=FILE         blis_bench CSV results to place under the roof\n"
+"  -T, --bench-threads=N    thread count those results were run with\n"
+"                           (default: the largest of --threads)\n"
+"\n"
+"The roof for each result is min(peak, AI x bandwidth), where AI is the\n"
+"result's GFLOPS over its compulsory GB/s and the bandwidth is the STREAM\n"
+"triad rate of the fastest placement among its operands. Run BLIS\n"
+"single-threaded (BLIS_NUM_THREADS=1); the threads here are this\n"
+"program's own.\n";
+}
+
+Options parse_options(int argc, char** argv)
+{
+    Options opt;
+
+    static const option longopts[] =
+    {
+        {"memory",        required_argument, nullptr, 'M'},
+        {"threads",       required_argument, nullptr, 't'},
+        {"length",        required_argument, nullptr, 'N'},
+        {"reps",          required_argument, nullptr, 'r'},
+        {"dt",            required_argument, nullptr, 'd'},
+        {"probe-size",    required_argument, nullptr, 's'},
+        {"probe-time",    required_argument, nullptr, 'S'},
+        {"bench",         required_argument, nullptr, 'b'},
+        {"bench-threads", required_argument, nullptr, 'T'},
+        {"help",          no_argument,       nullptr, 'h'},
+        {nullptr,         0,                 nullptr,  0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "M:t:N:r:d:s:S:b:T:h", longopts, nullptr)) != -1)
+    {
+        switch (c)
+        {
+            case 'M': opt.placements = split_list(optarg); break;
+            case 't':
+                for (const string& r : split_list(optarg))
+                    for (dim_t t : parse_range(r)) opt.threads.push_back(t);
+                break;
+            case 'N': opt.length = strtoull(optarg, nullptr, 10); break;
+            case 'r': opt.reps = atoi(optarg); break;
+            case 'd': opt.dts = optarg; break;
+            case 's': opt.probe_size = atol(optarg); break;
+            case 'S': opt.probe_time = atof(optarg); break;
+            case 'b': opt.bench = optarg; break;
+            case 'T': opt.bench_threads = atoi(optarg); break;
+            case 'h': usage(argv[0]); exit(0);
+            default:  usage(argv[0]); exit(1);
+        }
+    }
+
+    if (opt.threads.empty())
+    {
+        /*
+         * Not BLIS_NUM_THREADS, which is meant to be 1 here.
+         */
+        int hw = max(1u, thread::hardware_concurrency());
+        opt.threads.push_back(1);
+        if (hw > 1) opt.threads.push_back(hw);
+    }
+
+    for (int t : opt.threads)
+    {
+        if (t < 1)
+        {
+            cerr << "Thread counts must be positive" << endl;
+            exit(1);
+        }
+    }
+
+    if (opt.bench_threads == 0)
+        opt.bench_threads = *max_element(opt.threads.begin(), opt.threads.end());
+
+    for (const string& placement : opt.placements)
+    {
+        if (placement.compare(0, 5, "numa_") == 0) continue;
+
+        try
+        {
+            parse_memory_type(placement);
+        }
+        catch (const invalid_argument& e)
+        {
+            cerr << e.what() << endl;
+            exit(1);
+        }
+    }
+
+    for (char dt : opt.dts)
+    {
+        if (string("sdcz").find(dt) == string::npos)
+        {
+            cerr << "Unknown datatype: " << dt << endl;
+            exit(1);
+        }
+    }
+
+    if (opt.reps < 1 || opt.length == 0)
+    {
+        cerr << "Empty STREAM run" << endl;
+        exit(1);
+    }
+
+    return opt;
+}
+
+int main(int argc, char** argv)
+{
+    Options opt = parse_options(argc, argv);
+
+    bli_init();
+
+    vector<BenchResult> results;
+    if (!opt.bench.empty())
+    {
+        try
+        {
+            results = read_bench(opt.bench);
+        }
+        catch (const exception& e)
+        {
+            cerr << e.what() << endl;
+            exit(1);
+        }
+
+        /*
+         * The bench thread count must have been measured, as must every
+         * datatype that appears in the results.
+         */
+        if (find(opt.threads.begin(), opt.threads.end(), opt.bench_threads) == opt.threads.end())
+            opt.threads.push_back(opt.bench_threads);
+
+        for (const BenchResult& r : results)
+            if (opt.dts.find(r.dt) == string::npos) opt.dts += r.dt;
+    }
+
+    printf("STREAM: %zu doubles (%s) per array, best of %d, AlignedAllocator backend %s\n\n",
+           opt.length, page_size_name(opt.length*sizeof(double)).c_str(), opt.reps,
+           aligned_allocator_backend());
+    printf("%-16s %7s %5s %4s", "placement", "threads", "page", "node");
+    for (const char* name : stream_names) printf(" %10s", (string(name) + " GB/s").c_str());
+    printf("\n");
+
+    map<string,map<int,double>> triad;
+    for (const string& placement : opt.placements)
+    {
+        for (int t : opt.threads)
+        {
+            Bandwidth bw;
+            try
+            {
+                bw = run_stream(placement, t, opt.length, opt.reps);
+            }
+            catch (const bad_alloc&)
+            {
+                printf("%-16s %7d (not available)\n", placement.c_str(), t);
+                break;
+            }
+
+            printf("%-16s %7d %5s %4d", placement.c_str(), t,
+                   page_size_name(bw.page_size).c_str(), bw.node);
+            for (double gbs : bw.gbs) printf(" %10.2f", gbs);
+            printf("\n");
+            fflush(stdout);
+
+            triad[placement][t] = bw.gbs[STREAM_TRIAD];
+        }
+    }
+
+    printf("\nPeak: gemm on %ldx%ld operands per thread\n\n", (long)opt.probe_size,
+           (long)opt.probe_size);
+    printf("%2s %7s %10s\n", "dt", "threads", "GFLOPS");
+
+    map<char,map<int,double>> peak;
+    for (char dt : opt.dts)
+    {
+        for (int t : opt.threads)
+        {
+            peak[dt][t] = probe_peak(dt, t, opt.probe_size, opt.probe_time);
+            printf("%2c %7d %10.2f\n", dt, t, peak[dt][t]);
+            fflush(stdout);
+        }
+    }
+
+    if (!results.empty())
+    {
+        int t = opt.bench_threads;
+
+        printf("\nRoofline: %s at %d threads\n\n", opt.bench.c_str(), t);
+        printf("%-7s %2s %-5s %7s %7s %7s %9s %8s %9s %-8s %9s  %s\n", "op", "dt", "var",
+               "m", "n", "k", "GFLOPS", "AI", "roof", "bound", "fraction", "memory");
+
+        for (const BenchResult& r : results)
+        {
+            /*
+             * Results whose placement was not measured (or predates
+             * placement reporting) get the best bandwidth measured,
+             * marked with a *.
+             */
+            double bw = 0;
+            for (const string& mem : r.memory)
+                if (triad.count(mem) && triad[mem].count(t)) bw = max(bw, triad[mem][t]);
+
+            bool guessed = bw == 0;
+            if (guessed)
+                for (auto& placement : triad)
+                    if (placement.second.count(t)) bw = max(bw, placement.second[t]);
+
+            double ai = r.gbs > 0 ? r.gflops/r.gbs : 0;
+            double roof = peak[r.dt][t];
+            bool memory_bound = ai > 0 && bw > 0 && ai*bw < roof;
+            if (memory_bound) roof = ai*bw;
+
+            string memory;
+            for (const string& mem : r.memory) memory += (memory.empty() ? "" : ",") + mem;
+
+            printf("%-7s %2c %-5s %7ld %7ld %7ld %9.3f %8.3f %9.3f %-8s %8.1f%%%s %s\n",
+                   r.op.c_str(), r.dt, r.variant.c_str(), r.m, r.n, r.k, r.gflops,
+                   ai, roof, memory_bound ? "memory" : "compute",
+                   roof > 0 ? 100*r.gflops/roof : 0.0, guessed ? "*" : " ",
+                   memory.empty() ? "-" : memory.c_str());
+        }
+    }
+
+    bli_finalize();
+
+    return 0;
+}